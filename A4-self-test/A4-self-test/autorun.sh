@@ -31,6 +31,13 @@ cp images/emptydisk.img runs/case16-concurrent-mkdir.img
 cp images/emptydisk.img runs/case17-concurrent-all-one-time.img
 cp images/emptydisk.img runs/case18-concurrent-all-five-times.img
 
+# Operations run in one process by out/tools/ext2_run (build out/tools
+# first); their results go to results/ next to the dumps
+cp images/twolevel.img runs/case19-rename.img
+cp images/manyfiles.img runs/case20-rm-r.img
+cp images/emptydisk.img runs/case21-cp-r.img
+cp images/twolevel.img runs/case22-mkdir-p.img
+
 #--- Now, do the test cases ---
 
 # Copy
@@ -79,6 +86,34 @@ wrappers/ext2_concurrent_all_one_time runs/case17-concurrent-all-one-time.img
 echo "Concurrency Test 18"
 wrappers/ext2_concurrent_all_five_times runs/case18-concurrent-all-five-times.img
 
+# Rename
+echo "Rename Test 19"
+wrappers/ext2_ops runs/case19-rename.img "rename /afile /level1/afile2" \
+	"rename /level1/level2 /level2" "rename /level2 /level2/sub" \
+	"rename /level1/afile2 /level2/bfile" "rename /lost+found /level2/bfile" \
+	"rename /level2/bfile /level1" "rename /level1 /level2" \
+	"rename /level2/bfile /level2/bfile2" > results/case19-rename.log
+
+# Recursive remove
+echo "Remove Test 20"
+wrappers/ext2_ops runs/case20-rm-r.img "rm_r /level1/" "rm_r /c.txt" \
+	"rm_r /a.txt/" "rm_r /nope" "rm_r /" "rm_r /folder2/." \
+	"rm_r /folder2" > results/case20-rm-r.log
+
+# Recursive import (files/tree holds one file, so the layout does not
+# depend on the order the host lists it in)
+echo "Import Test 21"
+wrappers/ext2_ops runs/case21-cp-r.img "mkdir_p /tree/sub" \
+	"cp ../bin/files/oneblock.txt /tree/sub/c.txt" "cp_r ../bin/files/tree /" \
+	"mkdir_p /t/tree/sub" "cp_r ../bin/files/tree /t" "cp_r ../bin/files/tree /u" \
+	"cp_r ../bin/files/oneblock.txt /one" "cp_r ../bin/nope /x" > results/case21-cp-r.log
+
+# mkdir -p, with "." and ".." taken relative to where they appear
+echo "Mkdir -p Test 22"
+wrappers/ext2_ops runs/case22-mkdir-p.img "mkdir_p /level1/level2/../q" \
+	"mkdir_p /level1/./level2/../../r/s/" "mkdir_p /afile/x" \
+	"mkdir_p /level1/level2/bfile" "mkdir_p /level1" "mkdir_p rel" > results/case22-mkdir-p.log
+
 # --- Now do the dumps ---
 the_files="$(ls runs)"
 for the_file in $the_files
@@ -0,0 +1,164 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Microbenchmark for the bitmap summary tree (src/bmtree.c).
+ *
+ * For a bitmap filled to 0%, 90% and 99%, measures the average time 
+ * of first-fit, goal-fit, first run of RUN_LEN free bits, largest run
+ * and a single-bit update, next to the plain linear bitmap scans the 
+ * tree replaces. Each fill level is run with used bits spread 
+ * uniformly and packed at the low end (the shape a first-fit 
+ * allocator leaves behind).
+ *
+ * usage: ./bmtree_bench [nbits] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "e2fs.h"
+
+#define RUN_LEN 8
+
+/*
+ * Returns: monotonic time in nanoseconds.
+ */
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Bit helpers, kept local so the benchmark only links bmtree.c.
+ */
+static int bit_used(uint8_t *bitmap, int n) {
+	return bitmap[n / 8] & (1 << (n % 8));
+}
+
+/*
+ * Linear first free bit at or after goal, wrapping once.
+ */
+static int scan_free(uint8_t *bitmap, int nbits, int goal) {
+	for (int k = 0; k < nbits; k++) {
+		int i = (goal + k) % nbits;
+		if (!bit_used(bitmap, i)) return i;
+	}
+	return -1;
+}
+
+/*
+ * Linear first run of len free bits.
+ */
+static int scan_run(uint8_t *bitmap, int nbits, int len) {
+	int run = 0;
+	for (int i = 0; i < nbits; i++) {
+		run = bit_used(bitmap, i) ? 0 : run + 1;
+		if (run == len) return i - len + 1;
+	}
+	return -1;
+}
+
+/*
+ * Marks fill_pct percent of the bits used, either uniformly at random
+ * or as one used prefix.
+ */
+static void fill_bitmap(uint8_t *bitmap, int nbits, int fill_pct, int packed) {
+	memset(bitmap, 0, (nbits + 7) / 8);
+	for (int i = 0; i < nbits; i++) {
+		int used = packed ? (long)i * 100 < (long)nbits * fill_pct 
+				  : rand() % 1000 < fill_pct * 10;
+		if (used) bitmap[i / 8] |= 1 << (i % 8);
+	}
+}
+
+static void bench_fill(int nbits, int iters, int fill_pct, int packed) {
+	uint8_t *bitmap = malloc((nbits + 7) / 8);
+	int *goals = malloc(sizeof(int) * iters);
+	struct bm_tree tree;
+	volatile int sink = 0;
+
+	srand(369 + fill_pct);
+	fill_bitmap(bitmap, nbits, fill_pct, packed);
+	for (int i = 0; i < iters; i++) goals[i] = rand() % nbits;
+
+	double t0 = now_ns();
+	bm_tree_build(&tree, bitmap, nbits, 0);
+	double build = now_ns() - t0;
+	int free_bits = bm_tree_free_count(&tree);
+
+	double t[8];
+
+	t0 = now_ns();
+	for (int i = 0; i < iters; i++) sink += bm_find_free(&tree, 0);
+	t[0] = (now_ns() - t0) / iters;
+
+	t0 = now_ns();
+	for (int i = 0; i < iters; i++) sink += scan_free(bitmap, nbits, 0);
+	t[1] = (now_ns() - t0) / iters;
+
+	t0 = now_ns();
+	for (int i = 0; i < iters; i++) sink += bm_find_free(&tree, goals[i]);
+	t[2] = (now_ns() - t0) / iters;
+
+	t0 = now_ns();
+	for (int i = 0; i < iters; i++) sink += scan_free(bitmap, nbits, goals[i]);
+	t[3] = (now_ns() - t0) / iters;
+
+	t0 = now_ns();
+	for (int i = 0; i < iters; i++) sink += bm_find_run(&tree, RUN_LEN);
+	t[4] = (now_ns() - t0) / iters;
+
+	t0 = now_ns();
+	for (int i = 0; i < iters; i++) sink += scan_run(bitmap, nbits, RUN_LEN);
+	t[5] = (now_ns() - t0) / iters;
+
+	int start;
+	t0 = now_ns();
+	for (int i = 0; i < iters; i++) sink += bm_largest_run(&tree, &start);
+	t[6] = (now_ns() - t0) / iters;
+
+	// toggle a bit and re-summarize, as alloc/free do
+	t0 = now_ns();
+	for (int i = 0; i < iters; i++) {
+		bitmap[goals[i] / 8] ^= 1 << (goals[i] % 8);
+		bm_tree_update(&tree, goals[i]);
+	}
+	t[7] = (now_ns() - t0) / iters;
+
+	printf("{\"nbits\":%d,\"fill_pct\":%d,\"layout\":\"%s\",\"free\":%d,\"build_us\":%.1f,"
+	       "\"first_fit_ns\":%.1f,\"first_fit_scan_ns\":%.1f,"
+	       "\"goal_fit_ns\":%.1f,\"goal_fit_scan_ns\":%.1f,"
+	       "\"run%d_ns\":%.1f,\"run%d_scan_ns\":%.1f,"
+	       "\"largest_run_ns\":%.1f,\"update_ns\":%.1f}\n",
+	       nbits, fill_pct, packed ? "packed" : "uniform", free_bits, build / 1000,
+	       t[0], t[1], t[2], t[3], RUN_LEN, t[4], RUN_LEN, t[5], t[6], t[7]);
+
+	bm_tree_destroy(&tree);
+	free(goals);
+	free(bitmap);
+	(void)sink;
+}
+
+int main(int argc, char **argv) {
+	int nbits = argc > 1 ? atoi(argv[1]) : 1 << 20;
+	int iters = argc > 2 ? atoi(argv[2]) : 2000;
+	int fills[] = { 0, 90, 99 };
+
+	for (int packed = 0; packed <= 1; packed++) {
+		for (int i = 0; i < 3; i++) bench_fill(nbits, iters, fills[i], packed);
+	}
+	return 0;
+}
@@ -0,0 +1,525 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Throughput and latency benchmark for libext2fsal.so.
+ *
+ * Runs one workload in-process against a private copy of an image
+ * and prints a single JSON line with ops/sec and per-operation
+ * p50/p99/p999 latencies. The image is first filled to the requested
+ * percentage of its blocks with files under /fill.
+ *
+ * Workloads:
+ *   cp-small      copy a 1 KiB host file into a per-thread directory
+ *   cp-large      copy a -s byte host file into a per-thread directory
+ *   mkdir-fanout  create directories in one shared parent
+ *   deep-lookup   resolve a -d level deep path (mkdir of an existing
+ *                 path, so only the lookup runs; EEXIST is expected)
+ *   ln-rm         alternate hard and symbolic links to one file
+ *   mixed         random mix of all of the above
+ *
+ * Each thread cycles through a fixed number of name slots, sized from
+ * the free inodes and blocks after setup, and removes a slot's old
+ * entry (timed as rm / rm_r) before reusing it, so any number of ops
+ * fits on even the smallest image.
+ *
+ * usage: ./fsal_bench -i image -w workload [-t threads] [-n ops]
+ *                     [-f fill] [-s size] [-d depth] [-r seed]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "e2fs.h"
+#include "ext2fsal.h"
+
+#define SMALL_SIZE   1024
+#define FILL_SIZE    (12 * EXT2_BLOCK_SIZE)   // direct blocks only
+#define MAX_SLOTS    256
+// entries that fit in a directory's direct blocks, at 20 bytes per
+// entry and with one block to spare
+#define DIR_MAX_ENTRIES  ((11 * EXT2_BLOCK_SIZE) / 20)
+#define NAME_LEN     256
+
+enum workload { W_CP_SMALL, W_CP_LARGE, W_MKDIR_FANOUT, W_DEEP_LOOKUP,
+	W_LN_RM, W_MIXED, W_COUNT };
+
+static const char *workload_names[W_COUNT] = {
+	"cp-small", "cp-large", "mkdir-fanout", "deep-lookup", "ln-rm", "mixed",
+};
+
+enum op_kind { K_CP, K_MKDIR, K_LOOKUP, K_LN_HL, K_LN_SL, K_RM, K_RM_R, K_COUNT };
+
+static const char *kind_names[K_COUNT] = {
+	"cp", "mkdir", "lookup", "ln_hl", "ln_sl", "rm", "rm_r",
+};
+
+enum slot_state { SLOT_EMPTY, SLOT_FILE, SLOT_DIR };
+
+struct lat_vec {
+	uint64_t *ns;
+	int count;
+	int cap;
+	int errors;
+};
+
+struct worker {
+	pthread_t thread;
+	int id;
+	unsigned int seed;
+	uint64_t start_ns, end_ns;
+	uint8_t slots[MAX_SLOTS];
+	struct lat_vec lat[K_COUNT];
+};
+
+// run configuration
+static enum workload workload;
+static int num_threads = 1;
+static int ops_per_thread = 1000;
+static int fill_pct = 0;
+static int large_size = 64 * 1024;
+static int depth = 16;
+static int num_slots;
+
+static char small_src[NAME_LEN];
+static char large_src[NAME_LEN];
+static char deep_path[PATH_MAX];
+static pthread_barrier_t start_barrier;
+
+/*
+ * Returns: monotonic time in nanoseconds.
+ */
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void die(const char *msg) {
+	fprintf(stderr, "fsal_bench: %s\n", msg);
+	exit(2);
+}
+
+static void lat_push(struct lat_vec *v, uint64_t ns) {
+	if (v->count == v->cap) {
+		v->cap = v->cap ? 2 * v->cap : 1024;
+		v->ns = realloc(v->ns, v->cap * sizeof(uint64_t));
+		if (v->ns == NULL) die("out of memory");
+	}
+	v->ns[v->count++] = ns;
+}
+
+// ------------------------------ SETUP ------------------------------
+
+/*
+ * Copies the file at src to dst.
+ */
+static void copy_file(const char *src, const char *dst) {
+	char buf[65536];
+	ssize_t n;
+
+	int in = open(src, O_RDONLY);
+	int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (in < 0 || out < 0) die("cannot copy image");
+
+	while ((n = read(in, buf, sizeof(buf))) > 0) {
+		if (write(out, buf, n) != n) die("cannot copy image");
+	}
+	close(in);
+	close(out);
+}
+
+/*
+ * Creates a host file of size bytes in a fresh temporary file whose
+ * name is stored in path.
+ */
+static void make_host_file(char *path, int size) {
+	strcpy(path, "/tmp/fsal_bench_src.XXXXXX");
+	int fd = mkstemp(path);
+	if (fd < 0) die("cannot create host file");
+
+	char block[EXT2_MIN_BLOCK_SIZE];
+	for (int i = 0; i < EXT2_MIN_BLOCK_SIZE; i++) block[i] = 'a' + i % 26;
+
+	for (int left = size; left > 0; left -= EXT2_MIN_BLOCK_SIZE) {
+		int n = left < EXT2_MIN_BLOCK_SIZE ? left : EXT2_MIN_BLOCK_SIZE;
+		if (write(fd, block, n) != n) die("cannot create host file");
+	}
+	close(fd);
+}
+
+/*
+ * Fills the image with FILL_SIZE files under /fill until fill_pct
+ * percent of its blocks are in use, keeping a few inodes back.
+ *
+ * Returns: the fill percentage actually reached.
+ */
+static int prefill(void) {
+	char fill_src[NAME_LEN];
+	char dst[NAME_LEN];
+
+	if (ext2_fsal_mkdir("/fill") != 0) die("cannot create /fill");
+	make_host_file(fill_src, FILL_SIZE);
+
+	int total = superblock->s_blocks_count;
+	for (int i = 0; ; i++) {
+		int used = total - superblock->s_free_blocks_count;
+		if (used * 100 >= fill_pct * total) break;
+		if (superblock->s_free_inodes_count <= 2 * (uint32_t)num_threads + 4) break;
+
+		snprintf(dst, sizeof(dst), "/fill/f%d", i);
+		if (ext2_fsal_cp(fill_src, dst) != 0) break;
+	}
+
+	unlink(fill_src);
+	return (total - superblock->s_free_blocks_count) * 100 / total;
+}
+
+/*
+ * Creates the directories and files the workload operates on.
+ */
+static void setup_workload(void) {
+	char path[NAME_LEN];
+
+	for (int t = 0; t < num_threads; t++) {
+		snprintf(path, sizeof(path), "/t%d", t);
+		if (ext2_fsal_mkdir(path) != 0) die("cannot create thread directory");
+	}
+
+	if (workload == W_MKDIR_FANOUT) {
+		if (ext2_fsal_mkdir("/fan") != 0) die("cannot create /fan");
+	}
+	if (workload == W_LN_RM || workload == W_MIXED) {
+		if (ext2_fsal_mkdir("/churn") != 0) die("cannot create /churn");
+		if (ext2_fsal_cp(small_src, "/churn/f") != 0) die("cannot create /churn/f");
+	}
+	if (workload != W_DEEP_LOOKUP && workload != W_MIXED) return;
+
+	// deep chain /p/p/.../p, leaving most inodes to the workload
+	int max_depth = (int)superblock->s_free_inodes_count / 
+		(workload == W_MIXED ? 4 : 2);
+	if (depth > max_depth) depth = max_depth;
+	if (depth < 1) die("image too small for deep-lookup");
+
+	deep_path[0] = '\0';
+	for (int d = 0; d < depth; d++) {
+		strcat(deep_path, "/p");
+		if (ext2_fsal_mkdir(deep_path) != 0) die("cannot create deep path");
+	}
+}
+
+/*
+ * Sizes the per-thread slot count so that every slot can be occupied
+ * at once, keeping 10% of the free blocks for directory growth and
+ * the shared fanout directory within its direct blocks.
+ */
+static void size_slots(void) {
+	int inode_cost = (workload == W_DEEP_LOOKUP) ? 0 : 1;
+	int block_cost = 1;
+	if (workload == W_CP_LARGE || workload == W_MIXED) {
+		block_cost = (large_size + EXT2_BLOCK_SIZE - 1) / EXT2_BLOCK_SIZE;
+		if (block_cost > 12) block_cost++;   // indirect block
+	}
+
+	int free_inodes = superblock->s_free_inodes_count - 2;
+	int free_blocks = superblock->s_free_blocks_count * 9 / 10 - 2;
+
+	num_slots = MAX_SLOTS;
+	if (inode_cost > 0 && free_inodes / (inode_cost * num_threads) < num_slots)
+		num_slots = free_inodes / (inode_cost * num_threads);
+	if (free_blocks / (block_cost * num_threads) < num_slots)
+		num_slots = free_blocks / (block_cost * num_threads);
+	if (ops_per_thread < num_slots) num_slots = ops_per_thread;
+	if (workload == W_MKDIR_FANOUT && DIR_MAX_ENTRIES / num_threads < num_slots)
+		num_slots = DIR_MAX_ENTRIES / num_threads;
+
+	if (num_slots < 1) die("image too small for workload at this thread count");
+}
+
+// ----------------------------- WORKERS -----------------------------
+
+/*
+ * Runs one timed operation and records its latency and whether the
+ * result matched expect.
+ *
+ * Returns: 1 if the result matched, 0 otherwise.
+ */
+static int timed(struct worker *w, enum op_kind kind, int expect,
+		const char *a, const char *b) {
+	int32_t r;
+	uint64_t start = now_ns();
+
+	switch (kind) {
+		case K_CP:     r = ext2_fsal_cp(a, b); break;
+		case K_MKDIR:
+		case K_LOOKUP: r = ext2_fsal_mkdir(a); break;
+		case K_LN_HL:  r = ext2_fsal_ln_hl(a, b); break;
+		case K_LN_SL:  r = ext2_fsal_ln_sl(a, b); break;
+		case K_RM:     r = ext2_fsal_rm(a); break;
+		default:       r = ext2_fsal_rm_r(a); break;
+	}
+
+	lat_push(&w->lat[kind], now_ns() - start);
+	if (r != expect) {
+		w->lat[kind].errors++;
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Removes whatever occupies slot so its name can be reused.
+ */
+static void clear_slot(struct worker *w, int slot, const char *path) {
+	if (w->slots[slot] == SLOT_FILE) timed(w, K_RM, 0, path, NULL);
+	else if (w->slots[slot] == SLOT_DIR) timed(w, K_RM_R, 0, path, NULL);
+	w->slots[slot] = SLOT_EMPTY;
+}
+
+/*
+ * Runs a single operation of workload wl on slot.
+ */
+static void run_one(struct worker *w, enum workload wl, int i, int slot) {
+	char path[NAME_LEN];
+
+	if (wl == W_DEEP_LOOKUP) {
+		timed(w, K_LOOKUP, EEXIST, deep_path, NULL);
+		return;
+	}
+
+	if (wl == W_MKDIR_FANOUT) {
+		snprintf(path, sizeof(path), "/fan/t%d_%d", w->id, slot);
+	} else {
+		snprintf(path, sizeof(path), "/t%d/s%d", w->id, slot);
+	}
+	clear_slot(w, slot, path);
+
+	switch (wl) {
+		case W_CP_SMALL:
+			if (timed(w, K_CP, 0, small_src, path)) w->slots[slot] = SLOT_FILE;
+			break;
+		case W_CP_LARGE:
+			if (timed(w, K_CP, 0, large_src, path)) w->slots[slot] = SLOT_FILE;
+			break;
+		case W_MKDIR_FANOUT:
+			if (timed(w, K_MKDIR, 0, path, NULL)) w->slots[slot] = SLOT_DIR;
+			break;
+		case W_LN_RM:
+			if (timed(w, (i & 1) ? K_LN_SL : K_LN_HL, 0, "/churn/f", path))
+				w->slots[slot] = SLOT_FILE;
+			break;
+		default:
+			break;
+	}
+}
+
+static void *worker_main(void *arg) {
+	struct worker *w = arg;
+	static const enum workload mix[] = {
+		W_CP_SMALL, W_CP_SMALL, W_CP_SMALL, W_CP_LARGE, W_MKDIR_FANOUT,
+		W_MKDIR_FANOUT, W_LN_RM, W_LN_RM, W_DEEP_LOOKUP, W_DEEP_LOOKUP,
+	};
+
+	pthread_barrier_wait(&start_barrier);
+	w->start_ns = now_ns();
+
+	for (int i = 0; i < ops_per_thread; i++) {
+		int slot = i % num_slots;
+		enum workload wl = workload;
+		if (wl == W_MIXED) {
+			wl = mix[rand_r(&w->seed) % (sizeof(mix) / sizeof(mix[0]))];
+			// the slot lives in /t<id>; keep mixed dirs there as well
+			if (wl == W_MKDIR_FANOUT) {
+				char path[NAME_LEN];
+				snprintf(path, sizeof(path), "/t%d/s%d", w->id, slot);
+				clear_slot(w, slot, path);
+				if (timed(w, K_MKDIR, 0, path, NULL)) w->slots[slot] = SLOT_DIR;
+				continue;
+			}
+		}
+		run_one(w, wl, i, slot);
+	}
+
+	w->end_ns = now_ns();
+	return NULL;
+}
+
+// ----------------------------- REPORT ------------------------------
+
+static int cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Returns: the q-quantile of the sorted samples.
+ */
+static uint64_t quantile(uint64_t *sorted, int n, double q) {
+	int idx = (int)(q * n + 0.999999) - 1;
+	if (idx < 0) idx = 0;
+	if (idx >= n) idx = n - 1;
+	return sorted[idx];
+}
+
+static void report(const char *image, struct worker *workers, double secs, int fill) {
+	long total_ops = 0, total_errors = 0;
+
+	printf("{\"workload\":\"%s\",\"image\":\"%s\",\"blocks\":%u,\"inodes\":%u,"
+	       "\"fill_pct\":%d,\"threads\":%d,\"slots\":%d,\"secs\":%.6f,\"latency\":{",
+	       workload_names[workload], image, superblock->s_blocks_count,
+	       superblock->s_inodes_count, fill, num_threads, num_slots, secs);
+
+	int first = 1;
+	for (int k = 0; k < K_COUNT; k++) {
+		struct lat_vec all = { 0 };
+		uint64_t sum = 0;
+		for (int t = 0; t < num_threads; t++) {
+			struct lat_vec *v = &workers[t].lat[k];
+			for (int j = 0; j < v->count; j++) {
+				lat_push(&all, v->ns[j]);
+				sum += v->ns[j];
+			}
+			all.errors += v->errors;
+		}
+		if (all.count == 0) continue;
+
+		qsort(all.ns, all.count, sizeof(uint64_t), cmp_u64);
+		printf("%s\"%s\":{\"count\":%d,\"errors\":%d,\"mean_ns\":%llu,"
+		       "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}",
+		       first ? "" : ",", kind_names[k], all.count, all.errors,
+		       (unsigned long long)(sum / all.count),
+		       (unsigned long long)quantile(all.ns, all.count, 0.50),
+		       (unsigned long long)quantile(all.ns, all.count, 0.99),
+		       (unsigned long long)quantile(all.ns, all.count, 0.999),
+		       (unsigned long long)all.ns[all.count - 1]);
+		first = 0;
+
+		total_ops += all.count;
+		total_errors += all.errors;
+		free(all.ns);
+	}
+
+	// mapping policy, what ext2_fsal_init cost, and faults since
+	// (prefill included)
+	struct ext2_fsal_stats st;
+	ext2_fsal_stats_snapshot(&st);
+	struct ext2_fsal_mapping_stats *m = &st.mapping;
+
+	printf("},\"ops\":%ld,\"errors\":%ld,\"ops_per_sec\":%.1f,"
+	       "\"mmap\":{\"policy\":\"%s\",\"hugepages\":%s,\"init_ns\":%llu,"
+	       "\"init_minor_faults\":%llu,\"init_major_faults\":%llu,"
+	       "\"minor_faults\":%llu,\"major_faults\":%llu}}\n",
+	       total_ops, total_errors, secs > 0 ? total_ops / secs : 0.0,
+	       m->policy, m->hugepages ? "true" : "false", (unsigned long long)m->init_ns,
+	       (unsigned long long)m->init_minor_faults, (unsigned long long)m->init_major_faults,
+	       (unsigned long long)m->minor_faults, (unsigned long long)m->major_faults);
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: fsal_bench -i image -w workload [-t threads] [-n ops]"
+	                " [-f fill] [-s size] [-d depth] [-r seed]\n"
+	                "workloads: cp-small cp-large mkdir-fanout deep-lookup ln-rm mixed\n");
+	exit(2);
+}
+
+int main(int argc, char **argv) {
+	const char *image = NULL;
+	const char *wname = NULL;
+	unsigned int seed = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:w:t:n:f:s:d:r:")) != -1) {
+		switch (opt) {
+			case 'i': image = optarg; break;
+			case 'w': wname = optarg; break;
+			case 't': num_threads = atoi(optarg); break;
+			case 'n': ops_per_thread = atoi(optarg); break;
+			case 'f': fill_pct = atoi(optarg); break;
+			case 's': large_size = atoi(optarg); break;
+			case 'd': depth = atoi(optarg); break;
+			case 'r': seed = strtoul(optarg, NULL, 10); break;
+			default: usage();
+		}
+	}
+	if (image == NULL || wname == NULL) usage();
+
+	workload = W_COUNT;
+	for (int i = 0; i < W_COUNT; i++) {
+		if (strcmp(wname, workload_names[i]) == 0) workload = i;
+	}
+	if (workload == W_COUNT || num_threads < 1 || ops_per_thread < 1 ||
+	    fill_pct < 0 || fill_pct > 100 || large_size < 1 || depth < 1) usage();
+
+	// never touch the caller's image
+	char work_image[NAME_LEN];
+	strcpy(work_image, "/tmp/fsal_bench_img.XXXXXX");
+	int fd = mkstemp(work_image);
+	if (fd < 0) die("cannot create working image");
+	close(fd);
+	copy_file(image, work_image);
+
+	ext2_fsal_init(work_image);
+
+	// largest file the direct and single indirect blocks can hold
+	int max_size = (12 + EXT2_BLOCK_SIZE / 4) * EXT2_BLOCK_SIZE;
+	if (large_size > max_size) large_size = max_size;
+
+	make_host_file(small_src, SMALL_SIZE);
+	make_host_file(large_src, large_size);
+
+	int fill = prefill();
+	setup_workload();
+	size_slots();
+
+	struct worker *workers = calloc(num_threads, sizeof(struct worker));
+	if (workers == NULL) die("out of memory");
+	pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+
+	for (int t = 0; t < num_threads; t++) {
+		workers[t].id = t;
+		workers[t].seed = seed + t;
+		if (pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]) != 0)
+			die("cannot create thread");
+	}
+
+	// wall time from the first thread starting to the last finishing
+	pthread_barrier_wait(&start_barrier);
+	uint64_t start = UINT64_MAX, end = 0;
+	for (int t = 0; t < num_threads; t++) {
+		pthread_join(workers[t].thread, NULL);
+		if (workers[t].start_ns < start) start = workers[t].start_ns;
+		if (workers[t].end_ns > end) end = workers[t].end_ns;
+	}
+	double secs = (end - start) / 1e9;
+
+	const char *base = strrchr(image, '/');
+	report(base ? base + 1 : image, workers, secs, fill);
+
+	ext2_fsal_destroy();
+	unlink(work_image);
+	unlink(small_src);
+	unlink(large_src);
+
+	for (int t = 0; t < num_threads; t++) {
+		for (int k = 0; k < K_COUNT; k++) free(workers[t].lat[k].ns);
+	}
+	free(workers);
+	pthread_barrier_destroy(&start_barrier);
+	return 0;
+}
@@ -0,0 +1,88 @@
+#!/bin/bash
+#
+# Runs the fsal_bench workload matrix and prints one JSON line per
+# run (see fsal_bench.c for the fields). Save the output of a known
+# good build and compare against it to catch regressions.
+#
+# usage: ./run.sh [-i images] [-w workloads] [-t threads] [-n ops]
+#                 [-f fills] [-s size] [-m policies]
+#
+#   -i  self-test image names (emptydisk manyfiles largefile) and/or
+#       BLOCKSxINODES[xBLOCKSIZE] to generate a fresh image with mke2fs
+#       (block size 1024, 2048 or 4096, default 1024; a single block
+#       group, so at most 8 * BLOCKSIZE blocks)
+#   -w  workloads (default: all)
+#   -t  thread counts (default: 1 2 4 8)
+#   -n  operations per thread (default: 1000)
+#   -f  fill percentages (default: 0 50)
+#   -s  cp-large file size in bytes (default: 65536)
+#   -m  image mapping policies, EXT2FSAL_MMAP (default: meta); each
+#       run reports its policy's init time and page faults under "mmap"
+#
+# Lists are space separated, e.g. ./run.sh -i "emptydisk 8192x1024" -t "1 4"
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+IMAGE_DIR="$BENCH_DIR/../../A4-self-test/A4-self-test/images"
+
+IMAGES="emptydisk manyfiles largefile 8192x1024"
+WORKLOADS="cp-small cp-large mkdir-fanout deep-lookup ln-rm mixed"
+THREADS="1 2 4 8"
+OPS=1000
+FILLS="0 50"
+SIZE=65536
+POLICIES="meta"
+
+while getopts "i:w:t:n:f:s:m:" opt; do
+	case $opt in
+		i) IMAGES=$OPTARG ;;
+		w) WORKLOADS=$OPTARG ;;
+		t) THREADS=$OPTARG ;;
+		n) OPS=$OPTARG ;;
+		f) FILLS=$OPTARG ;;
+		s) SIZE=$OPTARG ;;
+		m) POLICIES=$OPTARG ;;
+		*) sed -n '9,24p' "$0" >&2; exit 2 ;;
+	esac
+done
+
+[ -x "$BENCH_DIR/fsal_bench" ] || make -C "$BENCH_DIR" fsal_bench >&2 || exit 1
+
+GEN_DIR=$(mktemp -d /tmp/fsal_bench_images.XXXXXX)
+trap 'rm -rf "$GEN_DIR"' EXIT
+
+# prints the path of image $1, generating BLOCKSxINODES[xBLOCKSIZE] images
+image_path() {
+	case $1 in
+		*x*)
+			local blocks inodes bsize
+			IFS=x read -r blocks inodes bsize <<< "$1"
+			local img="$GEN_DIR/$1.img"
+			if [ ! -f "$img" ]; then
+				mke2fs -q -t ext2 -b "${bsize:-1024}" -I 128 -O none -m 0 -N "$inodes" \
+					-F "$img" "$blocks" </dev/null >/dev/null 2>&1 || return 1
+			fi
+			echo "$img" ;;
+		*)
+			echo "$IMAGE_DIR/$1.img" ;;
+	esac
+}
+
+for image in $IMAGES; do
+	path=$(image_path "$image")
+	if [ -z "$path" ] || [ ! -f "$path" ]; then
+		echo "{\"image\":\"$image\",\"error\":\"cannot find or create image\"}"
+		continue
+	fi
+	for policy in $POLICIES; do
+	for fill in $FILLS; do
+		for workload in $WORKLOADS; do
+			for threads in $THREADS; do
+				if ! EXT2FSAL_MMAP=$policy "$BENCH_DIR/fsal_bench" -i "$path" -w "$workload" \
+						-t "$threads" -n "$OPS" -f "$fill" -s "$SIZE" 2>/dev/null; then
+					echo "{\"workload\":\"$workload\",\"image\":\"$image\",\"fill\":$fill,\"threads\":$threads,\"policy\":\"$policy\",\"error\":\"image too small\"}"
+				fi
+			done
+		done
+	done
+	done
+done
@@ -0,0 +1,385 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Asynchronous client operations.
+ *
+ * ext2umfs_* block the calling thread until the server has executed
+ * the command. A context runs a fixed pool of submitter threads, one
+ * per operation it may have in flight, that take queued requests in
+ * submission order and issue them through those blocking calls. The
+ * caller only ever touches the queues, under the context's lock.
+ *
+ * Completions without a callback go to a done list in completion
+ * order. The context's eventfd counter is nonzero exactly while that
+ * list is not empty: it is written and reset under the same lock that
+ * guards the list.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "ext2umfs.h"
+#include "ext2umfs_async.h"
+
+enum async_op { ASYNC_CP, ASYNC_LN_HL, ASYNC_LN_SL, ASYNC_RM, ASYNC_MKDIR };
+
+struct async_req {
+	uint64_t ticket;
+	enum async_op op;
+	char *a, *b;                   // path arguments (b may be NULL)
+	ext2umfs_async_cb cb;
+	void *user;
+	int32_t result;
+	struct async_req *next;
+};
+
+// a FIFO of requests
+struct req_list {
+	struct async_req *head, *tail;
+};
+
+struct ext2umfs_async {
+	pthread_mutex_t lock;
+	pthread_cond_t work;           // pending became non-empty, or stopping
+	pthread_cond_t done;           // an operation finished
+	struct req_list pending;       // submitted, not yet picked up
+	struct req_list finished;      // completions waiting to be collected
+	uint64_t next_ticket;
+	int outstanding;               // submitted and not yet finished
+	int stopping;
+	int efd;
+	int nthreads;
+	pthread_t *threads;
+};
+
+static void list_push(struct req_list *l, struct async_req *r) {
+	r->next = NULL;
+	if (l->tail) l->tail->next = r;
+	else l->head = r;
+	l->tail = r;
+}
+
+static struct async_req *list_pop(struct req_list *l) {
+	struct async_req *r = l->head;
+	if (r == NULL) return NULL;
+	l->head = r->next;
+	if (l->head == NULL) l->tail = NULL;
+	return r;
+}
+
+static void free_req(struct async_req *r) {
+	free(r->a);
+	free(r->b);
+	free(r);
+}
+
+/*
+ * Issues r through the blocking client call.
+ *
+ * Returns: what that call returned.
+ */
+static int32_t run_req(struct async_req *r) {
+	switch (r->op) {
+	case ASYNC_CP:    return ext2umfs_cp(r->a, r->b);
+	case ASYNC_LN_HL: return ext2umfs_ln_hl(r->a, r->b);
+	case ASYNC_LN_SL: return ext2umfs_ln_sl(r->a, r->b);
+	case ASYNC_RM:    return ext2umfs_rm(r->a);
+	case ASYNC_MKDIR: return ext2umfs_mkdir(r->a);
+	}
+	return EINVAL;
+}
+
+// -------------------------- SUBMITTERS -----------------------------
+
+static void *submitter(void *arg) {
+	struct ext2umfs_async *ctx = arg;
+
+	pthread_mutex_lock(&ctx->lock);
+	for (;;) {
+		struct async_req *r;
+		while ((r = list_pop(&ctx->pending)) == NULL && !ctx->stopping)
+			pthread_cond_wait(&ctx->work, &ctx->lock);
+		if (r == NULL) break;
+
+		pthread_mutex_unlock(&ctx->lock);
+		r->result = run_req(r);
+		if (r->cb) r->cb(r->ticket, r->result, r->user);
+		pthread_mutex_lock(&ctx->lock);
+
+		if (r->cb) {
+			free_req(r);
+		}
+		else {
+			// the counter only needs to be nonzero; keep it at 1
+			if (ctx->finished.head == NULL) {
+				uint64_t one = 1;
+				ssize_t n = write(ctx->efd, &one, sizeof(one));
+				(void)n;  // cannot fail: the counter is 0
+			}
+			list_push(&ctx->finished, r);
+		}
+		ctx->outstanding--;
+		pthread_cond_broadcast(&ctx->done);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+	return NULL;
+}
+
+/*
+ * Creates a context; see ext2umfs_async.h.
+ */
+struct ext2umfs_async *ext2umfs_async_create(int max_inflight) {
+	if (max_inflight <= 0) max_inflight = EXT2UMFS_ASYNC_DEFAULT_INFLIGHT;
+	if (max_inflight > EXT2UMFS_ASYNC_MAX_INFLIGHT) max_inflight = EXT2UMFS_ASYNC_MAX_INFLIGHT;
+
+	struct ext2umfs_async *ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL) return NULL;
+
+	ctx->threads = calloc(max_inflight, sizeof(pthread_t));
+	ctx->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ctx->threads == NULL || ctx->efd < 0) {
+		int err = ctx->threads == NULL ? ENOMEM : errno;
+		if (ctx->efd >= 0) close(ctx->efd);
+		free(ctx->threads);
+		free(ctx);
+		errno = err;
+		return NULL;
+	}
+
+	pthread_mutex_init(&ctx->lock, NULL);
+	pthread_cond_init(&ctx->work, NULL);
+	pthread_cond_init(&ctx->done, NULL);
+	ctx->next_ticket = 1;
+
+	// submitters spend their lives blocked on the server: small stacks
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, 64 * 1024);
+
+	for (int i = 0; i < max_inflight; i++) {
+		int err = pthread_create(&ctx->threads[i], &attr, submitter, ctx);
+		if (err != 0) {
+			pthread_attr_destroy(&attr);
+			if (ctx->nthreads > 0) break;  // run with fewer
+			ext2umfs_async_destroy(ctx);
+			errno = err;
+			return NULL;
+		}
+		ctx->nthreads++;
+	}
+	pthread_attr_destroy(&attr);
+	return ctx;
+}
+
+/*
+ * Waits for everything submitted, stops the submitters and frees ctx.
+ */
+void ext2umfs_async_destroy(struct ext2umfs_async *ctx) {
+	if (ctx == NULL) return;
+
+	ext2umfs_async_wait_all(ctx);
+
+	pthread_mutex_lock(&ctx->lock);
+	ctx->stopping = 1;
+	pthread_cond_broadcast(&ctx->work);
+	pthread_mutex_unlock(&ctx->lock);
+
+	for (int i = 0; i < ctx->nthreads; i++) pthread_join(ctx->threads[i], NULL);
+
+	struct async_req *r;
+	while ((r = list_pop(&ctx->finished)) != NULL) free_req(r);
+
+	close(ctx->efd);
+	pthread_cond_destroy(&ctx->done);
+	pthread_cond_destroy(&ctx->work);
+	pthread_mutex_destroy(&ctx->lock);
+	free(ctx->threads);
+	free(ctx);
+}
+
+// --------------------------- SUBMISSION ----------------------------
+
+/*
+ * Queues operation op on paths a and b (b may be NULL).
+ *
+ * Returns: the ticket, or 0 with errno ENOMEM.
+ */
+static uint64_t submit(struct ext2umfs_async *ctx, enum async_op op, const char *a,
+		const char *b, ext2umfs_async_cb cb, void *user) {
+	struct async_req *r = calloc(1, sizeof(*r));
+	if (r == NULL) goto fail;
+
+	r->op = op;
+	r->cb = cb;
+	r->user = user;
+	r->a = strdup(a ? a : "");
+	r->b = b ? strdup(b) : NULL;
+	if (r->a == NULL || (b && r->b == NULL)) goto fail;
+
+	// r belongs to the submitters once it is queued
+	pthread_mutex_lock(&ctx->lock);
+	uint64_t ticket = ctx->next_ticket++;
+	r->ticket = ticket;
+	list_push(&ctx->pending, r);
+	ctx->outstanding++;
+	pthread_cond_signal(&ctx->work);
+	pthread_mutex_unlock(&ctx->lock);
+
+	return ticket;
+
+fail:
+	if (r) free_req(r);
+	errno = ENOMEM;
+	return 0;
+}
+
+uint64_t ext2umfs_cp_async(struct ext2umfs_async *ctx, const char *src, const char *dst,
+		ext2umfs_async_cb cb, void *user) {
+	return submit(ctx, ASYNC_CP, src, dst, cb, user);
+}
+
+uint64_t ext2umfs_ln_hl_async(struct ext2umfs_async *ctx, const char *src, const char *dst,
+		ext2umfs_async_cb cb, void *user) {
+	return submit(ctx, ASYNC_LN_HL, src, dst, cb, user);
+}
+
+uint64_t ext2umfs_ln_sl_async(struct ext2umfs_async *ctx, const char *src, const char *dst,
+		ext2umfs_async_cb cb, void *user) {
+	return submit(ctx, ASYNC_LN_SL, src, dst, cb, user);
+}
+
+uint64_t ext2umfs_rm_async(struct ext2umfs_async *ctx, const char *path,
+		ext2umfs_async_cb cb, void *user) {
+	return submit(ctx, ASYNC_RM, path, NULL, cb, user);
+}
+
+uint64_t ext2umfs_mkdir_async(struct ext2umfs_async *ctx, const char *path,
+		ext2umfs_async_cb cb, void *user) {
+	return submit(ctx, ASYNC_MKDIR, path, NULL, cb, user);
+}
+
+// --------------------------- COLLECTION ----------------------------
+
+/*
+ * Resets the eventfd once the done list has been emptied. The caller
+ * holds ctx->lock.
+ */
+static void drained(struct ext2umfs_async *ctx) {
+	if (ctx->finished.head != NULL) return;
+
+	uint64_t count;
+	ssize_t n = read(ctx->efd, &count, sizeof(count));
+	(void)n;  // EAGAIN if it was already 0
+}
+
+/*
+ * Moves up to max completions from the done list into out. The caller
+ * holds ctx->lock.
+ *
+ * Returns: the number moved.
+ */
+static int take_completions(struct ext2umfs_async *ctx, struct ext2umfs_completion *out, int max) {
+	int n = 0;
+	while (n < max && ctx->finished.head != NULL) {
+		struct async_req *r = list_pop(&ctx->finished);
+		out[n++] = (struct ext2umfs_completion){ r->ticket, r->result, r->user };
+		free_req(r);
+	}
+	if (n > 0) drained(ctx);
+	return n;
+}
+
+int ext2umfs_async_poll(struct ext2umfs_async *ctx, struct ext2umfs_completion *out, int max) {
+	pthread_mutex_lock(&ctx->lock);
+	int n = take_completions(ctx, out, max);
+	pthread_mutex_unlock(&ctx->lock);
+	return n;
+}
+
+/*
+ * Waits up to timeout_ms (-1 for no limit) for a completion; see
+ * ext2umfs_async.h.
+ */
+int ext2umfs_async_wait_any(struct ext2umfs_async *ctx, struct ext2umfs_completion *out,
+		int max, int timeout_ms) {
+	struct timespec deadline;
+	if (timeout_ms >= 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock(&ctx->lock);
+	while (ctx->finished.head == NULL && ctx->outstanding > 0) {
+		if (timeout_ms < 0) {
+			pthread_cond_wait(&ctx->done, &ctx->lock);
+		}
+		else if (pthread_cond_timedwait(&ctx->done, &ctx->lock, &deadline) == ETIMEDOUT) {
+			break;
+		}
+	}
+	int n = take_completions(ctx, out, max);
+	pthread_mutex_unlock(&ctx->lock);
+	return n;
+}
+
+/*
+ * Waits for ticket and collects its completion; see ext2umfs_async.h.
+ */
+int ext2umfs_async_wait(struct ext2umfs_async *ctx, uint64_t ticket, int32_t *result) {
+	pthread_mutex_lock(&ctx->lock);
+	for (;;) {
+		// an unknown ticket may still be running: keep waiting while 
+		// anything is outstanding
+		struct async_req *prev = NULL, *r;
+		for (r = ctx->finished.head; r != NULL; prev = r, r = r->next) {
+			if (r->ticket == ticket) break;
+		}
+
+		if (r != NULL) {
+			if (prev) prev->next = r->next;
+			else ctx->finished.head = r->next;
+			if (ctx->finished.tail == r) ctx->finished.tail = prev;
+			drained(ctx);
+			pthread_mutex_unlock(&ctx->lock);
+
+			if (result) *result = r->result;
+			free_req(r);
+			return 0;
+		}
+
+		if (ticket == 0 || ticket >= ctx->next_ticket || ctx->outstanding == 0) break;
+		pthread_cond_wait(&ctx->done, &ctx->lock);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+	return ENOENT;
+}
+
+void ext2umfs_async_wait_all(struct ext2umfs_async *ctx) {
+	pthread_mutex_lock(&ctx->lock);
+	while (ctx->outstanding > 0) pthread_cond_wait(&ctx->done, &ctx->lock);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+int ext2umfs_async_eventfd(struct ext2umfs_async *ctx) {
+	return ctx->efd;
+}
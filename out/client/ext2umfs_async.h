@@ -0,0 +1,103 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Non-blocking client API on top of ext2umfs.h.
+//
+// Each *_async call queues the operation and returns a ticket at once;
+// a pool of submitter threads owned by the context issues the queued
+// operations through the blocking ext2umfs_* calls, so up to
+// max_inflight of them are with the server at any time, from a single
+// calling thread. Finished operations are collected with
+// ext2umfs_async_poll, ext2umfs_async_wait_any or ext2umfs_async_wait,
+// or handed to a callback. ext2umfs_async_eventfd becomes readable
+// while completions are waiting, for use in an epoll loop.
+//
+// A context may be shared by several threads.
+
+struct ext2umfs_async;
+
+// One finished operation.
+struct ext2umfs_completion {
+	uint64_t ticket;
+	int32_t result;       // what the blocking ext2umfs_* call returned
+	void *user;           // as given at submit
+};
+
+// Called on a submitter thread as soon as an operation finishes, in
+// place of queueing its completion. It must not block for long; it
+// may submit further operations.
+typedef void (*ext2umfs_async_cb)(uint64_t ticket, int32_t result, void *user);
+
+// Creates a context with up to max_inflight operations with the server
+// at once (0 for EXT2UMFS_ASYNC_DEFAULT_INFLIGHT, at most
+// EXT2UMFS_ASYNC_MAX_INFLIGHT). Further submissions wait in the
+// context's queue.
+//
+// returns the context, or NULL with errno set.
+#define EXT2UMFS_ASYNC_DEFAULT_INFLIGHT 128
+#define EXT2UMFS_ASYNC_MAX_INFLIGHT     1024
+struct ext2umfs_async *ext2umfs_async_create(int max_inflight);
+
+// Waits for every submitted operation, then frees the context along
+// with any completions that were never collected.
+void ext2umfs_async_destroy(struct ext2umfs_async *ctx);
+
+// Paths are copied, so they need not outlive the call. cb may be NULL
+// to have the completion queued instead.
+//
+// returns the operation's ticket (never 0), or 0 with errno set to
+// ENOMEM.
+uint64_t ext2umfs_cp_async(struct ext2umfs_async *ctx, const char *src, const char *dst,
+                           ext2umfs_async_cb cb, void *user);
+uint64_t ext2umfs_ln_hl_async(struct ext2umfs_async *ctx, const char *src, const char *dst,
+                              ext2umfs_async_cb cb, void *user);
+uint64_t ext2umfs_ln_sl_async(struct ext2umfs_async *ctx, const char *src, const char *dst,
+                              ext2umfs_async_cb cb, void *user);
+uint64_t ext2umfs_rm_async(struct ext2umfs_async *ctx, const char *path,
+                           ext2umfs_async_cb cb, void *user);
+uint64_t ext2umfs_mkdir_async(struct ext2umfs_async *ctx, const char *path,
+                              ext2umfs_async_cb cb, void *user);
+
+// Collects up to max finished operations without blocking, oldest
+// first.
+//
+// returns the number stored in out.
+int ext2umfs_async_poll(struct ext2umfs_async *ctx, struct ext2umfs_completion *out, int max);
+
+// As ext2umfs_async_poll, but first waits up to timeout_ms (-1 for no
+// limit) for at least one completion.
+//
+// returns the number stored in out; 0 on timeout, or at once if no
+// operation is outstanding.
+int ext2umfs_async_wait_any(struct ext2umfs_async *ctx, struct ext2umfs_completion *out,
+                            int max, int timeout_ms);
+
+// Waits for the operation with ticket and collects its completion.
+//
+// returns 0 with the result in result, or ENOENT if ticket will not
+// be queued (unknown, already collected, or given a callback); that
+// is only known once no operation is outstanding.
+int ext2umfs_async_wait(struct ext2umfs_async *ctx, uint64_t ticket, int32_t *result);
+
+// Waits until every operation submitted so far has finished. Their
+// completions stay queued for collection.
+void ext2umfs_async_wait_all(struct ext2umfs_async *ctx);
+
+// returns a file descriptor that is readable exactly while
+// completions are queued. It belongs to the context; do not read or
+// close it.
+int ext2umfs_async_eventfd(struct ext2umfs_async *ctx);
@@ -0,0 +1,363 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Asynchronous I/O engine.
+ *
+ * aio_run performs a batch of positioned reads and writes. With
+ * io_uring available (probed at init, unless EXT2FSAL_AIO=0) each
+ * thread gets its own ring and keeps up to EXT2FSAL_AIO_DEPTH
+ * (default 32) requests in flight: the queue is topped up, one
+ * io_uring_enter both submits and waits, and every completion that
+ * has arrived is harvested before the next round. Otherwise, and for
+ * any thread whose ring cannot be set up, requests run one after
+ * another with pread/pwrite. The rings are driven with the raw
+ * system calls, so there is no library dependency.
+ *
+ * Used for copying host file data into data blocks and for the
+ * writeback passes of the pread block device backend.
+ */
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "ext2fsal.h"
+#include "e2fs.h"
+
+#define DEFAULT_DEPTH 32
+#define MAX_DEPTH     256
+
+struct uring {
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr, *cq_ptr;
+	size_t sq_len, cq_len, sqes_len;
+	int gen;                       // aio_gen when created
+};
+
+static int aio_enabled;                // io_uring works here
+static int aio_depth;
+static int aio_gen = 1;                // bumped by aio_engine_destroy
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static __thread struct uring *my_ring;
+
+static uint64_t aio_requests, aio_enters;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+// -------------------------- RINGS --------------------------------
+
+static void ring_close(struct uring *r) {
+	if (r->sqes) munmap(r->sqes, r->sqes_len);
+	if (r->cq_ptr && r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_len);
+	if (r->sq_ptr) munmap(r->sq_ptr, r->sq_len);
+	if (r->fd >= 0) close(r->fd);
+	free(r);
+}
+
+static void ring_destructor(void *arg) {
+	ring_close(arg);
+}
+
+static void make_ring_key(void) {
+	pthread_key_create(&ring_key, ring_destructor);
+}
+
+/*
+ * Sets up a ring with room for entries requests in flight.
+ *
+ * Returns: the ring, or NULL if io_uring cannot be used.
+ */
+static struct uring *ring_open(unsigned entries) {
+	struct uring *r = calloc(1, sizeof(*r));
+	if (r == NULL) return NULL;
+
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	r->fd = sys_io_uring_setup(entries, &p);
+	if (r->fd < 0) {
+		free(r);
+		return NULL;
+	}
+
+	r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_len > r->sq_len) r->sq_len = r->cq_len;
+		r->cq_len = r->sq_len;
+	}
+
+	r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			 r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED) {
+		r->sq_ptr = NULL;
+		ring_close(r);
+		return NULL;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_ptr = r->sq_ptr;
+	}
+	else {
+		r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				 r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ptr == MAP_FAILED) {
+			r->cq_ptr = NULL;
+			ring_close(r);
+			return NULL;
+		}
+	}
+
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		       r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		r->sqes = NULL;
+		ring_close(r);
+		return NULL;
+	}
+
+	uint8_t *sq = r->sq_ptr, *cq = r->cq_ptr;
+	r->sq_head = (unsigned *)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(sq + p.sq_off.array);
+	r->cq_head = (unsigned *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return r;
+}
+
+/*
+ * Returns: the calling thread's ring, creating it on first use; NULL
+ * if io_uring is off or the ring cannot be set up.
+ */
+static struct uring *get_ring(void) {
+	if (!aio_enabled) return NULL;
+
+	int gen = __atomic_load_n(&aio_gen, __ATOMIC_RELAXED);
+	if (my_ring != NULL && my_ring->gen == gen) return my_ring;
+
+	// left over from before the last aio_engine_destroy
+	if (my_ring != NULL) {
+		ring_close(my_ring);
+		my_ring = NULL;
+		pthread_setspecific(ring_key, NULL);
+	}
+
+	my_ring = ring_open(aio_depth);
+	if (my_ring == NULL) return NULL;
+	my_ring->gen = gen;
+	pthread_setspecific(ring_key, my_ring);
+	return my_ring;
+}
+
+// ------------------------- TRANSFERS -----------------------------
+
+/*
+ * Finishes req from done bytes on with plain pread/pwrite. A read that
+ * reaches the end of the file zero-fills the rest of the buffer.
+ *
+ * Returns: 0 on success, an errno value on error.
+ */
+static int finish_sync(struct aio_req *req, size_t done) {
+	while (done < req->len) {
+		ssize_t r = req->write
+			? pwrite(req->fd, (char *)req->buf + done, req->len - done, req->off + done)
+			: pread(req->fd, (char *)req->buf + done, req->len - done, req->off + done);
+		if (r < 0 && errno == EINTR) continue;
+		if (r < 0) return errno;
+		if (r == 0) {
+			if (req->write) return EIO;
+			memset((char *)req->buf + done, 0, req->len - done);
+			return 0;
+		}
+		done += r;
+	}
+	return 0;
+}
+
+static void prep_sqe(struct uring *r, struct aio_req *req, int idx) {
+	unsigned tail = *r->sq_tail;
+	unsigned slot = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[slot];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = req->write ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = req->fd;
+	sqe->addr = (uint64_t)(uintptr_t)req->buf;
+	sqe->len = req->len;
+	sqe->off = req->off;
+	sqe->user_data = idx;
+	r->sq_array[slot] = slot;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Performs the n transfers in reqs, reads zero-filling whatever lies
+ * past the end of their file. If overlap is not NULL, overlap(arg) is
+ * called once the first requests are on their way, so the caller can
+ * do other work while they are in flight. reqs may complete in any
+ * order.
+ *
+ * Returns: 0 on success, or the errno value of a failed transfer (the
+ * others still run).
+ */
+int aio_run(struct aio_req *reqs, int n, void (*overlap)(void *), void *arg) {
+	struct uring *r = get_ring();
+	int retval = 0;
+
+	if (r == NULL) {
+		if (overlap) overlap(arg);
+		for (int i = 0; i < n; i++) {
+			int err = finish_sync(&reqs[i], 0);
+			if (err && !retval) retval = err;
+		}
+		return retval;
+	}
+
+	int next = 0, inflight = 0, done = 0;
+	unsigned submit = 0;               // queued, not yet taken by the kernel
+	uint64_t enters = 0;
+
+	while (done < n) {
+		// top up the submission queue
+		while (next < n && inflight < aio_depth) {
+			prep_sqe(r, &reqs[next], next);
+			next++;
+			inflight++;
+			submit++;
+		}
+
+		// submit, and wait for one completion unless there is
+		// overlapping work to do first
+		unsigned wait = overlap ? 0 : 1;
+		int ret = sys_io_uring_enter(r->fd, submit, wait, IORING_ENTER_GETEVENTS);
+		enters++;
+		if (ret >= 0) {
+			submit -= (unsigned)ret < submit ? (unsigned)ret : submit;
+		}
+		else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+			// the ring is unusable: run what was never submitted
+			// synchronously and drop the ring
+			if (!retval) retval = errno;
+			break;
+		}
+
+		if (overlap) {
+			overlap(arg);
+			overlap = NULL;
+		}
+
+		// harvest every completion that has arrived
+		unsigned head = *r->cq_head;
+		unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+			struct aio_req *req = &reqs[cqe->user_data];
+			int res = cqe->res;
+			head++;
+
+			int err = 0;
+			if (res == -EINTR || res == -EAGAIN || res == -EINVAL || res == -EOPNOTSUPP)
+				err = finish_sync(req, 0);   // retry, or opcode too new for the kernel
+			else if (res < 0) err = -res;
+			else if ((size_t)res < req->len) err = finish_sync(req, res);
+			if (err && !retval) retval = err;
+
+			done++;
+			inflight--;
+		}
+		__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	if (done < n) {
+		// submitted requests cannot be recovered from a broken ring;
+		// only the ones never handed over are retried
+		for (int i = next; i < n; i++) finish_sync(&reqs[i], 0);
+		ring_close(r);
+		my_ring = NULL;
+		pthread_setspecific(ring_key, NULL);
+	}
+
+	__atomic_fetch_add(&aio_requests, n, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&aio_enters, enters, __ATOMIC_RELAXED);
+	return retval;
+}
+
+// ------------------------ SETUP & TEARDOWN -----------------------
+
+/*
+ * Probes io_uring unless EXT2FSAL_AIO is "0" and reads the queue depth
+ * from EXT2FSAL_AIO_DEPTH. Called from ext2_fsal_init.
+ */
+void aio_engine_init(void) {
+	pthread_once(&ring_key_once, make_ring_key);
+	aio_enabled = 0;
+	aio_requests = aio_enters = 0;
+
+	const char *d = getenv("EXT2FSAL_AIO_DEPTH");
+	aio_depth = d ? atoi(d) : DEFAULT_DEPTH;
+	if (aio_depth < 1) aio_depth = 1;
+	if (aio_depth > MAX_DEPTH) aio_depth = MAX_DEPTH;
+
+	const char *env = getenv("EXT2FSAL_AIO");
+	if (env != NULL && strcmp(env, "0") == 0) return;
+
+	// seccomp or an old kernel turns the engine off for good
+	struct uring *probe = ring_open(aio_depth);
+	if (probe == NULL) return;
+	ring_close(probe);
+	aio_enabled = 1;
+}
+
+/*
+ * Turns the engine off and closes the calling thread's ring; other
+ * threads' rings are closed when they exit or next use the engine.
+ * Called from ext2_fsal_destroy after the last writeback.
+ */
+void aio_engine_destroy(void) {
+	aio_enabled = 0;
+	__atomic_store_n(&aio_gen, aio_gen + 1, __ATOMIC_RELAXED);
+	if (my_ring != NULL) {
+		ring_close(my_ring);
+		my_ring = NULL;
+		pthread_setspecific(ring_key, NULL);
+	}
+}
+
+/*
+ * Fills in the engine and its counters.
+ */
+void aio_snapshot(struct ext2_fsal_blockdev_stats *out) {
+	snprintf(out->aio, sizeof(out->aio), "%s", aio_enabled ? "io_uring" : "sync");
+	out->aio_requests = __atomic_load_n(&aio_requests, __ATOMIC_RELAXED);
+	out->aio_enters = __atomic_load_n(&aio_enters, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,590 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Block device layer under get_block/put_block.
+ *
+ * EXT2FSAL_BACKEND selects how blocks of the image are reached:
+ *
+ *   mmap   (default) the whole image is mapped (see mapping.c);
+ *          get_block returns a pointer into the mapping and put_block
+ *          does nothing
+ *   pread  the image is read and written with pread/pwrite through a
+ *          bounded block cache, for images too large to map
+ *
+ * Under pread, the metadata at the front of the image (boot block
+ * through the inode table) stays resident in memory, so superblock,
+ * group_desc, the bitmaps and inode_table are ordinary pointers as
+ * before; a shadow copy of it tells which pages changed. All other
+ * blocks live in a cache of EXT2FSAL_CACHE_BLOCKS (default 8192)
+ * blocks split into CACHE_SHARDS shards by block number, each with
+ * its own lock and CLOCK replacement. A block is pinned from
+ * get_block until put_block and never evicted while pinned;
+ * put_block(n, 1) marks it dirty. Dirty blocks are written when
+ * evicted, and otherwise by a writeback pass: data blocks first, then
+ * the changed metadata pages, so metadata on disk never points at
+ * data that has not been written. EXT2FSAL_WRITEBACK_MS picks when
+ * passes run:
+ *
+ *   0    (default) as each operation finishes (blockdev_op_done), so
+ *        an operation's changes are in the image when it returns, as
+ *        with the mapping; hosts that never call ext2_fsal_destroy
+ *        lose nothing
+ *   N    write-behind: a thread runs a pass every N milliseconds and
+ *        operations return without writing
+ *
+ * ext2_fsal_destroy writes everything that is left.
+ *
+ * Callers see the same interface either way: get_block, put_block
+ * once done with the pointer, and get_block_new for a block that is
+ * about to be overwritten entirely (under pread, it is not read).
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "ext2fsal.h"
+#include "e2fs.h"
+
+#define CACHE_SHARDS         16
+#define DEFAULT_CACHE_BLOCKS 8192
+#define MIN_SHARD_SLOTS      64       // more than the pins operations hold at once
+#define META_CHUNK           4096     // granularity of metadata writeback
+
+struct blockdev_ops {
+	const char *name;
+	char *(*get)(int block_num, int fill);
+	void (*put)(int block_num, int dirty);
+	void (*close)(void);
+};
+
+static const struct blockdev_ops *bdev;
+static int bdev_fd = -1;
+static size_t bdev_size;
+
+// ------------------------- MMAP BACKEND --------------------------
+
+static char *mmap_get(int block_num, int fill) {
+	(void)fill;
+	return (char *)(fs + ((size_t)block_num << block_shift));
+}
+
+static void mmap_put(int block_num, int dirty) {
+	(void)block_num;
+	(void)dirty;
+}
+
+static void mmap_close(void) {
+	munmap(fs, bdev_size);
+}
+
+static const struct blockdev_ops mmap_ops = { "mmap", mmap_get, mmap_put, mmap_close };
+
+// ------------------------- PREAD BACKEND -------------------------
+
+struct cache_slot {
+	int block;          // 0 if empty
+	int pins;
+	int next;           // hash chain, -1 terminated
+	uint8_t ref;        // CLOCK reference bit
+	uint8_t dirty;
+	char *data;
+};
+
+struct cache_shard {
+	pthread_mutex_t lock;
+	pthread_cond_t unpinned;     // a slot's pins dropped to zero
+	int waiters;
+	struct cache_slot *slots;
+	int nslots;
+	int *buckets;                // heads of the hash chains
+	int mask;
+	int hand;                    // CLOCK hand
+	int ndirty;                  // dirty slots, to skip clean shards
+	char *mem;                   // data of all slots
+	uint64_t hits, misses, writebacks;
+};
+
+static struct cache_shard shards[CACHE_SHARDS];
+static int meta_blocks;              // resident blocks at the front
+static uint8_t *meta_shadow;         // meta as last written
+static uint64_t meta_writebacks;
+
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;   // one pass at a time
+static pthread_t writeback_thread;
+static pthread_mutex_t writeback_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writeback_cond = PTHREAD_COND_INITIALIZER;
+static int writeback_ms;
+static int stopping;
+
+/*
+ * Reads or writes count bytes at offset off of the image, retrying
+ * short transfers. I/O errors are reported but not returned: like a
+ * failed page-in of the mapping, there is nothing the caller could do.
+ */
+static void image_io(int write, void *buf, size_t count, off_t off) {
+	size_t done = 0;
+	while (done < count) {
+		ssize_t r = write ? pwrite(bdev_fd, (char *)buf + done, count - done, off + done)
+				  : pread(bdev_fd, (char *)buf + done, count - done, off + done);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) {
+			if (r < 0) perror(write ? "blockdev: pwrite" : "blockdev: pread");
+			if (!write) memset((char *)buf + done, 0, count - done);
+			return;
+		}
+		done += r;
+	}
+}
+
+static int slot_lookup(struct cache_shard *sh, int block_num) {
+	int i = sh->buckets[(block_num / CACHE_SHARDS) & sh->mask];
+	while (i >= 0 && sh->slots[i].block != block_num) i = sh->slots[i].next;
+	return i;
+}
+
+static void slot_unlink(struct cache_shard *sh, int idx) {
+	int *p = &sh->buckets[(sh->slots[idx].block / CACHE_SHARDS) & sh->mask];
+	while (*p != idx) p = &sh->slots[*p].next;
+	*p = sh->slots[idx].next;
+}
+
+static void slot_writeback(struct cache_shard *sh, struct cache_slot *s) {
+	image_io(1, s->data, EXT2_BLOCK_SIZE, (off_t)s->block * EXT2_BLOCK_SIZE);
+	s->dirty = 0;
+	sh->ndirty--;
+	sh->writebacks++;
+}
+
+/*
+ * Finds an unpinned slot to reuse with the CLOCK hand, writing it back
+ * if it is dirty. The caller holds the shard lock.
+ *
+ * Returns: the slot index, or -1 if every slot is pinned.
+ */
+static int slot_evict(struct cache_shard *sh) {
+	for (int step = 0; step < 2 * sh->nslots; step++) {
+		int i = sh->hand;
+		sh->hand = (sh->hand + 1) % sh->nslots;
+
+		struct cache_slot *s = &sh->slots[i];
+		if (s->pins > 0) continue;
+		if (s->ref) {
+			s->ref = 0;
+			continue;
+		}
+
+		if (s->block != 0) {
+			if (s->dirty) slot_writeback(sh, s);
+			slot_unlink(sh, i);
+			s->block = 0;
+		}
+		return i;
+	}
+	return -1;
+}
+
+static char *pread_get(int block_num, int fill) {
+	if (block_num < meta_blocks) return (char *)(fs + ((size_t)block_num << block_shift));
+
+	struct cache_shard *sh = &shards[block_num % CACHE_SHARDS];
+	pthread_mutex_lock(&sh->lock);
+
+	for (;;) {
+		int i = slot_lookup(sh, block_num);
+		if (i >= 0) {
+			sh->slots[i].pins++;
+			sh->slots[i].ref = 1;
+			sh->hits++;
+			pthread_mutex_unlock(&sh->lock);
+			return sh->slots[i].data;
+		}
+
+		i = slot_evict(sh);
+		if (i < 0) {
+			// every slot pinned: wait for one, then look again since
+			// another thread may have loaded the block meanwhile
+			sh->waiters++;
+			pthread_cond_wait(&sh->unpinned, &sh->lock);
+			sh->waiters--;
+			continue;
+		}
+
+		struct cache_slot *s = &sh->slots[i];
+		s->block = block_num;
+		s->pins = 1;
+		s->ref = 1;
+		s->dirty = 0;
+		int *head = &sh->buckets[(block_num / CACHE_SHARDS) & sh->mask];
+		s->next = *head;
+		*head = i;
+
+		if (fill) image_io(0, s->data, EXT2_BLOCK_SIZE, (off_t)block_num * EXT2_BLOCK_SIZE);
+		sh->misses++;
+		pthread_mutex_unlock(&sh->lock);
+		return s->data;
+	}
+}
+
+static void pread_put(int block_num, int dirty) {
+	if (block_num < meta_blocks) return;
+
+	struct cache_shard *sh = &shards[block_num % CACHE_SHARDS];
+	pthread_mutex_lock(&sh->lock);
+
+	int i = slot_lookup(sh, block_num);
+	if (i >= 0) {
+		struct cache_slot *s = &sh->slots[i];
+		if (dirty && !s->dirty) {
+			s->dirty = 1;
+			sh->ndirty++;
+		}
+		if (--s->pins == 0 && sh->waiters > 0) pthread_cond_signal(&sh->unpinned);
+	}
+
+	pthread_mutex_unlock(&sh->lock);
+}
+
+static int cmp_slot_block(const void *a, const void *b) {
+	int x = (*(struct cache_slot * const *)a)->block;
+	int y = (*(struct cache_slot * const *)b)->block;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Writes every dirty, unpinned cached block, then every metadata page
+ * that differs from its shadow. Each shard's blocks (in block order)
+ * and then the metadata pages go to the image as one batch through
+ * the async I/O engine.
+ */
+static void pread_flush(void) {
+	struct cache_slot **dirty = NULL;
+	struct aio_req *reqs = NULL;
+	int cap = 0;
+
+	pthread_mutex_lock(&flush_lock);
+
+	for (int k = 0; k < CACHE_SHARDS; k++) {
+		struct cache_shard *sh = &shards[k];
+		pthread_mutex_lock(&sh->lock);
+		if (sh->ndirty == 0) {
+			pthread_mutex_unlock(&sh->lock);
+			continue;
+		}
+
+		if (cap < sh->nslots) {
+			struct cache_slot **d = realloc(dirty, sh->nslots * sizeof(*d));
+			if (d != NULL) dirty = d;
+			struct aio_req *r = realloc(reqs, sh->nslots * sizeof(*r));
+			if (r != NULL) reqs = r;
+			if (d == NULL || r == NULL) {
+				pthread_mutex_unlock(&sh->lock);
+				continue;
+			}
+			cap = sh->nslots;
+		}
+
+		int n = 0;
+		for (int i = 0; i < sh->nslots; i++) {
+			struct cache_slot *s = &sh->slots[i];
+			if (s->block != 0 && s->dirty && s->pins == 0) dirty[n++] = s;
+		}
+		qsort(dirty, n, sizeof(*dirty), cmp_slot_block);
+
+		for (int i = 0; i < n; i++) {
+			reqs[i] = (struct aio_req){ bdev_fd, 1, dirty[i]->data, EXT2_BLOCK_SIZE,
+						    (off_t)dirty[i]->block * EXT2_BLOCK_SIZE };
+		}
+		int err = aio_run(reqs, n, NULL, NULL);
+		if (err) fprintf(stderr, "blockdev: writeback: %s\n", strerror(err));
+		for (int i = 0; i < n; i++) dirty[i]->dirty = 0;
+		sh->ndirty -= n;
+		sh->writebacks += n;
+
+		pthread_mutex_unlock(&sh->lock);
+	}
+	free(dirty);
+	free(reqs);
+
+	size_t meta_size = (size_t)meta_blocks * EXT2_BLOCK_SIZE;
+	int chunks = (meta_size + META_CHUNK - 1) / META_CHUNK;
+	reqs = malloc(chunks * sizeof(*reqs));
+
+	int n = 0;
+	for (size_t off = 0; off < meta_size; off += META_CHUNK) {
+		size_t len = meta_size - off < META_CHUNK ? meta_size - off : META_CHUNK;
+		if (memcmp(fs + off, meta_shadow + off, len) == 0) continue;
+		memcpy(meta_shadow + off, fs + off, len);
+		if (reqs == NULL) {
+			image_io(1, meta_shadow + off, len, off);
+		}
+		else {
+			reqs[n++] = (struct aio_req){ bdev_fd, 1, meta_shadow + off, len, off };
+		}
+		meta_writebacks++;
+	}
+	int err = n > 0 ? aio_run(reqs, n, NULL, NULL) : 0;
+	if (err) fprintf(stderr, "blockdev: writeback: %s\n", strerror(err));
+	free(reqs);
+
+	pthread_mutex_unlock(&flush_lock);
+}
+
+/*
+ * Write-behind thread: flushes every writeback_ms until stopping is
+ * set.
+ */
+static void *writeback_main(void *arg) {
+	(void)arg;
+	pthread_mutex_lock(&writeback_lock);
+
+	while (!stopping) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += (long)writeback_ms * 1000000L;
+		ts.tv_sec += ts.tv_nsec / 1000000000L;
+		ts.tv_nsec %= 1000000000L;
+		pthread_cond_timedwait(&writeback_cond, &writeback_lock, &ts);
+		if (stopping) break;
+
+		pthread_mutex_unlock(&writeback_lock);
+		pread_flush();
+		pthread_mutex_lock(&writeback_lock);
+	}
+
+	pthread_mutex_unlock(&writeback_lock);
+	return NULL;
+}
+
+static void pread_close(void) {
+	if (writeback_ms > 0) {
+		pthread_mutex_lock(&writeback_lock);
+		stopping = 1;
+		pthread_cond_signal(&writeback_cond);
+		pthread_mutex_unlock(&writeback_lock);
+		pthread_join(writeback_thread, NULL);
+	}
+
+	pread_flush();
+
+	for (int k = 0; k < CACHE_SHARDS; k++) {
+		struct cache_shard *sh = &shards[k];
+		pthread_mutex_destroy(&sh->lock);
+		pthread_cond_destroy(&sh->unpinned);
+		free(sh->slots);
+		free(sh->buckets);
+		free(sh->mem);
+	}
+	memset(shards, 0, sizeof(shards));
+
+	free(fs);
+	free(meta_shadow);
+	meta_shadow = NULL;
+	close(bdev_fd);
+	bdev_fd = -1;
+}
+
+static const struct blockdev_ops pread_ops = { "pread", pread_get, pread_put, pread_close };
+
+/*
+ * Sets up one cache shard of nslots slots.
+ *
+ * Returns: 0 on success, -1 if memory is exhausted.
+ */
+static int shard_init(struct cache_shard *sh, int nslots) {
+	int nbuckets = 1;
+	while (nbuckets < 2 * nslots) nbuckets <<= 1;
+
+	sh->slots = calloc(nslots, sizeof(struct cache_slot));
+	sh->buckets = malloc(nbuckets * sizeof(int));
+	sh->mem = malloc((size_t)nslots * EXT2_BLOCK_SIZE);
+	if (sh->slots == NULL || sh->buckets == NULL || sh->mem == NULL) return -1;
+
+	for (int i = 0; i < nbuckets; i++) sh->buckets[i] = -1;
+	for (int i = 0; i < nslots; i++) sh->slots[i].data = sh->mem + (size_t)i * EXT2_BLOCK_SIZE;
+	sh->nslots = nslots;
+	sh->mask = nbuckets - 1;
+	pthread_mutex_init(&sh->lock, NULL);
+	pthread_cond_init(&sh->unpinned, NULL);
+	return 0;
+}
+
+/*
+ * Opens the pread backend on fd: loads the metadata region, points fs
+ * at it and, for write-behind, starts the writeback thread.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int pread_open(int fd) {
+	bdev_fd = dup(fd);
+	if (bdev_fd < 0) return -1;
+
+	// the group descriptor says where the metadata ends
+	struct ext2_group_desc gd;
+	struct ext2_super_block sb;
+	image_io(0, &sb, sizeof(sb), EXT2_SUPERBLOCK_OFFSET);
+	image_io(0, &gd, sizeof(gd), (off_t)(first_data_block + 1) * EXT2_BLOCK_SIZE);
+
+	int itable_blocks = (sb.s_inodes_count * sizeof(struct ext2_inode) + EXT2_BLOCK_SIZE - 1) / EXT2_BLOCK_SIZE;
+	meta_blocks = gd.bg_inode_table + itable_blocks;
+	if ((int)gd.bg_block_bitmap >= meta_blocks) meta_blocks = gd.bg_block_bitmap + 1;
+	if ((int)gd.bg_inode_bitmap >= meta_blocks) meta_blocks = gd.bg_inode_bitmap + 1;
+
+	size_t meta_size = (size_t)meta_blocks * EXT2_BLOCK_SIZE;
+	if (meta_size > bdev_size) return -1;
+
+	fs = malloc(meta_size);
+	meta_shadow = malloc(meta_size);
+	if (fs == NULL || meta_shadow == NULL) return -1;
+	image_io(0, fs, meta_size, 0);
+	memcpy(meta_shadow, fs, meta_size);
+
+	const char *n = getenv("EXT2FSAL_CACHE_BLOCKS");
+	long blocks = n ? strtol(n, NULL, 10) : DEFAULT_CACHE_BLOCKS;
+	int per_shard = blocks / CACHE_SHARDS;
+	if (per_shard < MIN_SHARD_SLOTS) per_shard = MIN_SHARD_SLOTS;
+
+	for (int k = 0; k < CACHE_SHARDS; k++) {
+		if (shard_init(&shards[k], per_shard) < 0) return -1;
+	}
+
+	const char *ms = getenv("EXT2FSAL_WRITEBACK_MS");
+	writeback_ms = ms ? atoi(ms) : 0;
+	if (writeback_ms < 0) writeback_ms = 0;
+	stopping = 0;
+	meta_writebacks = 0;
+	if (writeback_ms > 0 && pthread_create(&writeback_thread, NULL, writeback_main, NULL) != 0)
+		return -1;
+	return 0;
+}
+
+// --------------------------- INTERFACE ---------------------------
+
+/**
+ * Returns: a pointer to the start of the block with block number
+ * block_num (1-based). The block stays pinned until put_block.
+ */
+char* get_block(int block_num) {
+	return bdev->get(block_num, 1);
+}
+
+/*
+ * Same as get_block, for a block the caller is about to overwrite
+ * entirely: its old contents are not read.
+ */
+char* get_block_new(int block_num) {
+	return bdev->get(block_num, 0);
+}
+
+/*
+ * Releases a block from get_block or get_block_new; dirty is non-zero
+ * if the caller changed it.
+ */
+void put_block(int block_num, int dirty) {
+	bdev->put(block_num, dirty);
+}
+
+/*
+ * Runs a writeback pass if passes run per operation (pread backend
+ * with EXT2FSAL_WRITEBACK_MS 0). Called by each ext2_fsal_* operation
+ * before it returns.
+ */
+void blockdev_op_done(void) {
+	if (bdev == &pread_ops && writeback_ms == 0) pread_flush();
+}
+
+/*
+ * Returns: non-zero if the image is mapped (blocks may be addressed
+ * through fs directly), zero under the pread backend.
+ */
+int blockdev_mapped(void) {
+	return bdev == &mmap_ops;
+}
+
+/*
+ * Drops pending writes of the cached blocks in [first, end), which the
+ * caller knows are free, so writeback does not refill space that
+ * discard released. The caller holds block_bitmap_lock.
+ */
+void blockdev_forget(int first, int end) {
+	if (bdev != &pread_ops) return;
+
+	for (int b = first; b < end; b++) {
+		if (b < meta_blocks) continue;
+		struct cache_shard *sh = &shards[b % CACHE_SHARDS];
+		pthread_mutex_lock(&sh->lock);
+		int i = slot_lookup(sh, b);
+		if (i >= 0 && sh->slots[i].pins == 0 && sh->slots[i].dirty) {
+			sh->slots[i].dirty = 0;
+			sh->ndirty--;
+		}
+		pthread_mutex_unlock(&sh->lock);
+	}
+}
+
+/*
+ * Fills out with the block size, the backend, its cache counters and
+ * the I/O engine's.
+ */
+void blockdev_snapshot(struct ext2_fsal_blockdev_stats *out) {
+	memset(out, 0, sizeof(*out));
+	snprintf(out->backend, sizeof(out->backend), "%s", bdev ? bdev->name : "none");
+	out->block_size = block_size;
+	aio_snapshot(out);
+	if (bdev != &pread_ops) return;
+
+	out->meta_writebacks = __atomic_load_n(&meta_writebacks, __ATOMIC_RELAXED);
+	for (int k = 0; k < CACHE_SHARDS; k++) {
+		out->cache_blocks += shards[k].nslots;
+		out->hits += __atomic_load_n(&shards[k].hits, __ATOMIC_RELAXED);
+		out->misses += __atomic_load_n(&shards[k].misses, __ATOMIC_RELAXED);
+		out->writebacks += __atomic_load_n(&shards[k].writebacks, __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * Opens the image on fd (size bytes) with the backend EXT2FSAL_BACKEND
+ * names and points fs at it: the mapping under mmap, the resident
+ * metadata under pread. Called from ext2_fsal_init.
+ *
+ * Returns: 0 on success, -1 on error (errno set).
+ */
+int blockdev_open(int fd, size_t size) {
+	bdev_size = size;
+
+	const char *env = getenv("EXT2FSAL_BACKEND");
+	if (env != NULL && strcmp(env, "pread") == 0) {
+		bdev = &pread_ops;
+		return pread_open(fd);
+	}
+	if (env != NULL && *env != '\0' && strcmp(env, "mmap") != 0)
+		fprintf(stderr, "blockdev: unknown backend %s, using mmap\n", env);
+
+	bdev = &mmap_ops;
+	fs = map_image(fd, size);
+	return fs == MAP_FAILED ? -1 : 0;
+}
+
+/*
+ * Writes back everything still dirty and releases the image. Called
+ * last from ext2_fsal_destroy.
+ */
+void blockdev_close(void) {
+	bdev->close();
+	bdev = NULL;
+}
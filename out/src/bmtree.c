@@ -0,0 +1,275 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * In-memory summary tree over an on-disk allocation bitmap.
+ *
+ * Every leaf summarizes one 64-bit word of the bitmap and every
+ * internal node summarizes the span of its two children:
+ *
+ *   free: number of free bits in the span
+ *   pre:  length of the free run starting at the span's first bit
+ *   suf:  length of the free run ending at the span's last bit
+ *   best: length of the longest free run anywhere in the span
+ *
+ * With these, first-fit, goal-fit, first run of N free bits and the
+ * largest run are all answered by a single root-to-leaf descent.
+ * The tree is only a cache: the bitmap stays authoritative, and
+ * callers re-summarize a word with bm_tree_update after changing it
+ * (under the same lock that protects the bitmap).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "e2fs.h"
+
+#define BM_WORD_BITS 64
+
+/*
+ * Loads the 64-bit word with index word from the bitmap; bits past
+ * the end of the bitmap read as used.
+ */
+static uint64_t load_word(struct bm_tree *t, int word) {
+	uint64_t bits = ~0ULL;
+	int nbytes = (t->nbits + 7) / 8;
+	int off = word * 8;
+	int avail = nbytes - off;
+
+	if (avail >= 8) {
+		memcpy(&bits, t->bitmap + off, sizeof(bits));
+	}
+	else if (avail > 0) {
+		memcpy(&bits, t->bitmap + off, avail);
+	}
+
+	return bits;
+}
+
+/*
+ * Returns: the mask of bits in word that may never be handed out:
+ * those below the tree's first allocatable bit or past its end.
+ */
+static uint64_t reserved_mask(struct bm_tree *t, int word) {
+	uint64_t mask = 0;
+	int lo = word * BM_WORD_BITS;
+	int hi = lo + BM_WORD_BITS;
+
+	if (t->first > lo) {
+		int n = t->first - lo;
+		mask |= (n >= BM_WORD_BITS) ? ~0ULL : ((1ULL << n) - 1);
+	}
+	if (t->nbits < hi) {
+		int n = t->nbits - lo;
+		mask |= (n <= 0) ? ~0ULL : ~((1ULL << n) - 1);
+	}
+
+	return mask;
+}
+
+/*
+ * Returns: the free-bit mask of word (set bit = allocatable).
+ */
+static uint64_t free_mask(struct bm_tree *t, int word) {
+	if (word >= t->nwords) return 0;
+	return ~(load_word(t, word) | reserved_mask(t, word));
+}
+
+/*
+ * Summarizes a single free-bit mask into a leaf node.
+ */
+static void summarize_leaf(struct bm_node *node, uint64_t mask) {
+	node->len = BM_WORD_BITS;
+	node->free = __builtin_popcountll(mask);
+
+	if (mask == ~0ULL) {
+		node->pre = node->suf = node->best = BM_WORD_BITS;
+		return;
+	}
+
+	node->pre = __builtin_ctzll(~mask);
+	node->suf = __builtin_clzll(~mask);
+
+	// longest run of ones: shrink all runs by one bit per step
+	int best = 0;
+	uint64_t m = mask;
+	while (m) {
+		m &= m << 1;
+		best++;
+	}
+	node->best = best;
+}
+
+/*
+ * Recomputes an internal node from its two children.
+ */
+static void combine(struct bm_node *node, struct bm_node *l, struct bm_node *r) {
+	node->len = l->len + r->len;
+	node->free = l->free + r->free;
+	node->pre = (l->pre == l->len) ? l->len + r->pre : l->pre;
+	node->suf = (r->suf == r->len) ? r->len + l->suf : r->suf;
+
+	int best = l->best > r->best ? l->best : r->best;
+	if (l->suf + r->pre > best) best = l->suf + r->pre;
+	node->best = best;
+}
+
+/*
+ * Builds the summary tree for bitmap (nbits bits, set = used). Bits
+ * below first are never reported as free.
+ *
+ * Returns: 0 on success, -1 if memory cannot be allocated.
+ */
+int bm_tree_build(struct bm_tree *t, uint8_t *bitmap, int nbits, int first) {
+	t->bitmap = bitmap;
+	t->nbits = nbits;
+	t->first = first;
+	t->nwords = (nbits + BM_WORD_BITS - 1) / BM_WORD_BITS;
+
+	t->size = 1;
+	while (t->size < t->nwords) t->size *= 2;
+
+	t->nodes = calloc(2 * t->size, sizeof(struct bm_node));
+	if (t->nodes == NULL) return -1;
+
+	for (int w = 0; w < t->size; w++) {
+		summarize_leaf(&t->nodes[t->size + w], free_mask(t, w));
+	}
+	for (int i = t->size - 1; i >= 1; i--) {
+		combine(&t->nodes[i], &t->nodes[2 * i], &t->nodes[2 * i + 1]);
+	}
+
+	return 0;
+}
+
+/*
+ * Releases the tree's memory.
+ */
+void bm_tree_destroy(struct bm_tree *t) {
+	free(t->nodes);
+	t->nodes = NULL;
+}
+
+/*
+ * Re-summarizes the word holding bit (0-based) after the bitmap
+ * changed and propagates the change to the root.
+ */
+void bm_tree_update(struct bm_tree *t, int bit) {
+	int word = bit / BM_WORD_BITS;
+	int i = t->size + word;
+
+	summarize_leaf(&t->nodes[i], free_mask(t, word));
+	for (i /= 2; i >= 1; i /= 2) {
+		combine(&t->nodes[i], &t->nodes[2 * i], &t->nodes[2 * i + 1]);
+	}
+}
+
+/*
+ * Returns: the number of free bits tracked by the tree.
+ */
+int bm_tree_free_count(struct bm_tree *t) {
+	return t->nodes[1].free;
+}
+
+/*
+ * Descends into node i (covering words [lo, hi)) looking for the
+ * first free bit at or after goal, pruning spans that end before goal
+ * or contain no free bits.
+ */
+static int find_free_from(struct bm_tree *t, int i, int lo, int hi, int goal) {
+	if (t->nodes[i].free == 0 || hi * BM_WORD_BITS <= goal) return -1;
+
+	if (i >= t->size) {
+		uint64_t mask = free_mask(t, lo);
+		int start = goal - lo * BM_WORD_BITS;
+		if (start > 0) mask &= ~0ULL << start;
+		return mask ? lo * BM_WORD_BITS + __builtin_ctzll(mask) : -1;
+	}
+
+	int mid = (lo + hi) / 2;
+	int found = find_free_from(t, 2 * i, lo, mid, goal);
+	if (found >= 0) return found;
+	return find_free_from(t, 2 * i + 1, mid, hi, goal);
+}
+
+/*
+ * Goal-fit: finds the first free bit at or after goal, wrapping
+ * around to the start of the bitmap if there is none.
+ *
+ * Returns: the bit index (0-based), or -1 if the bitmap is full.
+ */
+int bm_find_free(struct bm_tree *t, int goal) {
+	if (goal < 0 || goal >= t->nbits) goal = 0;
+
+	int found = find_free_from(t, 1, 0, t->size, goal);
+	if (found < 0 && goal > 0) found = find_free_from(t, 1, 0, t->size, 0);
+	return found;
+}
+
+/*
+ * Returns: the start of the first run of len free bits inside the
+ * single word mask, or -1.
+ */
+static int find_run_in_word(uint64_t mask, int len) {
+	// keep only bits that start a run of at least len ones
+	uint64_t m = mask;
+	for (int k = 1; k < len && m; k++) m &= mask >> k;
+	return m ? __builtin_ctzll(m) : -1;
+}
+
+/*
+ * First-fit for runs: finds the lowest-addressed run of at least len
+ * contiguous free bits.
+ *
+ * Returns: the first bit (0-based) of the run, or -1 if none exists.
+ */
+int bm_find_run(struct bm_tree *t, int len) {
+	if (len <= 0 || t->nodes[1].best < len) return -1;
+
+	int i = 1;
+	int lo = 0, hi = t->size;
+
+	while (i < t->size) {
+		struct bm_node *l = &t->nodes[2 * i];
+		struct bm_node *r = &t->nodes[2 * i + 1];
+		int mid = (lo + hi) / 2;
+
+		if (l->best >= len) {
+			i = 2 * i;
+			hi = mid;
+		}
+		else if (l->suf + r->pre >= len) {
+			// run straddles the two halves
+			return mid * BM_WORD_BITS - l->suf;
+		}
+		else {
+			i = 2 * i + 1;
+			lo = mid;
+		}
+	}
+
+	return lo * BM_WORD_BITS + find_run_in_word(free_mask(t, lo), len);
+}
+
+/*
+ * Finds the longest run of free bits.
+ *
+ * start: receives the first bit of the run (-1 if the bitmap is full)
+ *
+ * Returns: the length of the run.
+ */
+int bm_largest_run(struct bm_tree *t, int *start) {
+	int best = t->nodes[1].best;
+	*start = best > 0 ? bm_find_run(t, best) : -1;
+	return best;
+}
@@ -0,0 +1,99 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Directory block routines.
+ *
+ * Walking the entries of a directory block is the inner loop of every
+ * lookup, insert and removal. The walks are compiled once per
+ * supported block size from dirblock_tmpl.h, so each has the size of
+ * the block as a constant, and dirblock_init selects the variant for
+ * the block size of the image.
+ */
+
+#include <string.h>
+#include "ext2fsal.h"
+#include "e2fs.h"
+
+struct dirblock_ops {
+	struct ext2_dir_entry *(*last)(char *block);
+	struct ext2_dir_entry *(*lookup)(char *block, const char *name, int name_len,
+			struct ext2_dir_entry **prev_out);
+	struct ext2_dir_entry *(*gap)(char *block, int needed);
+};
+
+// the variants see a constant in place of the image's block size
+#undef EXT2_BLOCK_SIZE
+
+#define EXT2_BLOCK_SIZE 1024
+#define DIRBLOCK(name) name##_1k
+#include "dirblock_tmpl.h"
+#undef DIRBLOCK
+#undef EXT2_BLOCK_SIZE
+
+#define EXT2_BLOCK_SIZE 2048
+#define DIRBLOCK(name) name##_2k
+#include "dirblock_tmpl.h"
+#undef DIRBLOCK
+#undef EXT2_BLOCK_SIZE
+
+#define EXT2_BLOCK_SIZE 4096
+#define DIRBLOCK(name) name##_4k
+#include "dirblock_tmpl.h"
+#undef DIRBLOCK
+#undef EXT2_BLOCK_SIZE
+
+static const struct dirblock_ops ops_1k = { last_1k, lookup_1k, gap_1k };
+static const struct dirblock_ops ops_2k = { last_2k, lookup_2k, gap_2k };
+static const struct dirblock_ops ops_4k = { last_4k, lookup_4k, gap_4k };
+
+static const struct dirblock_ops *dops = &ops_1k;
+
+/*
+ * Selects the routines for blocks of size bytes (1024, 2048 or 4096).
+ * Called from ext2_fsal_init once the superblock has been read.
+ */
+void dirblock_init(int size) {
+	if (size == 4096) dops = &ops_4k;
+	else if (size == 2048) dops = &ops_2k;
+	else dops = &ops_1k;
+}
+
+/*
+ * Returns: the last entry of the directory block block, or NULL if it
+ * has none.
+ */
+struct ext2_dir_entry *dirblock_last(char *block) {
+	return dops->last(block);
+}
+
+/*
+ * Looks up the live entry called name (name_len bytes) in the
+ * directory block block; the entry before it, or NULL, goes to
+ * prev_out if that is not NULL.
+ *
+ * Returns: the entry, or NULL if not found.
+ */
+struct ext2_dir_entry *dirblock_lookup(char *block, const char *name, int name_len,
+		struct ext2_dir_entry **prev_out) {
+	return dops->lookup(block, name, name_len, prev_out);
+}
+
+/*
+ * Returns: an unused entry of at least needed bytes in the directory
+ * block block, or a live entry with that much slack to split off, or
+ * NULL if there is neither.
+ */
+struct ext2_dir_entry *dirblock_gap(char *block, int needed) {
+	return dops->gap(block, needed);
+}
@@ -0,0 +1,96 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Directory block routines for one block size. Included by dirblock.c
+ * once per supported size, with EXT2_BLOCK_SIZE defined as that size
+ * and DIRBLOCK(name) naming the variant; there is deliberately no
+ * include guard.
+ *
+ * The walks use offsets into the block, so the bound is a constant.
+ */
+
+/*
+ * Returns: the last entry of block (the one whose rec_len reaches the
+ * end of the block), or NULL if the block has no entries.
+ */
+static struct ext2_dir_entry *DIRBLOCK(last)(char *block) {
+	struct ext2_dir_entry *last = NULL;
+	int off = 0;
+
+	while (off < EXT2_BLOCK_SIZE) {
+		struct ext2_dir_entry *entry = (struct ext2_dir_entry *)(block + off);
+		if (entry->rec_len == 0) break;
+
+		last = entry;
+		if (off + entry->rec_len >= EXT2_BLOCK_SIZE) break;
+		off += entry->rec_len;
+	}
+
+	return last;
+}
+
+/*
+ * Looks up the live entry called name (name_len bytes) in block. The
+ * entry before it in the block (NULL if it is the first) is stored in
+ * prev_out, if given.
+ *
+ * Returns: a pointer to the entry, or NULL if not found.
+ */
+static struct ext2_dir_entry *DIRBLOCK(lookup)(char *block, const char *name,
+		int name_len, struct ext2_dir_entry **prev_out) {
+	struct ext2_dir_entry *prev = NULL;
+	int off = 0;
+
+	while (off < EXT2_BLOCK_SIZE) {
+		struct ext2_dir_entry *entry = (struct ext2_dir_entry *)(block + off);
+		if (entry->rec_len == 0) break;
+
+		if (entry->inode != 0 && entry->name_len == name_len &&
+		    memcmp(entry->name, name, name_len) == 0) {
+			if (prev_out) *prev_out = prev;
+			return entry;
+		}
+
+		prev = entry;
+		off += entry->rec_len;
+	}
+
+	return NULL;
+}
+
+/*
+ * Finds room for an entry of needed bytes in block: either an unused
+ * entry at least that long, or a live entry with that much slack
+ * behind its name.
+ *
+ * Returns: the entry to take over (inode 0) or to split, or NULL.
+ */
+static struct ext2_dir_entry *DIRBLOCK(gap)(char *block, int needed) {
+	int off = 0;
+
+	while (off < EXT2_BLOCK_SIZE) {
+		struct ext2_dir_entry *entry = (struct ext2_dir_entry *)(block + off);
+		if (entry->rec_len == 0) break;
+
+		if (entry->inode == 0 && entry->rec_len >= needed) return entry;
+
+		// header (8 bytes) plus name, 4-byte aligned
+		int actual_size = (8 + entry->name_len + 3) & ~3;
+		if (entry->inode != 0 && entry->rec_len - actual_size >= needed) return entry;
+
+		off += entry->rec_len;
+	}
+
+	return NULL;
+}
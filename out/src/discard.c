@@ -0,0 +1,293 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Discard of freed blocks in the host image file.
+ *
+ * With EXT2FSAL_DISCARD set at init, every block freed through
+ * free_block or free_blocks_bulk is queued, and a discard thread
+ * returns the space to the host file system every DISCARD_INTERVAL_MS
+ * (or sooner once the queue is half full):
+ *
+ *   punch    fallocate(FALLOC_FL_PUNCH_HOLE) on the image file
+ *   madvise  madvise(MADV_REMOVE) on the mapping (punch under the
+ *            pread block device backend, which has none)
+ *
+ * Queued blocks are sorted and coalesced into ranges widened to whole
+ * host pages, since a page can only be released once all the blocks
+ * in it are free. Each range is punched under block_bitmap_lock, and
+ * only where the bitmap still shows the blocks free: a block that was
+ * allocated again in the meantime is never touched, and a block
+ * allocated afterwards simply reads back as zeros before it is
+ * written. Frees only pay for appending to the queue.
+ *
+ * If the queue overflows, the next pass rescans the whole bitmap
+ * instead.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "ext2fsal.h"
+#include "e2fs.h"
+
+#define DISCARD_QUEUE       65536   // blocks queued between passes
+#define DISCARD_INTERVAL_MS 100
+#define RESCAN_CHUNK        4096    // blocks checked per hold of the bitmap lock
+
+enum discard_mode { DISCARD_OFF, DISCARD_PUNCH, DISCARD_MADVISE };
+
+static enum discard_mode mode = DISCARD_OFF;
+static int discard_fd = -1;
+static int blocks_per_page;
+
+// blocks freed since the last pass; double-buffered so the discard
+// thread can work through one batch while frees fill the other
+static int *queue, *batch;
+static int queued;
+static int overflow;                 // blocks were dropped: rescan all
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t discard_thread;
+static int stopping;
+
+static uint64_t punched_ranges, punched_bytes;
+
+// ------------------------- QUEUEING ------------------------------
+
+/*
+ * Queues count freed blocks (1-based numbers) for discard. Called by
+ * free_block and free_blocks_bulk with block_bitmap_lock held.
+ */
+void discard_freed(int *blocks, int count) {
+	if (mode == DISCARD_OFF || count == 0) return;
+
+	mutex_lock(&queue_lock);
+	if (queued + count > DISCARD_QUEUE) {
+		overflow = 1;
+	}
+	else {
+		memcpy(queue + queued, blocks, count * sizeof(int));
+		queued += count;
+	}
+	if (queued > DISCARD_QUEUE / 2 || overflow) pthread_cond_signal(&queue_cond);
+	mutex_unlock(&queue_lock);
+}
+
+// ------------------------- PUNCHING ------------------------------
+
+/*
+ * Releases the whole host pages inside blocks [first, end) of the
+ * image. The caller holds block_bitmap_lock and has checked that
+ * every block in the span is free.
+ */
+static void punch_blocks(int first, int end) {
+	int lo = (first + blocks_per_page - 1) / blocks_per_page * blocks_per_page;
+	int hi = end / blocks_per_page * blocks_per_page;
+	if (lo >= hi) return;
+
+	off_t off = (off_t)lo * EXT2_BLOCK_SIZE;
+	off_t len = (off_t)(hi - lo) * EXT2_BLOCK_SIZE;
+	int ret;
+
+	// cached writes of these blocks would fill the hole again
+	blockdev_forget(lo, hi);
+
+	if (mode == DISCARD_PUNCH)
+		ret = fallocate(discard_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, len);
+	else
+		ret = madvise(fs + off, len, MADV_REMOVE);
+
+	if (ret < 0) {
+		perror("discard");
+		return;
+	}
+	punched_ranges++;
+	punched_bytes += len;
+}
+
+/*
+ * Punches every run of blocks in [first, end) that is still free,
+ * under block_bitmap_lock.
+ */
+static void punch_free_runs(int first, int end) {
+	if (first < first_data_block) first = first_data_block;
+	if (end > num_blocks) end = num_blocks;
+
+	mutex_lock(&block_bitmap_lock);
+
+	int b = first;
+	while (b < end) {
+		while (b < end && test_bit(block_bitmap, BLOCK_BIT(b))) b++;
+		int start = b;
+		while (b < end && !test_bit(block_bitmap, BLOCK_BIT(b))) b++;
+		if (b > start) punch_blocks(start, b);
+	}
+
+	mutex_unlock(&block_bitmap_lock);
+}
+
+static int cmp_int(const void *a, const void *b) {
+	int x = *(const int *)a, y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Sorts the n queued blocks in batch, merges them into page-aligned
+ * ranges and punches each range.
+ */
+static void discard_batch(int n) {
+	qsort(batch, n, sizeof(int), cmp_int);
+
+	int i = 0;
+	while (i < n) {
+		// widen to whole pages and absorb every block that touches them
+		int first = batch[i] / blocks_per_page * blocks_per_page;
+		int end = (batch[i] / blocks_per_page + 1) * blocks_per_page;
+		while (i < n && batch[i] < end + blocks_per_page) {
+			end = (batch[i] / blocks_per_page + 1) * blocks_per_page;
+			i++;
+		}
+		punch_free_runs(first, end);
+	}
+}
+
+/*
+ * Discard thread: every DISCARD_INTERVAL_MS (or when signalled) takes
+ * the queued blocks and punches them, until stopping is set. A final
+ * pass runs after stopping so nothing queued is left behind.
+ */
+static void *discard_main(void *arg) {
+	(void)arg;
+	mutex_lock(&queue_lock);
+
+	for (;;) {
+		if (queued == 0 && !overflow && !stopping) {
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += DISCARD_INTERVAL_MS * 1000000L;
+			ts.tv_sec += ts.tv_nsec / 1000000000L;
+			ts.tv_nsec %= 1000000000L;
+			pthread_cond_timedwait(&queue_cond, &queue_lock, &ts);
+		}
+
+		int *full = queue;
+		int n = queued;
+		int rescan = overflow;
+		int stop = stopping;
+		queue = batch;
+		batch = full;
+		queued = 0;
+		overflow = 0;
+		mutex_unlock(&queue_lock);
+
+		if (rescan) {
+			for (int b = 1; b < num_blocks; b += RESCAN_CHUNK)
+				punch_free_runs(b, b + RESCAN_CHUNK);
+		}
+		else if (n > 0) {
+			discard_batch(n);
+		}
+
+		mutex_lock(&queue_lock);
+		if (stop && queued == 0 && !overflow) break;
+	}
+
+	mutex_unlock(&queue_lock);
+	return NULL;
+}
+
+// ------------------------ SETUP & TEARDOWN -----------------------
+
+/*
+ * Turns discard on if EXT2FSAL_DISCARD is "punch" or "madvise" and
+ * starts the discard thread. fd is the open image; punch mode keeps
+ * its own duplicate. Called from ext2_fsal_init once the image is
+ * mapped.
+ */
+void discard_init(int fd) {
+	const char *env = getenv("EXT2FSAL_DISCARD");
+	if (env == NULL || *env == '\0' || strcmp(env, "0") == 0) return;
+
+	enum discard_mode m;
+	if (strcmp(env, "punch") == 0) m = DISCARD_PUNCH;
+	else if (strcmp(env, "madvise") == 0) m = DISCARD_MADVISE;
+	else {
+		fprintf(stderr, "discard: unknown mode %s (punch or madvise)\n", env);
+		return;
+	}
+
+	// without a mapping there is nothing to madvise
+	if (m == DISCARD_MADVISE && !blockdev_mapped()) m = DISCARD_PUNCH;
+
+	long page = sysconf(_SC_PAGESIZE);
+	blocks_per_page = page > EXT2_BLOCK_SIZE ? page / EXT2_BLOCK_SIZE : 1;
+
+	queue = malloc(DISCARD_QUEUE * sizeof(int));
+	batch = malloc(DISCARD_QUEUE * sizeof(int));
+	if (m == DISCARD_PUNCH) discard_fd = dup(fd);
+	if (queue == NULL || batch == NULL || (m == DISCARD_PUNCH && discard_fd < 0)) {
+		perror("discard");
+		goto fail;
+	}
+
+	queued = 0;
+	overflow = 0;
+	stopping = 0;
+	punched_ranges = punched_bytes = 0;
+	mode = m;
+	if (pthread_create(&discard_thread, NULL, discard_main, NULL) != 0) {
+		perror("discard");
+		mode = DISCARD_OFF;
+		goto fail;
+	}
+	return;
+
+fail:
+	free(queue);
+	free(batch);
+	queue = batch = NULL;
+	if (discard_fd >= 0) close(discard_fd);
+	discard_fd = -1;
+}
+
+/*
+ * Punches whatever is still queued, stops the discard thread and
+ * reports how much was released. Called from ext2_fsal_destroy once
+ * no operations are running, before the image is unmapped.
+ */
+void discard_destroy(void) {
+	if (mode == DISCARD_OFF) return;
+
+	mutex_lock(&queue_lock);
+	stopping = 1;
+	pthread_cond_signal(&queue_cond);
+	mutex_unlock(&queue_lock);
+	pthread_join(discard_thread, NULL);
+
+	fprintf(stderr, "discard: released %llu KiB in %llu ranges\n",
+		(unsigned long long)(punched_bytes / 1024), (unsigned long long)punched_ranges);
+
+	mode = DISCARD_OFF;
+	free(queue);
+	free(batch);
+	queue = batch = NULL;
+	if (discard_fd >= 0) close(discard_fd);
+	discard_fd = -1;
+}
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include "e2fs.h"
 #include "ext2fsal.h"
+#include "probes.h"
 #include <stdio.h>
 
 // ----------------------- BITMAP OPERATION HELPERS ----------------
@@ -65,14 +66,52 @@ static void mutex_init(pthread_mutex_t *mutex) {
 }
 
 /*
- * Locks a mutex and checks for error.
+ * Returns: the statistics lock class of mutex, derived from which 
+ * lock array or global it lives in.
+ */
+static int lock_class(pthread_mutex_t *mutex) {
+	if (mutex >= inode_locks && mutex < inode_locks + num_inodes) 
+		return EXT2_FSAL_LOCK_INODE;
+	if (mutex >= block_locks && mutex < block_locks + num_blocks) 
+		return EXT2_FSAL_LOCK_BLOCK;
+	if (mutex >= name_locks && mutex < name_locks + NAME_LOCKS) 
+		return EXT2_FSAL_LOCK_NAME;
+	if (mutex == &inode_bitmap_lock) return EXT2_FSAL_LOCK_INODE_BITMAP;
+	if (mutex == &block_bitmap_lock) return EXT2_FSAL_LOCK_BLOCK_BITMAP;
+	return EXT2_FSAL_LOCK_OTHER;
+}
+
+/*
+ * Locks a mutex and checks for error. An uncontended lock is taken 
+ * with a trylock; only when it has to wait is the wait timed, so the 
+ * fast path costs no clock reads.
  */
 void mutex_lock(pthread_mutex_t *mutex) {
+
+	if (pthread_mutex_trylock(mutex) == 0) {
+		stats_lock_acquired(lock_class(mutex), 0, 0);
+#ifdef EXT2FSAL_LOCKPROF
+		lockprof_acquired(mutex, lock_class(mutex), 0, 0, __builtin_return_address(0));
+#endif
+		return;
+	}
+
+	uint64_t start = stats_now();
+#ifdef EXT2FSAL_LOCKPROF
+	// the profiler times waits even with statistics disabled
+	uint64_t prof_start = lockprof_now();
+#endif
 	
 	if (pthread_mutex_lock(mutex) != 0) {
 		fprintf(stderr, "mutex lock failed\n");
 		exit(EXIT_FAILURE);
 	}
+
+	stats_lock_acquired(lock_class(mutex), stats_now() - start, 1);
+#ifdef EXT2FSAL_LOCKPROF
+	lockprof_acquired(mutex, lock_class(mutex), lockprof_now() - prof_start, 
+		1, __builtin_return_address(0));
+#endif
 }
 
 /*
@@ -98,7 +137,8 @@ static void mutex_destroy(pthread_mutex_t *mutex) {
 
 /*
  * Initializes all synchronization locks for thread-safe filesystem 
- * access. Creates per-inode locks, per-block locks, and bitmap locks.
+ * access. Creates per-inode locks, per-block locks, the hashed name
+ * locks, and bitmap locks.
  */
 void locks_init(int num_inodes, int num_blocks) {
 
@@ -115,9 +155,16 @@ void locks_init(int num_inodes, int num_blocks) {
 		exit(EXIT_FAILURE);
 	}
 
+	name_locks = malloc(sizeof(pthread_mutex_t) * NAME_LOCKS);
+	if (name_locks == NULL) {
+		perror("malloc failed");
+		exit(EXIT_FAILURE);
+	}
+
 	// initialize bitmap locks
 	mutex_init(&inode_bitmap_lock);
 	mutex_init(&block_bitmap_lock);
+	mutex_init(&rename_lock);
 
 	// initialize per-inode and per-block locks
         for (int i = 0; i < num_inodes; i++) {
@@ -128,6 +175,9 @@ void locks_init(int num_inodes, int num_blocks) {
 		mutex_init(&block_locks[i]);
 	}
 
+	for (int i = 0; i < NAME_LOCKS; i++) {
+		mutex_init(&name_locks[i]);
+	}
 }
 
 /*
@@ -140,59 +190,94 @@ void locks_destroy(int num_inodes, int num_blocks) {
 	
 	for (int i = 0; i < num_blocks; i++) mutex_destroy(&block_locks[i]);
 
+	for (int i = 0; i < NAME_LOCKS; i++) mutex_destroy(&name_locks[i]);
+
 	// destroy bitmap locks	
 	mutex_destroy(&inode_bitmap_lock);
 	mutex_destroy(&block_bitmap_lock);
+	mutex_destroy(&rename_lock);
 
 	// free lock arrays
         free(inode_locks);
         free(block_locks);
+	free(name_locks);
 	block_locks = NULL;
 	inode_locks = NULL;
+	name_locks = NULL;
+}
+
+/*
+ * Returns: the lock guarding the name name (name_len bytes) in 
+ * directory dir_ino. Holding it keeps any other thread from adding an
+ * entry of that name to the directory, so a lookup followed by an 
+ * insert is atomic without locking the whole directory. Names hash 
+ * onto NAME_LOCKS locks, so unrelated names occasionally share one.
+ */
+pthread_mutex_t *name_lock(int dir_ino, const char *name, int name_len) {
+
+	// FNV-1a over the name, seeded with the directory
+	uint32_t h = 2166136261u ^ (uint32_t)dir_ino;
+	for (int i = 0; i < name_len; i++) {
+		h ^= (uint8_t)name[i];
+		h *= 16777619u;
+	}
+	return &name_locks[h & (NAME_LOCKS - 1)];
 }
 
 // ----------------- INODE ACCESS/ALLOCATION HELPERS ----------------
 
 /*
  * Allocates a new inode from the bitmap:
- * - Searches for the first free inode starting from the first 
- *   non-reserved inode.
+ * - Finds the first free inode past the reserved ones through the 
+ *   summary tree (inode_tree skips reserved inodes 0-10).
  * - Updates both group descriptor and superblock free inode counts.
  *
+ * - If none is free, tries to reclaim retired inodes first.
+ *
  * Returns: inode number (1-based) on success, -1 if no free inodes.
  */
 int alloc_inode() {
+	uint64_t start = stats_now();
 	mutex_lock(&inode_bitmap_lock);
 
-	// search for first free inode (skip reserved inodes 0-10)
-	for (int i = EXT2_GOOD_OLD_FIRST_INO; i < num_inodes; i++) {
-		// if inode is free, allocate new inode
-		if (!test_bit(inode_bitmap, i)) {
-			set_bit(inode_bitmap, i);
-			group_desc->bg_free_inodes_count--;
-			superblock->s_free_inodes_count--;
-			
-			mutex_unlock(&inode_bitmap_lock);
-			
-			// return inode number
-			return i + 1;  // inode numbers start at 1
+	int i;
+	while ((i = bm_find_free(&inode_tree, 0)) < 0) {
+		mutex_unlock(&inode_bitmap_lock);
+		if (reclaim_advance() <= 0) {
+			stats_phase_done(EXT2_FSAL_PHASE_ALLOC, start);
+			return -1;  // No free inodes
 		}
+		mutex_lock(&inode_bitmap_lock);
 	}
 
+	set_bit(inode_bitmap, i);
+	bm_tree_update(&inode_tree, i);
+	group_desc->bg_free_inodes_count--;
+	superblock->s_free_inodes_count--;
+
 	mutex_unlock(&inode_bitmap_lock);
-	return -1;  // No free inodes
+	stats_phase_done(EXT2_FSAL_PHASE_ALLOC, start);
+
+	// return inode number
+	return i + 1;  // inode numbers start at 1
 }
 
 /*
  * Frees the given inode (1-based index) and updates filesystem 
- * counts.
+ * counts. The inode is marked deleted first: callers free inodes 
+ * that were written but never linked, which must not look live.
  */
 void free_inode(int inode) {
 	int idx = inode - 1;  // convert to 0-based index
 
+	struct ext2_inode *dead = get_inode(inode);
+	dead->i_links_count = 0;
+	dead->i_dtime = (uint32_t)time(NULL);
+
 	mutex_lock(&inode_bitmap_lock);
 
 	clear_bit(inode_bitmap, idx);
+	bm_tree_update(&inode_tree, idx);
 	group_desc->bg_free_inodes_count++;
 	superblock->s_free_inodes_count++;
 
@@ -226,44 +311,159 @@ void write_inode(int ino, struct ext2_inode* inode) {
 // ----------------- BLOCK ACCESS/ALLOCATION HELPERS ----------------
 
 /*
- * Allocates a new data block from the bitmap.
+ * Allocates a new data block from the bitmap (first fit, found 
+ * through the summary tree), reclaiming retired blocks if none is.
  * Updates both group descriptor and superblock free block counts.
  *
- * Returns: the block number (1-based) on success, or -1 if no free 
- * blocks.
+ * Returns: the block number on success, or -1 if no free blocks.
  */
 int alloc_block() {
 
+	uint64_t start = stats_now();
+	PHASE_BEGIN0(alloc_block);
 	mutex_lock(&block_bitmap_lock);
 
-	// scan bitmap for the first free block
-	for (int i = 0; i < num_blocks; i++) {
-		// if free, allocate block & update bookkeeping
-		if (!test_bit(block_bitmap, i)) {
-			set_bit(block_bitmap, i);
-			group_desc->bg_free_blocks_count--;
-			superblock->s_free_blocks_count--;
+	int i;
+	while ((i = bm_find_free(&block_tree, 0)) < 0) {
+		mutex_unlock(&block_bitmap_lock);
+		if (reclaim_advance() <= 0) {
+			PHASE_END(alloc_block, TL_ALLOC_BLOCK, -1);
+			stats_phase_done(EXT2_FSAL_PHASE_ALLOC, start);
+			return -1;  // no free blocks
+		}
+		mutex_lock(&block_bitmap_lock);
+	}
+
+	// allocate block & update bookkeeping
+	set_bit(block_bitmap, i);
+	bm_tree_update(&block_tree, i);
+	group_desc->bg_free_blocks_count--;
+	superblock->s_free_blocks_count--;
+
+	mutex_unlock(&block_bitmap_lock);
+	PHASE_END(alloc_block, TL_ALLOC_BLOCK, BIT_BLOCK(i));
+	stats_phase_done(EXT2_FSAL_PHASE_ALLOC, start);
+
+	return BIT_BLOCK(i);
+}
 
-			mutex_unlock(&block_bitmap_lock);
 
-			// return block number (1-based)
-			return i + 1;
+/*
+ * Reserves count free inodes under a single hold of 
+ * inode_bitmap_lock; the inode numbers (1-based) are stored in out. 
+ * Either all are reserved or none is.
+ *
+ * Returns: 0 on success, ENOSPC if fewer than count inodes are free.
+ */
+int alloc_inodes_batch(int count, int *out) {
+	int n = 0;
+
+	mutex_lock(&inode_bitmap_lock);
+
+	// short: retired inodes may be ready to reuse
+	while ((int)superblock->s_free_inodes_count < count) {
+		mutex_unlock(&inode_bitmap_lock);
+		if (reclaim_advance() <= 0) return ENOSPC;
+		mutex_lock(&inode_bitmap_lock);
+	}
+
+	int i = 0;
+	while (n < count && (i = bm_find_free(&inode_tree, i)) >= 0) {
+		set_bit(inode_bitmap, i);
+		bm_tree_update(&inode_tree, i);
+		out[n++] = i + 1;
+	}
+
+	// counts were stale: undo the partial reservation
+	if (n < count) {
+		for (int k = 0; k < n; k++) {
+			clear_bit(inode_bitmap, out[k] - 1);
+			bm_tree_update(&inode_tree, out[k] - 1);
 		}
+		mutex_unlock(&inode_bitmap_lock);
+		return ENOSPC;
 	}
 
-	mutex_unlock(&block_bitmap_lock);
+	group_desc->bg_free_inodes_count -= count;
+	superblock->s_free_inodes_count -= count;
 
-	// no free blocks
-	return -1;
+	mutex_unlock(&inode_bitmap_lock);
+	return 0;
 }
 
+/*
+ * Reserves count free blocks under a single hold of 
+ * block_bitmap_lock; the block numbers are stored in out in 
+ * ascending order. A single contiguous run is preferred when one 
+ * exists. Either all are reserved or none is.
+ *
+ * Returns: 0 on success, ENOSPC if fewer than count blocks are free.
+ */
+int alloc_blocks_batch(int count, int *out) {
+	int n = 0;
+
+	mutex_lock(&block_bitmap_lock);
 
-/**
- * Returns: a pointer to the start of the data block with block 
- * number block_num (1-based).
+	// short: retired directory blocks may be ready to reuse
+	while ((int)superblock->s_free_blocks_count < count) {
+		mutex_unlock(&block_bitmap_lock);
+		if (reclaim_advance() <= 0) return ENOSPC;
+		mutex_lock(&block_bitmap_lock);
+	}
+
+	// contiguous if possible, otherwise first fit one at a time
+	int i = bm_find_run(&block_tree, count);
+	if (i < 0) i = 0;
+
+	while (n < count && (i = bm_find_free(&block_tree, i)) >= 0) {
+		set_bit(block_bitmap, i);
+		bm_tree_update(&block_tree, i);
+		out[n++] = BIT_BLOCK(i);
+	}
+
+	// counts were stale: undo the partial reservation
+	if (n < count) {
+		for (int k = 0; k < n; k++) {
+			clear_bit(block_bitmap, BLOCK_BIT(out[k]));
+			bm_tree_update(&block_tree, BLOCK_BIT(out[k]));
+		}
+		mutex_unlock(&block_bitmap_lock);
+		return ENOSPC;
+	}
+
+	group_desc->bg_free_blocks_count -= count;
+	superblock->s_free_blocks_count -= count;
+
+	mutex_unlock(&block_bitmap_lock);
+	return 0;
+}
+
+/*
+ * Reserves count contiguous free blocks under block_bitmap_lock, 
+ * taking the first free run that is long enough.
+ *
+ * Returns: the first block number of the run, or -1 if no free run 
+ * of count blocks exists.
  */
-char* get_block(int block_num) {
-	return (char*)(fs + block_num * EXT2_BLOCK_SIZE);
+int alloc_block_run(int count) {
+	mutex_lock(&block_bitmap_lock);
+
+	int i = bm_find_run(&block_tree, count);
+	if (i < 0) {
+		mutex_unlock(&block_bitmap_lock);
+		return -1;
+	}
+
+	// re-summarize each touched word once
+	for (int k = 0; k < count; k++) {
+		set_bit(block_bitmap, i + k);
+		if ((i + k) % 64 == 63 || k == count - 1) bm_tree_update(&block_tree, i + k);
+	}
+	group_desc->bg_free_blocks_count -= count;
+	superblock->s_free_blocks_count -= count;
+
+	mutex_unlock(&block_bitmap_lock);
+	return BIT_BLOCK(i);
 }
 
 /*
@@ -272,26 +472,131 @@ char* get_block(int block_num) {
 void write_block(int block_num, char* data) {
 	mutex_lock(&block_locks[block_num - 1]);
 
-	char* block = get_block(block_num);
+	char* block = get_block_new(block_num);
 	memcpy(block, data, EXT2_BLOCK_SIZE);
+	put_block(block_num, 1);
 
 	mutex_unlock(&block_locks[block_num - 1]);
 }
 
 /*
  * Frees the data block with block number block_num (1-based) and 
- * updates filesystem counts.
+ * updates filesystem counts. The block is queued for discard if that
+ * is enabled.
  */
 void free_block(int block_num) {
 	mutex_lock(&block_bitmap_lock);
 
-	clear_bit(block_bitmap, block_num - 1);
+	clear_bit(block_bitmap, BLOCK_BIT(block_num));
+	bm_tree_update(&block_tree, BLOCK_BIT(block_num));
 	group_desc->bg_free_blocks_count++;
 	superblock->s_free_blocks_count++;
+	discard_freed(&block_num, 1);
+
+	mutex_unlock(&block_bitmap_lock);
+}
+
+// ---------------------- BULK BITMAP RELEASE ----------------------
+
+/*
+ * qsort comparator for ascending int arrays.
+ */
+static int cmp_int(const void *a, const void *b) {
+	int x = *(const int *)a, y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Clears the numbers in nums (count entries) from the bitmap 
+ * summarized by tree; base is the number of bit 0. The list is sorted first so that all bits 
+ * falling in the same 64-bit word are cleared with a single masked 
+ * store and re-summarized once. The caller must hold the bitmap's 
+ * lock.
+ *
+ * Returns: the number of bits that were set and are now clear.
+ */
+static int clear_bits_bulk(struct bm_tree *tree, int base, int *nums, int count) {
+	uint8_t *bitmap = tree->bitmap;
+	int nbits = tree->nbits;
+	int cleared = 0;
+
+	qsort(nums, count, sizeof(int), cmp_int);
+
+	int i = 0;
+	while (i < count) {
+		int word = (nums[i] - base) / 64;
+		uint64_t mask = 0;
+
+		// gather every number that lands in this word
+		while (i < count && (nums[i] - base) / 64 == word) {
+			mask |= 1ULL << ((nums[i] - base) % 64);
+			i++;
+		}
+
+		// tail word shorter than 64 bits: fall back to single bits
+		if ((word + 1) * 64 > nbits) {
+			for (int bit = 0; bit < 64; bit++) {
+				if ((mask >> bit) & 1) {
+					int n = word * 64 + bit;
+					if (n < nbits && test_bit(bitmap, n)) {
+						clear_bit(bitmap, n);
+						cleared++;
+					}
+				}
+			}
+			bm_tree_update(tree, word * 64);
+			continue;
+		}
+
+		uint64_t bits;
+		memcpy(&bits, bitmap + word * 8, sizeof(bits));
+		cleared += __builtin_popcountll(bits & mask);
+		bits &= ~mask;
+		memcpy(bitmap + word * 8, &bits, sizeof(bits));
+		bm_tree_update(tree, word * 64);
+	}
+
+	return cleared;
+}
+
+/*
+ * Frees all blocks in blocks (count block numbers) under a 
+ * single hold of block_bitmap_lock, updates the free counts once and
+ * queues the blocks for discard if that is enabled. The array is
+ * sorted in place.
+ */
+void free_blocks_bulk(int *blocks, int count) {
+	if (count == 0) return;
+
+	mutex_lock(&block_bitmap_lock);
+
+	int cleared = clear_bits_bulk(&block_tree, first_data_block, blocks, count);
+	group_desc->bg_free_blocks_count += cleared;
+	superblock->s_free_blocks_count += cleared;
+	discard_freed(blocks, count);
 
 	mutex_unlock(&block_bitmap_lock);
 }
 
+/*
+ * Frees all inodes in inos (count 1-based inode numbers) under a 
+ * single hold of inode_bitmap_lock, updates the free counts once and 
+ * drops dirs from the group's used directory count. The array is 
+ * sorted in place.
+ */
+void free_inodes_bulk(int *inos, int count, int dirs) {
+	if (count == 0) return;
+
+	mutex_lock(&inode_bitmap_lock);
+
+	int cleared = clear_bits_bulk(&inode_tree, 1, inos, count);
+	group_desc->bg_free_inodes_count += cleared;
+	superblock->s_free_inodes_count += cleared;
+	__atomic_fetch_sub(&group_desc->bg_used_dirs_count, dirs, __ATOMIC_RELAXED);
+
+	mutex_unlock(&inode_bitmap_lock);
+}
+
 // ---------------------  DIRECTORY OPERATIONS ---------------------
 
 /*
@@ -320,49 +625,37 @@ int dir_entry_rec_len(int name_len) {
 /*
  * Initializes a directory entry with the given inode number, name
  * (with length name_len), and type. The given rec_len will be the 
- * length of this entry.
+ * length of this entry. The inode number is stored last, so a lookup
+ * walking the block without its lock never matches a half-written 
+ * entry that takes over an unused one.
  * 
  */
 static void init_dir_entry(struct ext2_dir_entry* entry, 
 		int child_inode, const char* name, int name_len, 
 		uint8_t type, int rec_len) {
 	
-	entry->inode = child_inode;
 	entry->name_len = name_len;
 	entry->file_type = type;
 	memcpy(entry->name, name, name_len);
 	entry->rec_len = rec_len;
+	__atomic_store_n(&entry->inode, child_inode, __ATOMIC_RELEASE);
 }
 
 /*
- * Finds the last directory entry in the given block; traverses 
- * through all entries in the block following rec_len pointers 
- * until reaching the final entry (one whose rec_len extends to
- * block end).
- *
- * Returns: a pointer to the last directory entry in the block.
+ * Splits the entry entry, which has at least rec_len(name_len) bytes 
+ * of slack behind its own name, and places the new entry in the 
+ * slack. The new entry is complete before entry is shortened, so an
+ * unlocked walk of the block sees either the old or the new layout.
  */
-static struct ext2_dir_entry* find_last_dir_entry(char* block) {
-
-	struct ext2_dir_entry* entry = (struct ext2_dir_entry*) block;
-	struct ext2_dir_entry* last = NULL;
-	// traverse entries until we reach the last one
-	while ((char*)entry < block + EXT2_BLOCK_SIZE 
-			&& entry->rec_len > 0) {
-		
-		last = entry;
-		
-		// check if this entry's rec_len extends to block end
-
-		if ((char*)entry + entry->rec_len >= block + EXT2_BLOCK_SIZE) {
-			break;
-		}
+static void split_dir_entry(struct ext2_dir_entry *entry, int child_inode,
+		const char *name, int name_len, uint8_t type) {
 
-		entry = next_dir_entry(entry);
-	}
+	int actual_size = dir_entry_rec_len(entry->name_len);
+	int remain = entry->rec_len - actual_size;
 
-	// return the pointer to last directory
-	return last;
+	init_dir_entry((struct ext2_dir_entry *)((char *)entry + actual_size),
+			child_inode, name, name_len, type, remain);
+	__atomic_store_n(&entry->rec_len, actual_size, __ATOMIC_RELEASE);
 }
 
 /*
@@ -392,99 +685,108 @@ static int create_entry_in_new_block(struct ext2_inode* dir_inode,
 		return -1;
 	}
 
-	// update directory inode to reference new block
-	dir_inode->i_block[block_index] = new_block;
-	dir_inode->i_size += (block_index == 0) ? EXT2_BLOCK_SIZE : EXT2_BLOCK_SIZE;
-	dir_inode->i_blocks += EXT2_BLOCK_SIZE / 512;
-
 	// initialize the new block with zeros
-	char* block = get_block(new_block);
+	char* block = get_block_new(new_block);
 	memset(block, 0, EXT2_BLOCK_SIZE);
 
 	// create entry spanning the entire block
 	struct ext2_dir_entry* entry = (struct ext2_dir_entry*) block;
 	init_dir_entry(entry, child_inode, name, name_len, type, EXT2_BLOCK_SIZE);
+	put_block(new_block, 1);
 
-	// update directory count if adding a subdirectory
-	if (type == EXT2_FT_DIR) {
-		group_desc->bg_used_dirs_count++;
-	}
+	// update directory inode to reference new block; lookups and 
+	// inserts read i_block without the inode lock, so the block is 
+	// only linked in once it is complete
+	__atomic_store_n(&dir_inode->i_block[block_index], new_block, __ATOMIC_RELEASE);
+	dir_inode->i_size += (block_index == 0) ? EXT2_BLOCK_SIZE : EXT2_BLOCK_SIZE;
+	dir_inode->i_blocks += EXT2_BLOCK_SIZE / 512;
 
 	// return block number
 	return new_block;
 }
 
 /*
- * Adds a new directory entry (childe_inode; 1-based) with the given
- * name and type to a parent directory parent_inode (1-based).
- *
- * The function handles three cases:
- * 1. No blocks allocated: creates first block with the entry
- * 2. Space in last block: splits last entry and appends new one
- * 3. No space in last block: allocates new block for the entry
+ * Places a new entry into the first gap that removed entries left in
+ * blocks 0..last_block_index of dir_inode: either an unused entry at
+ * the start of a block or the slack behind a live entry. Used once a
+ * directory has no direct pointers left to grow into.
  *
- * Returns: 0 on success, errno on error.
+ * Returns: 0 on success, ENOSPC if no gap is large enough.
  */
-int add_dir_entry(int parent_inode, const char* name, int child_inode, uint8_t type) {
-	
-	struct ext2_inode* dir_inode = get_inode(parent_inode);
-
-	// verify parent is a directory
-	if (!S_ISDIR(dir_inode->i_mode)) {
-		return ENOENT;
-	}
+static int reuse_dir_space(struct ext2_inode *dir_inode, int last_block_index,
+		int child_inode, const char *name, int name_len, uint8_t type) {
 
-	int name_len = strlen(name);
 	int needed = dir_entry_rec_len(name_len);
 
-	mutex_lock(&inode_locks[parent_inode - 1]);
-
-	// re-verify: parent is still a valid directory after acquiring lock
-	// this handles race condition where parent was deleted concurrently
-	if (!S_ISDIR(dir_inode->i_mode)) {
-		mutex_unlock(&inode_locks[parent_inode - 1]);
-		return ENOENT;
-	}
-
-	// re-verify: check if name already exists after acquiring lock
-	// this handles race condition where another thread created same name
-	int existing = find_dir_entry(dir_inode, name);
-	if (existing >= 0) {
-		mutex_unlock(&inode_locks[parent_inode - 1]);
-		return EEXIST;
-	}
+	for (int i = 0; i <= last_block_index; i++) {
+		int block_num = dir_inode->i_block[i];
+		if (block_num == 0) continue;
 
-	// find last used block in directory
-	int last_block_index = -1;
-	for (int i = 0; i < DIRECT_POINTERS; i++) {
-		if (dir_inode->i_block[i] != 0) last_block_index = i;
-	}
+		mutex_lock(&block_locks[block_num - 1]);
+		char *block = get_block(block_num);
+		struct ext2_dir_entry *entry = dirblock_gap(block, needed);
 
-	// CASE 1: no blocks allocated yet, create first block
-	if (last_block_index == -1) {
-		int result = create_entry_in_new_block(dir_inode, 
-				0, child_inode, name, name_len, type);
-		
-		if (result < 0) {
-			int saved_errno = errno ? errno : ENOSPC;
-			mutex_unlock(&inode_locks[parent_inode - 1]);
-			return saved_errno;
+		if (entry == NULL) {
+			put_block(block_num, 0);
+			mutex_unlock(&block_locks[block_num - 1]);
+			continue;
 		}
 
-		// set size correctly for first block
-		dir_inode->i_size = EXT2_BLOCK_SIZE;
-		mutex_unlock(&inode_locks[parent_inode - 1]);
+		if (entry->inode == 0) {
+			// unused first entry of a block: take it over
+			init_dir_entry(entry, child_inode, name, name_len, 
+					type, entry->rec_len);
+		}
+		else {
+			// slack after a live entry: split it
+			split_dir_entry(entry, child_inode, name, name_len, type);
+		}
+		put_block(block_num, 1);
+		mutex_unlock(&block_locks[block_num - 1]);
 		return 0;
 	}
 
+	return ENOSPC;
+}
+
+/*
+ * Appends a new directory entry to the last block of dir_inode 
+ * (parent_inode; 1-based) if that block has room, locking only the 
+ * block. The directory's deletion time is checked under the block 
+ * lock: rm_r marks a directory deleted before it scans its blocks 
+ * under their locks, so an entry is either seen by that scan or not 
+ * added at all. The block must also still be the directory's, in case
+ * the inode was freed and reused meanwhile.
+ *
+ * Returns: 0 on success, EAGAIN if the directory has no blocks, the
+ * last one is full or it changed, ENOENT if the directory was 
+ * removed, ENOSPC if the block is corrupt.
+ */
+static int append_to_last_block(struct ext2_inode *dir_inode, int child_inode,
+		const char *name, int name_len, uint8_t type) {
+
+	// find last used block in directory; a block added meanwhile 
+	// only means this one is not the last any more
+	int block_num = 0, index = 0;
+	for (int i = 0; i < DIRECT_POINTERS; i++) {
+		int b = __atomic_load_n(&dir_inode->i_block[i], __ATOMIC_ACQUIRE);
+		if (b != 0) {
+			block_num = b;
+			index = i;
+		}
+	}
+	if (block_num == 0) return EAGAIN;
 
-	// CASE 2: block exists, try to append to the last block
-	int block_num = dir_inode->i_block[last_block_index];
+	mutex_lock(&block_locks[block_num - 1]);
 
-	mutex_lock(&block_locks[block_num]);
+	if (dir_inode->i_dtime != 0 || (int)dir_inode->i_block[index] != block_num) {
+		mutex_unlock(&block_locks[block_num - 1]);
+		return dir_inode->i_dtime != 0 ? ENOENT : EAGAIN;
+	}
 
 	char* block = get_block(block_num);
-	struct ext2_dir_entry* last = find_last_dir_entry(block);
+	struct ext2_dir_entry* last = dirblock_last(block);
+	int retval = EAGAIN;
 	
 	// try to split the last entry's rec_len to make room
 	if (last != NULL) {
@@ -493,40 +795,71 @@ int add_dir_entry(int parent_inode, const char* name, int child_inode, uint8_t t
 
 		// ensure last entry doesn't extend beyond block
 		if ((char*)last + last->rec_len > block + EXT2_BLOCK_SIZE) {
-			mutex_unlock(&block_locks[block_num]);
-			mutex_unlock(&inode_locks[parent_inode - 1]);
-			return ENOSPC;
+			retval = ENOSPC;
 		}
-
-		if (remain >= needed) {
-			
+		else if (remain >= dir_entry_rec_len(name_len)) {
 			// there is room: shrink last entry and 
 			// append new one
-			last->rec_len = actual_size;
-			struct ext2_dir_entry* new_entry = (struct ext2_dir_entry*)((char*)last + actual_size);
-			
-			init_dir_entry(new_entry, child_inode, name, name_len, type, remain);
-			
-			if (type == EXT2_FT_DIR) {
-				group_desc->bg_used_dirs_count++;
-			}
-			
-			mutex_unlock(&block_locks[block_num]);
-			mutex_unlock(&inode_locks[parent_inode - 1]);
-			
-			return 0;
+			split_dir_entry(last, child_inode, name, name_len, type);
+			retval = 0;
 		}
 	}
 
-	// CASE 3: no space in last block, allocate new block
+	put_block(block_num, retval == 0);
+	mutex_unlock(&block_locks[block_num - 1]);
+	return retval;
+}
+
+/*
+ * Inserts a new directory entry (child_inode; 1-based) with the given
+ * name and type into the directory parent_inode (1-based). The caller
+ * must hold inode_locks[parent_inode - 1]; duplicate names are not
+ * checked here.
+ *
+ * The function handles four cases:
+ * 1. Space in last block: splits last entry and appends new one
+ * 2. No blocks allocated: creates first block with the entry
+ * 3. No space in last block: allocates new block for the entry
+ * 4. No direct pointers left: reuses space freed by removed entries
+ *
+ * Returns: 0 on success, errno on error.
+ */
+int insert_dir_entry_locked(int parent_inode, const char* name, int child_inode, uint8_t type) {
 
-	mutex_unlock(&block_locks[block_num]);
+	struct ext2_inode* dir_inode = get_inode(parent_inode);
 
-	if (last_block_index + 1 >= DIRECT_POINTERS) {
+	int name_len = strlen(name);
+
+	// CASE 1: append to the last block
+	int retval = append_to_last_block(dir_inode, child_inode, name, name_len, type);
+	if (retval != EAGAIN) return retval;
+
+	// find last used block in directory
+	int last_block_index = -1;
+	for (int i = 0; i < DIRECT_POINTERS; i++) {
+		if (dir_inode->i_block[i] != 0) last_block_index = i;
+	}
+
+	// CASE 2: no blocks allocated yet, create first block
+	if (last_block_index == -1) {
+		int result = create_entry_in_new_block(dir_inode, 
+				0, child_inode, name, name_len, type);
 		
-		// out of direct block pointers
-		mutex_unlock(&inode_locks[parent_inode - 1]);
-		return ENOSPC;
+		if (result < 0) {
+			return errno ? errno : ENOSPC;
+		}
+
+		// set size correctly for first block
+		dir_inode->i_size = EXT2_BLOCK_SIZE;
+		return 0;
+	}
+
+	// CASE 3: no space in last block, allocate new block
+	if (last_block_index + 1 >= DIRECT_POINTERS) {
+		// out of direct block pointers: fall back to the space 
+		// removed entries left behind in earlier blocks
+		return reuse_dir_space(dir_inode, last_block_index, child_inode, 
+				name, name_len, type);
 	}
 
 	int result = create_entry_in_new_block(dir_inode, 
@@ -534,202 +867,495 @@ int add_dir_entry(int parent_inode, const char* name, int child_inode, uint8_t t
 			name_len, type);
 	
 	if (result < 0) {
-		int saved_err = errno ? errno : ENOSPC;
-		mutex_unlock(&inode_locks[parent_inode - 1]);
-		return saved_err;
+		return errno ? errno : ENOSPC;
 	}
 	
-	mutex_unlock(&inode_locks[parent_inode - 1]);
 	return 0;
 }
 
 /*
- * Finds a directory entry by name within a directory dir.
- * Searches through all blocks in the directory's i_block array.
+ * Adds a new directory entry (childe_inode; 1-based) with the given
+ * name and type to a parent directory parent_inode (1-based), rejects
+ * duplicate names and counts new subdirectories in the group 
+ * descriptor.
  *
- * Returns: inode number of the entry on success, -1 if not 
- * found.
+ * Uniqueness is guarded by the name's hashed lock rather than by the
+ * directory, so inserts of different names into one directory run in
+ * parallel: an entry that fits into the last block is added under 
+ * that block's lock alone. Only when the directory needs a new block
+ * (or is full) is the parent's inode lock taken.
+ *
+ * Returns: 0 on success, errno on error.
  */
-int find_dir_entry(struct ext2_inode *dir, const char *name) {
+static int do_add_dir_entry(int parent_inode, const char* name, int child_inode, uint8_t type);
 
-	size_t target_len = strlen(name);
-	int block;
+int add_dir_entry(int parent_inode, const char* name, int child_inode, uint8_t type) {
+	uint64_t start = stats_now();
+	PHASE_BEGIN2(add_dir_entry, parent_inode, name);
+	int retval = do_add_dir_entry(parent_inode, name, child_inode, type);
+	PHASE_END(add_dir_entry, TL_ADD_DIR_ENTRY, retval);
+	stats_phase_done(EXT2_FSAL_PHASE_DIRENT_INSERT, start);
+	return retval;
+}
 
-	// search through all block pointers
-	for (int i = 0; i < TOTAL_POINTERS; i++) {
+static int do_add_dir_entry(int parent_inode, const char* name, int child_inode, uint8_t type) {
+	
+	struct ext2_inode* dir_inode = get_inode(parent_inode);
 
-		block = dir->i_block[i];
-		if (block == 0)
-			continue;  // empty block pointer
+	// verify parent is a directory
+	if (!S_ISDIR(dir_inode->i_mode) || dir_inode->i_dtime != 0) {
+		return ENOENT;
+	}
+
+	int name_len = strlen(name);
+	pthread_mutex_t *nlock = name_lock(parent_inode, name, name_len);
+	mutex_lock(nlock);
 
-		// directory block start
-		uint8_t *block_ptr = (uint8_t *)get_block(block);
-		struct ext2_dir_entry *entry = (struct ext2_dir_entry *) block_ptr;
-		uint8_t *end = block_ptr + EXT2_BLOCK_SIZE;
+	// re-verify: check if name already exists after acquiring lock
+	// this handles race condition where another thread created same name
+	int existing = find_dir_entry_len(dir_inode, name, name_len);
+	if (existing >= 0) {
+		mutex_unlock(nlock);
+		return EEXIST;
+	}
 
-		// iterate through entries in this block
-		while ((uint8_t *)entry < end && entry->rec_len > 0) {
+	int retval = append_to_last_block(dir_inode, child_inode, name, name_len, type);
 
-			if (entry->inode != 0 &&
-			    entry->name_len == target_len &&
-			    strncmp(entry->name, name, entry->name_len) == 0) {
+	// the directory must grow: take it over
+	if (retval == EAGAIN) {
+		mutex_lock(&inode_locks[parent_inode - 1]);
 
-				return entry->inode;
-			}
+		// re-verify: parent is still a valid directory after 
+		// acquiring lock; it may have been deleted concurrently
+		if (!S_ISDIR(dir_inode->i_mode) || dir_inode->i_dtime != 0) retval = ENOENT;
+		else retval = insert_dir_entry_locked(parent_inode, name, child_inode, type);
 
-			entry = next_dir_entry(entry);
-		}
+		mutex_unlock(&inode_locks[parent_inode - 1]);
 	}
 
-	errno = ENOENT;
-	return -1;  // not found
-}
+	// update directory count if adding a subdirectory
+	if (retval == 0 && type == EXT2_FT_DIR) {
+		__atomic_fetch_add(&group_desc->bg_used_dirs_count, 1, __ATOMIC_RELAXED);
+	}
 
-// ----------------------- PATH OPERATIONS -------------------------
+	mutex_unlock(nlock);
+	return retval;
+}
 
 /*
- * Resolves an absolute path (must start with "/") to an inode 
- * number. Handles "." (current directory) and ".." (parent directory)
- * components.
+ * Locates the entry called name in directory dir. On success the
+ * owning block number is stored in block_out and the preceding entry
+ * in the same block (NULL if it is the first one) in prev_out.
+ * The caller must hold the directory's inode lock, and releases the
+ * owning block with put_block when done with the entry.
  *
- * Returns: inode number on success, -1 and sets errno on error.
+ * Returns: a pointer to the entry, or NULL if not found.
  */
-int path_lookup(const char *path) {
-	if (path == NULL) {
-		errno = ENOENT;
-		return -1;
-	}
+static struct ext2_dir_entry *find_dir_entry_slot(struct ext2_inode *dir,
+		const char *name, int *block_out, struct ext2_dir_entry **prev_out) {
 
-	// ensure path is absolute (must start with '/')
-	if (path[0] != '/') {
-		errno = ENOENT;
-		return -1;
+	int name_len = strlen(name);
+
+	for (int i = 0; i < DIRECT_POINTERS; i++) {
+		int block_num = dir->i_block[i];
+		if (block_num == 0) continue;
+
+		char *block = get_block(block_num);
+		struct ext2_dir_entry *entry = dirblock_lookup(block, name, name_len, prev_out);
+		if (entry != NULL) {
+			*block_out = block_num;
+			return entry;
+		}
+		put_block(block_num, 0);
 	}
 
-	// create a writable copy of the path for tokenization
-	char buf[PATH_MAX];
-	strncpy(buf, path, PATH_MAX);
-	buf[PATH_MAX - 1] = '\0';
+	return NULL;
+}
+
+/*
+ * Removes the entry called name from directory dir_ino (1-based) by
+ * merging its space into the previous entry, or by zeroing its inode
+ * when it is the first entry of a block. The caller must hold
+ * inode_locks[dir_ino - 1].
+ *
+ * Returns: the inode number the entry referred to, or -1 if not 
+ * found.
+ */
+int remove_dir_entry_locked(int dir_ino, const char *name) {
+
+	struct ext2_inode *dir = get_inode(dir_ino);
+	struct ext2_dir_entry *prev;
+	int block_num;
+
+	struct ext2_dir_entry *entry = find_dir_entry_slot(dir, name, &block_num, &prev);
+	if (entry == NULL) return -1;
 
-	// root directory handling
-	if (strcmp(buf, "/") == 0) {
-		return EXT2_ROOT_INO;
+	mutex_lock(&block_locks[block_num - 1]);
+
+	int removed = entry->inode;
+	if (prev) {
+		// merge space into previous entry
+		prev->rec_len += entry->rec_len;
+	}
+	else {
+		// first entry in block: zero inode, keep rec_len
+		entry->inode = 0;
 	}
 
-	int curr_ino = EXT2_ROOT_INO;
-	struct ext2_inode *curr_inode = get_inode(curr_ino);
+	put_block(block_num, 1);
+	mutex_unlock(&block_locks[block_num - 1]);
+	return removed;
+}
 
-	// tokenize path and traverse; skip leading '/'
-        char *saveptr;
-        char *token = strtok_r(buf, "/", &saveptr);
+/*
+ * Repoints the existing entry called name in directory dir_ino 
+ * (1-based) at new_ino with file type type, leaving its position and 
+ * rec_len untouched. The caller must hold inode_locks[dir_ino - 1].
+ *
+ * Returns: the inode number previously referenced, or -1 if not found.
+ */
+int replace_dir_entry_locked(int dir_ino, const char *name, int new_ino, uint8_t type) {
 
-	while (token != NULL) {
+	struct ext2_inode *dir = get_inode(dir_ino);
+	struct ext2_dir_entry *prev;
+	int block_num;
 
-		// handle "." -- stay in same directory
-		if (strcmp(token, ".") == 0) {
-			token = strtok_r(NULL, "/", &saveptr);
-			continue;
-		}
+	struct ext2_dir_entry *entry = find_dir_entry_slot(dir, name, &block_num, &prev);
+	if (entry == NULL) return -1;
 
-		// handle parent directory ".." -- go to parent
-		if (strcmp(token, "..") == 0) {
-			// wont be in middle of path.. 
-			// root's parent is root
-			curr_ino = EXT2_ROOT_INO;
-			curr_inode = get_inode(curr_ino);
-			token = strtok_r(NULL, "/", &saveptr);
-			continue;
-		}
+	mutex_lock(&block_locks[block_num - 1]);
 
-		// current inode must be a directory to continue
-		if (!S_ISDIR(curr_inode->i_mode)) {
-			errno = ENOENT;
-			return -1;
-		}
+	int old_ino = entry->inode;
+	entry->inode = new_ino;
+	entry->file_type = type;
 
-		// find the child entry
-		int child_ino = find_dir_entry(curr_inode, token);
-		if (child_ino == -1) {
-			errno = ENOENT;
-			return -1;
-		}
+	put_block(block_num, 1);
+	mutex_unlock(&block_locks[block_num - 1]);
+	return old_ino;
+}
 
-		curr_ino = child_ino;
-		curr_inode = get_inode(curr_ino);
+// generation given to the next directory created; directory handles
+// carry it to notice that their inode was freed and reused
+static uint32_t dir_generation;
+
+/*
+ * Seeds the directory generation counter, so that handles from an 
+ * earlier run of the server do not match directories created in this
+ * one. Called from ext2_fsal_init.
+ */
+void dir_generation_init(void) {
+	dir_generation = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+}
 
-		token = strtok_r(NULL, "/", &saveptr);
+/*
+ * Creates a new, empty directory called name inside parent_ino:
+ * - Allocates a new inode and block for the directory.
+ * - Initializes the directory with "." and ".." entries.
+ * - Adds an entry in the parent directory.
+ * - Updates parent's link count.
+ *
+ * new_ino_out: if not NULL, receives the new directory's inode number
+ *
+ * Returns: 0 on success, errno on error.
+ */
+int create_directory(int parent_ino, const char *name, int *new_ino_out) {
+
+	// allocate inode for the new directory
+	int new_ino = alloc_inode();
+	if (new_ino < 0) return ENOSPC;
+
+	// allocate data block for the directory contents
+	int new_block = alloc_block();
+	if (new_block < 0) {
+		free_inode(new_ino);
+		return ENOSPC;
+	}
+
+	// initialize new directory inode
+	struct ext2_inode new_inode;
+	memset(&new_inode, 0, sizeof(new_inode));
+
+	new_inode.i_mode = EXT2_S_IFDIR | 0755; // drwxr-xr-x
+	new_inode.i_size = EXT2_BLOCK_SIZE;
+	new_inode.i_links_count = 2;  // "." + ".."
+	new_inode.i_blocks = EXT2_BLOCK_SIZE / 512;
+	new_inode.i_ctime = (uint32_t)time(NULL);
+	new_inode.i_generation = __atomic_add_fetch(&dir_generation, 1, __ATOMIC_RELAXED);
+	new_inode.i_block[0] = new_block;
+
+	// write inode to disk
+	write_inode(new_ino, &new_inode);
+
+	// construct directory block with "." and ".." entries
+	uint8_t block_buf[EXT2_MAX_BLOCK_SIZE];
+	memset(block_buf, 0, EXT2_BLOCK_SIZE);
+
+	// create "." entry
+	struct ext2_dir_entry *dot = (struct ext2_dir_entry *) block_buf;
+	init_dir_entry(dot, new_ino, ".", 1, EXT2_FT_DIR, dir_entry_rec_len(1));
+
+	// create ".." entry; the rest of the block is assigned to it
+	struct ext2_dir_entry *dotdot = next_dir_entry(dot);
+	init_dir_entry(dotdot, parent_ino, "..", 2, EXT2_FT_DIR, 
+			EXT2_BLOCK_SIZE - dot->rec_len);
+
+	// write directory block to disk
+	write_block(new_block, (char *)block_buf);
+
+	// add entry for new directory in parent
+	int add_retval = add_dir_entry(parent_ino, name, new_ino, EXT2_FT_DIR);
+	if (add_retval != 0) {
+		free_block(new_block);
+		free_inode(new_ino);
+		return add_retval;
 	}
 
-	// return child entry inode number
-	return curr_ino;
+	// increment parent's link count ( ".." links to parent)
+	mutex_lock(&inode_locks[parent_ino - 1]);
+	struct ext2_inode *p = get_inode(parent_ino);
+	p->i_links_count += 1;
+	mutex_unlock(&inode_locks[parent_ino - 1]);
+
+	if (new_ino_out) *new_ino_out = new_ino;
+	return 0;
 }
 
 /*
- * Strips trailing slashes from a path.
- * Preserves the leading '/' for the root directory.
+ * Finds a directory entry by name within a directory dir.
+ * Searches through all blocks in the directory's i_block array.
+ *
+ * Returns: inode number of the entry on success, -1 if not 
+ * found.
  */
-void strip_trailing_slashes(char *path) {
-	size_t len = strlen(path);
-	while (len > 1 && path[len - 1] == '/') {
-		path[len - 1] = '\0';
-		len--;
+int find_dir_entry(struct ext2_inode *dir, const char *name) {
+	return find_dir_entry_len(dir, name, strlen(name));
+}
+
+/*
+ * Same as find_dir_entry, for a name of target_len bytes that need not
+ * be terminated, such as a component in the middle of a path.
+ */
+static int do_find_dir_entry(struct ext2_inode *dir, const char *name, int target_len);
+
+int find_dir_entry_len(struct ext2_inode *dir, const char *name, int target_len) {
+	PHASE_BEGIN2(find_dir_entry, dir, name);
+	int ino = do_find_dir_entry(dir, name, target_len);
+	PHASE_END(find_dir_entry, TL_FIND_DIR_ENTRY, ino);
+	return ino;
+}
+
+static int do_find_dir_entry(struct ext2_inode *dir, const char *name, int target_len) {
+
+	int block;
+
+	// search through all block pointers
+	for (int i = 0; i < TOTAL_POINTERS; i++) {
+
+		block = dir->i_block[i];
+		if (block == 0)
+			continue;  // empty block pointer
+
+		struct ext2_dir_entry *entry = dirblock_lookup(get_block(block), name, target_len, NULL);
+		if (entry != NULL) {
+			int ino = entry->inode;
+			put_block(block, 0);
+			return ino;
+		}
+		put_block(block, 0);
 	}
+
+	errno = ENOENT;
+	return -1;  // not found
 }
 
+// ----------------------- PATH OPERATIONS -------------------------
+
 /*
- * Splits an absolute path into parent directory path and final 
- * component name (ex: "/foo/bar/baz" -> parent="/foo/bar", 
- * name="baz").
+ * Walks path from the directory start_ino in a single pass, looking 
+ * every component up in place (no copy of the path is made). "." and
+ * ".." are looked up like any other name, through the directory's own
+ * entries. If create is set, missing components are created as 
+ * directories on the way (see make_dirs). Stores in res:
  *
- * parent_buf: buffer for parent path (must be PATH_MAX bytes)
- * name_buf: buffer for final name (must be EXT2_NAME_LEN bytes)
- * 
- * Returns: 0 on success, errno on error.
+ * - parent_ino: the directory holding the last component (start_ino 
+ *   if there is none)
+ * - ino: the inode the last component names, -1 if there is no such 
+ *   entry
+ * - name: the last component, empty if the path has none
+ * - trailing_slash: whether the path ends in '/' (other than "/")
+ *
+ * Returns: 0 on success, ENOENT if a directory on the way is missing 
+ * or not a directory (EEXIST for the latter if create is set), 
+ * ENAMETOOLONG if a component does not fit in a directory entry, or an
+ * error from create_directory.
  */
-int split_parent_name(const char *path, char *parent_buf, char *name_buf) {
-	if (path == NULL) return ENOENT;
-	if (path[0] != '/') return ENOENT;   // want absolute path
+static int walk_path(int start_ino, const char *path, int create, struct path_res *res) {
+	res->parent_ino = start_ino;
+	res->ino = start_ino;
+	res->trailing_slash = 0;
+
+	const char *leaf = path;
+	int leaf_len = 0;
+	const char *p = path;
+
+	while (*p != '\0') {
+
+		// skip separators to the start of the next component
+		while (*p == '/') p++;
+		if (*p == '\0') break;
+
+		const char *end = p;
+		while (*end != '\0' && *end != '/') end++;
+		int len = end - p;
+		if (len >= EXT2_NAME_LEN) return ENAMETOOLONG;
+
+		// everything before the last component must be a directory
+		if (res->ino < 0) return ENOENT;
+		struct ext2_inode *dir = get_inode(res->ino);
+		if (!S_ISDIR(dir->i_mode)) return create ? EEXIST : ENOENT;
+
+		res->parent_ino = res->ino;
+		res->ino = find_dir_entry_len(dir, p, len);
+
+		// create a missing component, tolerating a racing creator
+		if (res->ino < 0 && create) {
+			char name[EXT2_NAME_LEN];
+			memcpy(name, p, len);
+			name[len] = '\0';
+
+			int retval = create_directory(res->parent_ino, name, &res->ino);
+			if (retval == EEXIST) res->ino = find_dir_entry_len(dir, p, len);
+			else if (retval != 0) return retval;
+			if (res->ino < 0) return ENOENT;
+		}
+		leaf = p;
+		leaf_len = len;
+		p = end;
+	}
 
-	// copy and normalize the path
-	char tmp[PATH_MAX];
-	strncpy(tmp, path, PATH_MAX);
-	tmp[PATH_MAX - 1] = '\0';
-	strip_trailing_slashes(tmp);
+	memcpy(res->name, leaf, leaf_len);
+	res->name[leaf_len] = '\0';
+	res->trailing_slash = p - path > 1 && p[-1] == '/';
+	return 0;
+}
 
-	// special case: cannot create root ("/")
-	if (strcmp(tmp, "/") == 0) return ENOENT;
+/*
+ * Resolves the absolute path path from the root (see walk_path).
+ *
+ * Returns: 0 on success, ENOENT if the path is not absolute or a 
+ * directory on the way is missing or not a directory, ENAMETOOLONG if 
+ * a component does not fit in a directory entry.
+ */
+int resolve_path(const char *path, struct path_res *res) {
+	return resolve_at(NULL, path, res);
+}
 
-	// find the last '/' separator
-	char *last = strrchr(tmp, '/');
-	if (last == NULL) return ENOENT;
+/*
+ * Checks that the directory handle dir still names the directory it 
+ * was opened on: the inode must be a live directory carrying the 
+ * generation recorded in the handle. A removed directory has a 
+ * deletion time; once its inode is reused, the generation (or the 
+ * type) no longer matches.
+ *
+ * Returns: 0 if the handle is valid, ESTALE otherwise.
+ */
+int check_dir_handle(const struct ext2_fsal_dir *dir) {
+	if (dir->ino < 1 || dir->ino > (uint32_t)num_inodes) return ESTALE;
 
-	// extract parent path
-	if (last == tmp) {
-		// parent is "/" if last points to first char 
-		strncpy(parent_buf, "/", PATH_MAX);
-		parent_buf[PATH_MAX - 1] = '\0';
+	struct ext2_inode *inode = get_inode(dir->ino);
+	if (!S_ISDIR(inode->i_mode) || inode->i_links_count == 0 || 
+	    inode->i_dtime != 0 || inode->i_generation != dir->generation) {
+		return ESTALE;
 	}
-	else {
-		size_t parent_len = last - tmp;
-		
-		if (parent_len >= PATH_MAX) return ENAMETOOLONG;
-		
-		strncpy(parent_buf, tmp, parent_len);
-		parent_buf[parent_len] = '\0';
+	return 0;
+}
+
+/*
+ * Resolves path like resolve_path, except that a relative path starts
+ * at the directory handle dir instead of being rejected. An absolute
+ * path ignores dir, as with openat(2); dir may be NULL, in which case 
+ * the path must be absolute.
+ *
+ * Returns: 0 on success, ESTALE if dir no longer names a directory,
+ * or an error from walk_path.
+ */
+static int do_resolve_at(const struct ext2_fsal_dir *dir, const char *path, 
+		struct path_res *res);
+
+int resolve_at(const struct ext2_fsal_dir *dir, const char *path, struct path_res *res) {
+	uint64_t start = stats_now();
+	PHASE_BEGIN1(path_lookup, path);
+	int retval = do_resolve_at(dir, path, res);
+	PHASE_END(path_lookup, TL_PATH_LOOKUP, retval ? -1 : res->ino);
+	stats_phase_done(EXT2_FSAL_PHASE_PATH_LOOKUP, start);
+	return retval;
+}
+
+static int do_resolve_at(const struct ext2_fsal_dir *dir, const char *path, 
+		struct path_res *res) {
+	if (path == NULL) return ENOENT;
+	if (path[0] == '/') return walk_path(EXT2_ROOT_INO, path, 0, res);
+	if (dir == NULL) return ENOENT;
+
+	int retval = check_dir_handle(dir);
+	if (retval != 0) return retval;
+	return walk_path(dir->ino, path, 0, res);
+}
+
+/*
+ * Resolves an absolute path (must start with "/") to an inode 
+ * number (see resolve_path).
+ *
+ * Returns: inode number on success, -1 and sets errno on error.
+ */
+int path_lookup(const char *path) {
+	struct path_res res;
+	int retval = resolve_path(path, &res);
+	if (retval == 0 && res.ino < 0) retval = ENOENT;
+	if (retval != 0) {
+		errno = retval;
+		return -1;
 	}
+	return res.ino;
+}
 
-	// extract final name 
-	char *name = last + 1;
-	
-	if (strlen(name) == 0) return ENOENT;
-	if (strlen(name) >= EXT2_NAME_LEN) return ENAMETOOLONG;
-	
-	strncpy(name_buf, name, EXT2_NAME_LEN);
-	name_buf[EXT2_NAME_LEN - 1] = '\0';
+/*
+ * Creates a directory and any missing intermediate directories, like
+ * "mkdir -p". The path is walked once from the root by walk_path, so 
+ * "." and ".." mean what they mean in any other path; components that
+ * already exist as directories (including ones created concurrently)
+ * are reused.
+ *
+ * path: absolute path of the directory that is to be created.
+ * ino: receives the directory's inode number, if not NULL
+ *
+ * Returns: 0 on success (also when the directory already exists), 
+ * EEXIST if a component is not a directory, errno on other errors.
+ */
+int make_dirs(const char *path, int *ino) {
+	if (path == NULL || path[0] != '/') return ENOENT;
+
+	struct path_res res;
+	int retval = walk_path(EXT2_ROOT_INO, path, 1, &res);
+	if (retval != 0) return retval;
+	if (!S_ISDIR(get_inode(res.ino)->i_mode)) return EEXIST;
 
+	if (ino != NULL) *ino = res.ino;
 	return 0;
 }
 
+/*
+ * Strips trailing slashes from a path.
+ * Preserves the leading '/' for the root directory.
+ */
+void strip_trailing_slashes(char *path) {
+	size_t len = strlen(path);
+	while (len > 1 && path[len - 1] == '/') {
+		path[len - 1] = '\0';
+		len--;
+	}
+}
+
 /*
  * Extracts basename from a path (last component after final '/').
  */
@@ -770,6 +1396,7 @@ void free_inode_blocks_locked(int ino) {
 			}
 		}
 
+		put_block(indirect_blk, 0);
 		free_block(indirect_blk);
 		inode->i_block[INDIRECT_INDEX] = 0;
 	}
@@ -779,6 +1406,269 @@ void free_inode_blocks_locked(int ino) {
 	mutex_unlock(&inode_locks[ino - 1]);
 }
 
+/*
+ * Drops one link from inode ino (1-based). When the last link goes
+ * away, sets the deletion time and frees the inode's data blocks; the
+ * inode itself is retired (reclaim.c) and freed once no lookup can
+ * still reach it.
+ */
+void release_inode_link(int ino) {
+	mutex_lock(&inode_locks[ino - 1]);
+	struct ext2_inode *inode = get_inode(ino);
+
+	inode->i_links_count--;
+
+	// other hard links still exist
+	if (inode->i_links_count != 0) {
+		mutex_unlock(&inode_locks[ino - 1]);
+		return;
+	}
+
+	// set deletion time
+	inode->i_dtime = (unsigned int)time(NULL);
+	mutex_unlock(&inode_locks[ino - 1]);
+
+	PHASE_BEGIN1(rm_free, ino);
+	free_inode_blocks_locked(ino);
+
+	// lookups that found the old entry may still read the inode
+	reclaim_inodes(&ino, 1, 0);
+	PHASE_END0(rm_free, TL_RM_FREE);
+}
+
+/*
+ * Removes the entry called name, which must not be a directory, from
+ * directory parent_ino (1-based) and drops the link it held. Both are
+ * re-checked under the parent's lock, since they were looked up
+ * without it.
+ *
+ * Returns: 0 on success, ENOENT if the parent or the entry is gone, 
+ * EISDIR if the entry is a directory.
+ */
+int unlink_entry(int parent_ino, const char *name) {
+	struct ext2_inode *parent_inode = get_inode(parent_ino);
+
+	// lock parent for directory modification
+	mutex_lock(&inode_locks[parent_ino - 1]);
+
+	// re-verify parent is still a live directory after acquiring lock
+	if (!S_ISDIR(parent_inode->i_mode) || parent_inode->i_dtime != 0) {
+		mutex_unlock(&inode_locks[parent_ino - 1]);
+		return ENOENT;
+	}
+
+	// re-verify: the entry may have been replaced while unlocked
+	int found_target_ino = find_dir_entry(parent_inode, name);
+	if (found_target_ino < 0) {
+		mutex_unlock(&inode_locks[parent_ino - 1]);
+		return ENOENT;
+	}
+
+	// cannot remove directories with rm
+	if (S_ISDIR(get_inode(found_target_ino)->i_mode)) {
+		mutex_unlock(&inode_locks[parent_ino - 1]);
+		return EISDIR;
+	}
+
+	// remove directory entry by name
+	remove_dir_entry_locked(parent_ino, name);
+
+	mutex_unlock(&inode_locks[parent_ino - 1]);
+
+	// decrement link count of the inode we actually unlinked; 
+	// frees the file if no more links remain
+	release_inode_link(found_target_ino);
+
+	return 0;
+}
+
+/*
+ * Detaches every data block of inode (direct, single indirect and the
+ * indirect block itself) without freeing them: the block numbers are 
+ * stored in out, which must hold MAX_INODE_BLOCKS entries, and the 
+ * inode's block map, size and block count are cleared. The caller 
+ * must hold the inode's lock.
+ *
+ * Returns: the number of block numbers written to out.
+ */
+int collect_inode_blocks(struct ext2_inode *inode, int *out) {
+	int n = 0;
+
+	for (int i = 0; i < DIRECT_POINTERS; i++) {
+		if (inode->i_block[i] != 0) {
+			out[n++] = inode->i_block[i];
+			inode->i_block[i] = 0;
+		}
+	}
+
+	if (inode->i_block[INDIRECT_INDEX] != 0) {
+		int indirect_blk = inode->i_block[INDIRECT_INDEX];
+		uint32_t *ptrs = (uint32_t *) get_block(indirect_blk);
+		int per_block = EXT2_BLOCK_SIZE / sizeof(uint32_t);
+
+		for (int i = 0; i < per_block; i++) {
+			if (ptrs[i] != 0) out[n++] = ptrs[i];
+		}
+		put_block(indirect_blk, 0);
+
+		out[n++] = indirect_blk;
+		inode->i_block[INDIRECT_INDEX] = 0;
+	}
+
+	inode->i_blocks = 0;
+	inode->i_size = 0;
+	return n;
+}
+
+/*
+ * Returns: the number of data blocks a file of filesize bytes 
+ * occupies, capped at what one inode can map.
+ */
+int data_blocks_for_size(off_t filesize) {
+	int per_block = EXT2_BLOCK_SIZE / sizeof(uint32_t);
+	off_t data = (filesize + EXT2_BLOCK_SIZE - 1) >> block_shift;
+
+	if (data > DIRECT_POINTERS + per_block) data = DIRECT_POINTERS + per_block;
+	return (int)data;
+}
+
+/*
+ * Returns: the number of blocks (data plus single indirect) a file 
+ * of filesize bytes occupies, capped at what one inode can map.
+ */
+int blocks_for_size(off_t filesize) {
+	int data = data_blocks_for_size(filesize);
+	return data + (data > DIRECT_POINTERS ? 1 : 0);
+}
+
+/*
+ * Returns: the block holding data block k of inode, or 0 if k is a 
+ * hole or past what an inode can map. The caller must hold the 
+ * inode's lock.
+ */
+int inode_bmap(struct ext2_inode *inode, int k) {
+	if (k < DIRECT_POINTERS) return inode->i_block[k];
+
+	int per_block = EXT2_BLOCK_SIZE / sizeof(uint32_t);
+	int indirect_blk = inode->i_block[INDIRECT_INDEX];
+	if (indirect_blk == 0 || k >= DIRECT_POINTERS + per_block) return 0;
+
+	uint32_t *ptrs = (uint32_t *) get_block(indirect_blk);
+	int b = ptrs[k - DIRECT_POINTERS];
+	put_block(indirect_blk, 0);
+	return b;
+}
+
+/*
+ * Maps data blocks first to first + n - 1 of inode, which an inode 
+ * must be able to map, allocating the holes among them (and the 
+ * indirect block, if they need it) in one batch. If fresh is not NULL,
+ * fresh[i] is set to 1 if block first + i was allocated here and to 0
+ * if it was mapped already; the contents of new data blocks are left
+ * to the caller. Keeps i_blocks up to date but not i_size. The caller
+ * must hold the inode's lock.
+ *
+ * Returns: 0 on success, ENOSPC (with nothing changed) if there are 
+ * not enough free blocks.
+ */
+int map_inode_blocks(struct ext2_inode *inode, int first, int n, char *fresh) {
+	int indirect_blk = inode->i_block[INDIRECT_INDEX];
+	int need_indirect = (first + n > DIRECT_POINTERS && indirect_blk == 0);
+	uint32_t *ptrs = indirect_blk ? (uint32_t *) get_block(indirect_blk) : NULL;
+
+	// count the holes
+	int missing = 0;
+	for (int k = first; k < first + n; k++) {
+		uint32_t b = k < DIRECT_POINTERS ? inode->i_block[k] : 
+				ptrs ? ptrs[k - DIRECT_POINTERS] : 0;
+		if (b == 0) missing++;
+	}
+	if (missing == 0) {
+		if (ptrs) put_block(indirect_blk, 0);
+		if (fresh) memset(fresh, 0, n);
+		return 0;
+	}
+
+	int new_blocks[MAX_INODE_BLOCKS];
+	if (alloc_blocks_batch(missing + need_indirect, new_blocks) != 0) {
+		if (ptrs) put_block(indirect_blk, 0);
+		return ENOSPC;
+	}
+
+	// the indirect block comes first, as when a file is written whole
+	int next = 0;
+	if (need_indirect) {
+		indirect_blk = new_blocks[next++];
+		ptrs = (uint32_t *) get_block_new(indirect_blk);
+		memset(ptrs, 0, EXT2_BLOCK_SIZE);
+		inode->i_block[INDIRECT_INDEX] = indirect_blk;
+	}
+
+	for (int k = first; k < first + n; k++) {
+		uint32_t *slot = k < DIRECT_POINTERS ? &inode->i_block[k] : &ptrs[k - DIRECT_POINTERS];
+		if (fresh) fresh[k - first] = (*slot == 0);
+		if (*slot == 0) *slot = new_blocks[next++];
+	}
+	if (ptrs) put_block(indirect_blk, 1);
+
+	inode->i_blocks += (missing + need_indirect) * (EXT2_BLOCK_SIZE / 512);
+	return 0;
+}
+
+/*
+ * Frees the data blocks of inode from data block n on, and the 
+ * indirect block once it maps nothing. Keeps i_blocks up to date but
+ * not i_size. The caller must hold the inode's lock.
+ */
+void trim_inode_blocks(struct ext2_inode *inode, int n) {
+	int per_block = EXT2_BLOCK_SIZE / sizeof(uint32_t);
+	int freed[MAX_INODE_BLOCKS];
+	int count = 0;
+
+	for (int k = n; k < DIRECT_POINTERS; k++) {
+		if (inode->i_block[k] != 0) {
+			freed[count++] = inode->i_block[k];
+			inode->i_block[k] = 0;
+		}
+	}
+
+	int indirect_blk = inode->i_block[INDIRECT_INDEX];
+	if (indirect_blk != 0) {
+		int from = n > DIRECT_POINTERS ? n - DIRECT_POINTERS : 0;
+		uint32_t *ptrs = (uint32_t *) get_block(indirect_blk);
+		int changed = 0;
+
+		for (int i = from; i < per_block; i++) {
+			if (ptrs[i] != 0) {
+				freed[count++] = ptrs[i];
+				ptrs[i] = 0;
+				changed = 1;
+			}
+		}
+		put_block(indirect_blk, changed && from > 0);
+
+		if (from == 0) {
+			freed[count++] = indirect_blk;
+			inode->i_block[INDIRECT_INDEX] = 0;
+		}
+	}
+
+	inode->i_blocks -= count * (EXT2_BLOCK_SIZE / 512);
+	free_blocks_bulk(freed, count);
+}
+
+/*
+ * Takes the next block from a pre-reserved batch, or allocates one 
+ * from the bitmap when res is NULL.
+ *
+ * Returns: block number, or -1 if none is available.
+ */
+static int take_block(struct block_reserve *res) {
+	if (res == NULL) return alloc_block();
+	if (res->next >= res->count) return -1;
+	return res->blocks[res->next++];
+}
+
 /*
  * Writes file data from an open host file descriptor into an inode.
  * Allocates blocks as needed for direct and single indirect blocks.
@@ -790,80 +1680,250 @@ void free_inode_blocks_locked(int ino) {
  * Returns: 0 on success, ENOSPC or EIO on error
  */
 int write_data_into_inode(int host_fd, struct ext2_inode *inode, off_t filesize) {
+	return write_data_into_inode_reserved(host_fd, inode, filesize, NULL);
+}
 
-	ssize_t remaining = filesize;
-	int written_blocks = 0;
+/*
+ * Same as write_data_into_inode, but draws blocks from the batch res 
+ * (see alloc_blocks_batch) instead of the bitmap. With res NULL it
+ * allocates from the bitmap as usual.
+ *
+ * Returns: 0 on success, ENOSPC or EIO on error
+ */
+static int do_write_data(int host_fd, struct ext2_inode *inode, 
+		off_t filesize, struct block_reserve *res);
+
+int write_data_into_inode_reserved(int host_fd, struct ext2_inode *inode, 
+		off_t filesize, struct block_reserve *res) {
+	uint64_t start = stats_now();
+	PHASE_BEGIN2(write_data, inode, filesize);
+	int retval = do_write_data(host_fd, inode, filesize, res);
+	PHASE_END(write_data, TL_WRITE_DATA, retval);
+	stats_phase_done(EXT2_FSAL_PHASE_DATA_COPY, start);
+	return retval;
+}
 
-	// initialize all block pointers to zero
-	for (int i = 0; i < TOTAL_POINTERS; i++) inode->i_block[i] = 0;
+/*
+ * Prefetches the unused blocks of the batch res, one run of
+ * consecutive blocks at a time, since the copy will stream through
+ * them.
+ */
+static void prefetch_reserve(struct block_reserve *res) {
+	int i = res->next;
+	while (i < res->count) {
+		int first = res->blocks[i++];
+		int n = 1;
+		while (i < res->count && res->blocks[i] == first + n) {
+			i++;
+			n++;
+		}
+		map_prefetch(first, n);
+	}
+}
 
-	// write data to direct blocks (up to 12 blocks)
-	for (int di = 0; di < DIRECT_POINTERS && remaining > 0; di++) {
-		int b = alloc_block();
-		if (b < 0) return ENOSPC;
-		inode->i_block[di] = b;
+#define COPY_CHUNK 32   // data blocks pinned per batch of reads
 
-		// read data from host file descriptor
-		char buf[EXT2_BLOCK_SIZE];
-		ssize_t r = read(host_fd, buf, EXT2_BLOCK_SIZE);
-		if (r < 0) return EIO;
+/*
+ * Work run while the first data reads are in flight: writing out the
+ * indirect block.
+ */
+struct indirect_write {
+	int block;
+	uint32_t *ptrs;
+};
 
-		// initialize remainder of block to zero if needed
-		if (r < EXT2_BLOCK_SIZE) memset(buf + r, 0, EXT2_BLOCK_SIZE - r);
+static void write_indirect(void *arg) {
+	struct indirect_write *w = arg;
+	write_block(w->block, (char *)w->ptrs);
+}
 
-		// write_block handles block locking
-		write_block(b, buf);
+/*
+ * Reads n blocks of file data from host_fd, starting at offset base,
+ * straight into the blocks listed in blocks, zero-filling past the end
+ * of the file. The blocks are freshly allocated and not yet reachable
+ * by other operations. Reads go through the async I/O engine
+ * COPY_CHUNK blocks at a time, so that only that many blocks are
+ * pinned at once; overlap(arg), if given, runs while the first chunk
+ * is in flight.
+ *
+ * Returns: 0 on success, EIO on error.
+ */
+static int read_into_blocks(int host_fd, off_t base, int *blocks, int n,
+		void (*overlap)(void *), void *arg) {
+	struct aio_req reqs[COPY_CHUNK];
+	int retval = 0;
+
+	for (int k = 0; k < n; k += COPY_CHUNK) {
+		int count = n - k < COPY_CHUNK ? n - k : COPY_CHUNK;
+		for (int j = 0; j < count; j++) {
+			reqs[j] = (struct aio_req){ host_fd, 0, get_block_new(blocks[k + j]),
+						    EXT2_BLOCK_SIZE, base + (off_t)(k + j) * EXT2_BLOCK_SIZE };
+		}
 
-		remaining -= (r > 0 ? r : 0);
-		written_blocks++;
+		if (aio_run(reqs, count, overlap, arg) != 0) retval = EIO;
+		overlap = NULL;
+
+		for (int j = 0; j < count; j++) put_block(blocks[k + j], 1);
+		if (retval) break;
 	}
 
-	// write data to single indirect blocks if needed
-	if (remaining > 0) {
-		// allocate indirect block
-		int indirect_blk = alloc_block();
-		if (indirect_blk < 0) return ENOSPC;
-		inode->i_block[INDIRECT_INDEX] = indirect_blk;
-		written_blocks++;  // count the indirect block itself
+	// the indirect block is written even if a read failed
+	if (overlap) overlap(arg);
+	return retval;
+}
 
-		// allocate array for block pointers
-		uint32_t *ptrs = (uint32_t *) malloc(EXT2_BLOCK_SIZE);
-		if (!ptrs) return ENOMEM;
-		memset(ptrs, 0, EXT2_BLOCK_SIZE);
+static int do_write_data(int host_fd, struct ext2_inode *inode, 
+		off_t filesize, struct block_reserve *res) {
 
-		int per_block = EXT2_BLOCK_SIZE / sizeof(uint32_t);
-		for (int i = 0; i < per_block && remaining > 0; i++) {
-			int b = alloc_block();
-			if (b < 0) {
-				free(ptrs);
-				return ENOSPC;
-			}
-			ptrs[i] = b;
+	int per_block = EXT2_BLOCK_SIZE / sizeof(uint32_t);
+	off_t data_blocks = (filesize + EXT2_BLOCK_SIZE - 1) >> block_shift;
+	if (data_blocks > DIRECT_POINTERS + per_block) data_blocks = DIRECT_POINTERS + per_block;
+	int n = (int)data_blocks;
 
-			char buf[EXT2_BLOCK_SIZE];
-			ssize_t r = read(host_fd, buf, EXT2_BLOCK_SIZE);
-			if (r < 0) {
-				free(ptrs);
-				return EIO;
-			}
-			if (r < EXT2_BLOCK_SIZE) memset(buf + r, 0, EXT2_BLOCK_SIZE - r);
+	off_t base = lseek(host_fd, 0, SEEK_CUR);
+	if (base < 0) return EIO;
+
+	if (res != NULL) prefetch_reserve(res);
+
+	// initialize all block pointers to zero
+	for (int i = 0; i < TOTAL_POINTERS; i++) inode->i_block[i] = 0;
+
+	// map the whole file first, allocating in the usual order: the
+	// direct blocks (up to 12), the indirect block, the blocks it maps
+	int blocks[MAX_INODE_BLOCKS];
+	uint32_t ptrs[EXT2_MAX_BLOCK_SIZE / sizeof(uint32_t)];
+	memset(ptrs, 0, sizeof(ptrs));
+	struct indirect_write indirect = { 0, ptrs };
+	int written_blocks = 0;
 
-			write_block(b, buf);
-			remaining -= (r > 0 ? r : 0);
-			written_blocks++;
+	for (int k = 0; k < n; k++) {
+		if (k == DIRECT_POINTERS) {
+			indirect.block = take_block(res);
+			if (indirect.block < 0) return ENOSPC;
+			inode->i_block[INDIRECT_INDEX] = indirect.block;
+			written_blocks++;  // count the indirect block itself
 		}
 
-		//  write the indirect block with pointers
-		write_block(indirect_blk, (char *)ptrs);
-		free(ptrs);
+		int b = take_block(res);
+		if (b < 0) return ENOSPC;
+		blocks[k] = b;
+		if (k < DIRECT_POINTERS) inode->i_block[k] = b;
+		else ptrs[k - DIRECT_POINTERS] = b;
+		written_blocks++;
 	}
 
+	// copy the data; the indirect block is written while the first
+	// reads are in flight
+	int retval = read_into_blocks(host_fd, base, blocks, n,
+			indirect.block ? write_indirect : NULL, &indirect);
+	if (retval != 0) return retval;
+	lseek(host_fd, base + filesize, SEEK_SET);
+
 	// update inode metadata
 	inode->i_size = filesize;
 	inode->i_blocks = written_blocks * (EXT2_BLOCK_SIZE / 512);
 	return 0;
 }
 
+/*
+ * Rewrites the first n data blocks of inode from host_fd, starting at
+ * offset base. Blocks marked in fresh were just allocated and are read
+ * straight into; the others are read aside, COPY_CHUNK at a time, and
+ * only written if their contents changed.
+ *
+ * Returns: 0 on success, ENOMEM or EIO on error.
+ */
+static int update_blocks(int host_fd, off_t base, struct ext2_inode *inode, 
+		int n, const char *fresh) {
+	struct aio_req reqs[COPY_CHUNK];
+	int blocks[COPY_CHUNK];
+	int retval = 0;
+
+	char *buf = malloc((size_t)COPY_CHUNK * EXT2_BLOCK_SIZE);
+	if (buf == NULL) return ENOMEM;
+
+	for (int k = 0; k < n && retval == 0; k += COPY_CHUNK) {
+		int count = n - k < COPY_CHUNK ? n - k : COPY_CHUNK;
+		for (int j = 0; j < count; j++) {
+			blocks[j] = inode_bmap(inode, k + j);
+			char *dst = fresh[k + j] ? get_block_new(blocks[j]) : buf + j * EXT2_BLOCK_SIZE;
+			reqs[j] = (struct aio_req){ host_fd, 0, dst, EXT2_BLOCK_SIZE, 
+						    base + (off_t)(k + j) * EXT2_BLOCK_SIZE };
+		}
+
+		retval = aio_run(reqs, count, NULL, NULL) != 0 ? EIO : 0;
+
+		for (int j = 0; j < count; j++) {
+			if (fresh[k + j]) {
+				put_block(blocks[j], 1);
+				continue;
+			}
+			if (retval != 0) continue;
+
+			// unchanged blocks stay clean and are not written back
+			char *cur = get_block(blocks[j]);
+			char *src = buf + j * EXT2_BLOCK_SIZE;
+			int changed = memcmp(cur, src, EXT2_BLOCK_SIZE) != 0;
+			if (changed) memcpy(cur, src, EXT2_BLOCK_SIZE);
+			put_block(blocks[j], changed);
+		}
+	}
+
+	free(buf);
+	return retval;
+}
+
+static int do_overwrite_data(int host_fd, int ino, off_t filesize) {
+	int n = data_blocks_for_size(filesize);
+
+	off_t base = lseek(host_fd, 0, SEEK_CUR);
+	if (base < 0) return EIO;
+
+	mutex_lock(&inode_locks[ino - 1]);
+	struct ext2_inode *inode = get_inode(ino);
+	if (inode->i_links_count == 0 || inode->i_dtime != 0) {
+		mutex_unlock(&inode_locks[ino - 1]);
+		return ENOENT;
+	}
+
+	// grow the map first; only new blocks are allocated
+	char fresh[MAX_INODE_BLOCKS];
+	int retval = map_inode_blocks(inode, 0, n, fresh);
+	if (retval == 0) retval = update_blocks(host_fd, base, inode, n, fresh);
+
+	if (retval == 0) {
+		// then drop what the file no longer needs
+		trim_inode_blocks(inode, n);
+		inode->i_size = filesize;
+		inode->i_mtime = inode->i_ctime = (uint32_t)time(NULL);
+	}
+	else {
+		// keep the map consistent with the old size
+		trim_inode_blocks(inode, data_blocks_for_size(inode->i_size));
+	}
+	mutex_unlock(&inode_locks[ino - 1]);
+
+	lseek(host_fd, base + filesize, SEEK_SET);
+	return retval;
+}
+
+/*
+ * Overwrites existing regular file ino (1-based) with filesize bytes
+ * read from host_fd, in place: the file keeps its block map, blocks 
+ * are only allocated or freed for the part by which it grows or 
+ * shrinks, and a block is only written if its contents change. Holds
+ * the inode's lock throughout.
+ *
+ * Returns: 0 on success, ENOENT if the file was removed meanwhile, 
+ * ENOSPC, ENOMEM or EIO on error.
+ */
+int overwrite_file_data(int host_fd, int ino, off_t filesize) {
+	uint64_t start = stats_now();
+	int retval = do_overwrite_data(host_fd, ino, filesize);
+	stats_phase_done(EXT2_FSAL_PHASE_DATA_COPY, start);
+	return retval;
+}
+
 /*
  * Initialize a new file inode with proper mode, timestamps, and 
  * link count.
@@ -912,29 +1972,28 @@ int open_source_file(const char *src, off_t *filesize, int *err) {
  * operation. Handles trailing slashes by treating them as directory 
  * paths.
  *
+ * dir: directory handle relative paths start at, or NULL
  * dst: destination path in ext2 filesystem
  * src: source path (used for basename extraction)
  * parent_ino: pointer to store parent directory inode number
  * name: pointer to store target filename (EXT2_NAME_LEN buffer)
+ * existing: pointer to store the inode name currently refers to in 
+ *           the parent, or -1
  * 
  * Returns: 0 on success, errno on error
  */
-int resolve_copy_destination(const char *dst, const char *src, 
-		int *parent_ino, char *name) {
+int resolve_copy_destination(const struct ext2_fsal_dir *dir, const char *dst, 
+		const char *src, int *parent_ino, char *name, int *existing) {
 
-	// copy dst into a temporary buffer
-	char parent_path[PATH_MAX];
-	char tmp_dst[PATH_MAX];
-	strncpy(tmp_dst, dst, PATH_MAX - 1);
-	tmp_dst[PATH_MAX - 1] = '\0';
+	struct path_res r;
+	int retval = resolve_at(dir, dst, &r);
+	if (retval != 0) return retval;
 
 	// CASE 1: trailing slash, treat as directory, use source basename
-	if (strlen(tmp_dst) > 1 && tmp_dst[strlen(tmp_dst) - 1] == '/') {
-		// resolve the directory inode for dst
-		int dir_ino = path_lookup(tmp_dst);
-		if (dir_ino < 0) return ENOENT;  // doesnt exist
+	if (r.trailing_slash) {
+		if (r.ino < 0) return ENOENT;  // doesnt exist
 
-		struct ext2_inode *dir = get_inode(dir_ino);
+		struct ext2_inode *dir = get_inode(r.ino);
 		
 		// ensure dst is a directory
 		if (!S_ISDIR(dir->i_mode)) return ENOENT;
@@ -946,24 +2005,18 @@ int resolve_copy_destination(const char *dst, const char *src,
 		// copy name & parent inode num into provided buffers
 		strncpy(name, base, EXT2_NAME_LEN);
 		name[EXT2_NAME_LEN - 1] = '\0';
-		*parent_ino = dir_ino;
+		*parent_ino = r.ino;
+		*existing = find_dir_entry(dir, name);
 
 		return 0;
-    }
+	}
 	
-	// CASE 2: normal path, split into parent and name
-	int retval = split_parent_name(dst, parent_path, name);
-	if (retval != 0) return retval;
-	// resolve the parent directory's inode
-	int p_ino = path_lookup(parent_path);
-	if (p_ino < 0) return ENOENT;
-	struct ext2_inode *parent = get_inode(p_ino);
+	// CASE 2: normal path, the last component is the name
+	if (r.name[0] == '\0') return ENOENT;  // cannot copy onto "/"
 
-	// ensure parent is a directory
-	if (!S_ISDIR(parent->i_mode)) return ENOENT;
-
-	// success; fill provided buffer with parent inode number
-	*parent_ino = p_ino;
+	strcpy(name, r.name);
+	*parent_ino = r.parent_ino;
+	*existing = r.ino;
 	return 0;
 }
 
@@ -974,15 +2027,15 @@ int resolve_copy_destination(const char *dst, const char *src,
  * src: source path (for basename extraction)
  * parent_ino: parent directory inode
  * name: target name
+ * existing: inode name refers to in the parent (from 
+ *           resolve_copy_destination), or -1
  * target_ino: existing target inode if overwriting
  * overwrite: 1 if overwriting existing file, 0 otherwise
  * 
  * Returns: 0 on success, errno on error
  */
-int check_copy_target(const char *src, int *parent_ino, char *name, int *target_ino, int *overwrite) {
-	
-	struct ext2_inode *parent = get_inode(*parent_ino);
-	int existing = find_dir_entry(parent, name);
+int check_copy_target(const char *src, int *parent_ino, char *name, int existing,
+		int *target_ino, int *overwrite) {
 	
 	*target_ino = -1;
 	*overwrite = 0;
@@ -998,7 +2051,7 @@ int check_copy_target(const char *src, int *parent_ino, char *name, int *target_
 	// CASE 2: directory, copy file into it with source basename
 	if (S_ISDIR(target->i_mode)) {
 		*parent_ino = existing;
-		parent = get_inode(existing);
+		struct ext2_inode *parent = get_inode(existing);
 
 		const char *base = get_path_basename(src);
 		if (strlen(base) >= EXT2_NAME_LEN) return ENAMETOOLONG;
@@ -27,22 +27,194 @@
 #define DIRECT_POINTERS 12
 #define INDIRECT_INDEX  12
 #define TOTAL_POINTERS  15
+#define MAX_INODE_BLOCKS (DIRECT_POINTERS + 1 + EXT2_MAX_BLOCK_SIZE / 4)
 #define PATH_MAX 4096
+#define NAME_LOCKS 1024      // hashed name locks, power of two
+
+// Block size of the image. dirblock.c instantiates the directory block
+// routines once per supported size with this defined as a constant.
+#ifndef EXT2_BLOCK_SIZE
+#define EXT2_BLOCK_SIZE block_size
+#endif
+
+// Block bitmap bit of block b, and back. Bit 0 is s_first_data_block:
+// block 1 with 1 KiB blocks, block 0 otherwise.
+#define BLOCK_BIT(b) ((b) - first_data_block)
+#define BIT_BLOCK(i) ((i) + first_data_block)
+
+/*
+ * A batch of blocks reserved up front with alloc_blocks_batch and 
+ * handed out in order.
+ */
+struct block_reserve {
+	int *blocks;
+	int count;
+	int next;
+};
+
+/*
+ * A path resolved by resolve_path or resolve_at: the last component,
+ * the directory holding it and the inode it names.
+ */
+struct path_res {
+	int parent_ino;
+	int ino;                    // -1 if the last component does not exist
+	int trailing_slash;
+	char name[EXT2_NAME_LEN];   // last component, empty for "/"
+};
+
+/*
+ * One positioned read or write for aio_run.
+ */
+struct aio_req {
+	int fd;
+	int write;          // 0 to read into buf, 1 to write from it
+	void *buf;
+	size_t len;
+	off_t off;
+};
+
+/*
+ * One public operation between op_begin and op_end.
+ */
+struct op_call {
+	int op;
+	int flags;          // OP_* below
+	int outer;          // not nested in another operation
+	int admitted;
+	uint64_t start;     // stats_now() at op_begin
+	const char *a, *b;  // path arguments, for the trace
+};
+
+#define OP_REPLAY    1  // record the call in the trace (path-based forms)
+#define OP_NO_REJECT 2  // wait for admission even if the queue is full
+#define OP_NO_STATS  4  // the caller records the latency itself
 
 // BITMAP OPERATIONS
 int test_bit(uint8_t *bitmap, int n);
 void set_bit(uint8_t *bitmap, int n);
 void clear_bit(uint8_t *bitmap, int n);
 
+// BITMAP SUMMARY TREE (bmtree.c)
+struct bm_node {
+	int32_t len;    // bits covered
+	int32_t free;   // free bits
+	int32_t pre;    // free run at the start
+	int32_t suf;    // free run at the end
+	int32_t best;   // longest free run
+};
+
+struct bm_tree {
+	uint8_t *bitmap;        // on-disk bitmap being summarized
+	int nbits;
+	int first;              // bits below this are never free
+	int nwords;             // 64-bit words covering the bitmap
+	int size;               // leaves (power of two)
+	struct bm_node *nodes;  // heap-ordered, root at index 1
+};
+
+int bm_tree_build(struct bm_tree *t, uint8_t *bitmap, int nbits, int first);
+void bm_tree_destroy(struct bm_tree *t);
+void bm_tree_update(struct bm_tree *t, int bit);
+int bm_tree_free_count(struct bm_tree *t);
+int bm_find_free(struct bm_tree *t, int goal);
+int bm_find_run(struct bm_tree *t, int len);
+int bm_largest_run(struct bm_tree *t, int *start);
+
+
+// STATISTICS (stats.c)
+struct ext2_fsal_defrag_stats;
+void stats_init(void);
+void stats_destroy(void);
+uint64_t stats_now(void);
+void stats_op_done(int op, uint64_t start);
+void stats_phase_done(int phase, uint64_t start);
+void stats_lock_acquired(int cls, uint64_t wait_ns, int contended);
+void stats_defrag_done(const struct ext2_fsal_defrag_stats *d);
+void stats_qos_wait(int cls, uint64_t start);
+const char *stats_lock_name(int cls);
+
+// LOCK PROFILING (lockprof.c, only active with -DEXT2FSAL_LOCKPROF)
+void lockprof_init(int inodes, int blocks);
+void lockprof_destroy(void);
+uint64_t lockprof_now(void);
+void lockprof_acquired(pthread_mutex_t *mutex, int cls, uint64_t wait_ns,
+		int contended, void *pc);
+
+// TRACING (trace.c)
+void trace_init(void);
+void trace_destroy(void);
+int trace_enter(int op, const char *a, const char *b);
+void trace_exit(int outer, int op, const char *a, const char *b, int32_t retval);
+
+// TIMELINE (timeline.c; probes and regions are in probes.h)
+void timeline_init(void);
+void timeline_destroy(void);
+void timeline_export(void);
+
+// BLOCK DEVICE (blockdev.c)
+struct ext2_fsal_blockdev_stats;
+int blockdev_open(int fd, size_t size);
+void blockdev_close(void);
+void blockdev_op_done(void);
+int blockdev_mapped(void);
+void blockdev_forget(int first, int end);
+void blockdev_snapshot(struct ext2_fsal_blockdev_stats *out);
+char* get_block(int block_num);
+char* get_block_new(int block_num);
+void put_block(int block_num, int dirty);
+
+// ASYNC I/O (aio.c)
+void aio_engine_init(void);
+void aio_engine_destroy(void);
+int aio_run(struct aio_req *reqs, int n, void (*overlap)(void *), void *arg);
+void aio_snapshot(struct ext2_fsal_blockdev_stats *out);
+
+// MAPPING (mapping.c)
+struct ext2_fsal_mapping_stats;
+void map_init_begin(void);
+void *map_image(int fd, size_t size);
+void map_init_done(size_t size);
+void map_prefetch(int first, int count);
+void map_snapshot(struct ext2_fsal_mapping_stats *out);
+
+// DISCARD (discard.c)
+void discard_init(int fd);
+void discard_destroy(void);
+void discard_freed(int *blocks, int count);
+
+// RECLAMATION (reclaim.c)
+void reclaim_init(void);
+void reclaim_destroy(void);
+void reclaim_enter(void);
+void reclaim_exit(void);
+int reclaim_advance(void);
+void reclaim_inodes(int *inos, int count, int dirs);
+void reclaim_blocks(int *blocks, int count);
+
+// ADMISSION CONTROL (qos.c)
+struct ext2_fsal_qos_stats;
+void qos_init(void);
+void qos_destroy(void);
+int qos_class(int op);
+int qos_admit(int op, int may_reject);
+void qos_release(int op);
+void qos_snapshot(struct ext2_fsal_qos_stats *out);
+
+// PUBLIC OPERATIONS (ext2fsal.c)
+int32_t op_begin(struct op_call *c, int op, int flags, const char *a, const char *b);
+int32_t op_end(struct op_call *c, int32_t retval);
 
 // SYNCHRONIZATION PRIMITIVES
 void locks_init(int num_inodes, int num_blocks);
 void locks_destroy();
 void mutex_lock(pthread_mutex_t *mutex);
 void mutex_unlock(pthread_mutex_t *mutex);
+pthread_mutex_t *name_lock(int dir_ino, const char *name, int name_len);
 
 // INODE ALLOCATION & ACCESS
 int alloc_inode();
+int alloc_inodes_batch(int count, int *out);
 void free_inode(int ino);
 int alloc_block();
 struct ext2_inode* get_inode(int ino);
@@ -50,30 +222,65 @@ void write_inode(int ino, struct ext2_inode* inode);
 
 // BLOCK ALLOCATION & ACCESS
 int alloc_block(void);
+int alloc_blocks_batch(int count, int *out);
+int alloc_block_run(int count);
 void free_block(int block_num);
-char* get_block(int block_num);
 void write_block(int block_num, char* data);
 
+// BULK BITMAP RELEASE
+void free_blocks_bulk(int *blocks, int count);
+void free_inodes_bulk(int *inos, int count, int dirs);
+
 // DIRECTORY OPERATIONS
 struct ext2_dir_entry *next_dir_entry(struct ext2_dir_entry *entry);
 int dir_entry_rec_len(int name_len);
 int add_dir_entry(int parent_ino, const char* name, int child_ino, uint8_t type);
+int insert_dir_entry_locked(int parent_ino, const char* name, int child_ino, uint8_t type);
+int remove_dir_entry_locked(int dir_ino, const char *name);
+int replace_dir_entry_locked(int dir_ino, const char *name, int new_ino, uint8_t type);
 int find_dir_entry(struct ext2_inode *dir, const char *name);
+int find_dir_entry_len(struct ext2_inode *dir, const char *name, int name_len);
+int create_directory(int parent_ino, const char *name, int *new_ino);
+void dir_generation_init(void);
+
+// DIRECTORY BLOCKS (dirblock.c)
+void dirblock_init(int size);
+struct ext2_dir_entry *dirblock_last(char *block);
+struct ext2_dir_entry *dirblock_lookup(char *block, const char *name, int name_len,
+		struct ext2_dir_entry **prev_out);
+struct ext2_dir_entry *dirblock_gap(char *block, int needed);
 
 // PATH OPERATIONS
+struct ext2_fsal_dir;
+int resolve_path(const char *path, struct path_res *res);
+int resolve_at(const struct ext2_fsal_dir *dir, const char *path, struct path_res *res);
+int check_dir_handle(const struct ext2_fsal_dir *dir);
 int path_lookup(const char *path);
+int make_dirs(const char *path, int *ino);
 void strip_trailing_slashes(char *s);
-int split_parent_name(const char *path, char *parent_buf, char *name_buf);
 const char* get_path_basename(const char *path);
 
 // FILE DATA OPERATIONS
 void free_inode_blocks_locked(int ino);
+void release_inode_link(int ino);
+int unlink_entry(int parent_ino, const char *name);
+int collect_inode_blocks(struct ext2_inode *inode, int *out);
+int data_blocks_for_size(off_t filesize);
+int blocks_for_size(off_t filesize);
+int inode_bmap(struct ext2_inode *inode, int k);
+int map_inode_blocks(struct ext2_inode *inode, int first, int n, char *fresh);
+void trim_inode_blocks(struct ext2_inode *inode, int n);
 int write_data_into_inode(int host_fd, struct ext2_inode *inode, off_t filesize);
+int write_data_into_inode_reserved(int host_fd, struct ext2_inode *inode, off_t filesize, struct block_reserve *res);
+int overwrite_file_data(int host_fd, int ino, off_t filesize);
 void init_file_inode(struct ext2_inode *inode);
 
 // COPY HELPERS
+int32_t copy_file(const char *src, const struct ext2_fsal_dir *dir, const char *dst);
 int open_source_file(const char *src, off_t *filesize, int *err);
-int check_copy_target(const char *src, int *parent_ino, char *name, int *target_ino, int *overwrite);
-int resolve_copy_destination(const char *dst, const char *src, int *parent_ino, char *name);
+int check_copy_target(const char *src, int *parent_ino, char *name, int existing,
+		int *target_ino, int *overwrite);
+int resolve_copy_destination(const struct ext2_fsal_dir *dir, const char *dst, const char *src,
+		int *parent_ino, char *name, int *existing);
 
 #endif /* CSC369_E2FS_H */
@@ -19,8 +19,12 @@
 #ifndef CSC369_EXT2_FS_H
 #define CSC369_EXT2_FS_H
 
-/* The ext2 block size used in the assignment. */
-#define EXT2_BLOCK_SIZE 1024
+/* The range of ext2 block sizes supported: 1024 << s_log_block_size,
+ * s_log_block_size 0 to 2. The superblock is always at byte 1024. */
+#define EXT2_MIN_BLOCK_SIZE 1024
+#define EXT2_MAX_BLOCK_SIZE 4096
+#define EXT2_SUPERBLOCK_OFFSET 1024
+#define EXT2_SUPER_MAGIC 0xEF53
 
 /*
  * Structure of the super block
@@ -13,7 +13,6 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/mman.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include "ext2fsal.h"
@@ -31,15 +30,24 @@ uint8_t* inode_bitmap;         // bitmap for inode allocation
 uint8_t* block_bitmap;         // bitmap for block allocation
 struct ext2_inode* inode_table;  // array of inode structs
 
+// BITMAP SUMMARY TREES
+struct bm_tree inode_tree;     // free-inode summary over inode_bitmap
+struct bm_tree block_tree;     // free-block summary over block_bitmap
+
 // FILESYSTEM SIZE COUNTERS
 int num_inodes;        // total number of inodes
 int num_blocks;        // total number of blocks
+int block_size;        // bytes per block
+int block_shift;       // log2 of block_size
+int first_data_block;  // block of block bitmap bit 0
 
 // SYNCHRONIZATION PRIMITIVES
 pthread_mutex_t* inode_locks;    // per-inode locks
 pthread_mutex_t* block_locks;    // per-block locks
+pthread_mutex_t* name_locks;     // hashed (directory, name) locks
 pthread_mutex_t inode_bitmap_lock; // lock for inode bitmap access
 pthread_mutex_t block_bitmap_lock; // lock for block bitmap access
+pthread_mutex_t rename_lock;       // serializes cross-directory dir moves
 
 // PRIVATE VARIABLES
 static int disk;           // file descriptor for disk image
@@ -50,10 +58,19 @@ static size_t image_size;  // size of the disk image, in bytes
 /*
  * Initializes the ext2 filesystem interface for the given image:
  *
- * - Opens and mmaps the disk image.
+ * - Reads the block size (1, 2 or 4 KiB) from the superblock and
+ *   selects the directory block routines built for it.
+ * - Opens the disk image through the EXT2FSAL_BACKEND block device:
+ *   mmapped under the EXT2FSAL_MMAP policy (see mapping.c), or read
+ *   through a block cache (see blockdev.c).
  * - Sets up pointers to filesystem structures (superblock, 
  *   group descriptor, etc.)
  * - Initializes synchronization primitives.
+ * - Builds the in-memory bitmap summary trees and resets deferred
+ *   reclamation of removed inodes and directory blocks.
+ * - Sets up operation statistics, the async I/O engine and, if
+ *   requested, tracing, discard of freed blocks and admission control
+ *   of bulk operations.
  */
 void ext2_fsal_init(const char* image) {
 
@@ -65,22 +82,41 @@ void ext2_fsal_init(const char* image) {
     	}
 	image_size = st.st_size;
 
-	// open and mmap the disk image
+	map_init_begin();
+
+	// open the disk image and map or cache it (blockdev.c)
 	disk = open(image, O_RDWR);
 	if (disk < 0) {
 		perror("open");
 		exit(1);
 	}
 
-	fs = mmap(NULL, image_size, PROT_READ | PROT_WRITE, MAP_SHARED, disk, 0);
-	if (fs == MAP_FAILED) {
-		perror("mmap");
+	// the block size decides where everything else is
+	struct ext2_super_block sb;
+	if (pread(disk, &sb, sizeof(sb), EXT2_SUPERBLOCK_OFFSET) != sizeof(sb) ||
+	    sb.s_magic != EXT2_SUPER_MAGIC) {
+		fprintf(stderr, "%s: not an ext2 image\n", image);
+		exit(1);
+	}
+	if (sb.s_log_block_size > 2 || 
+	    (sb.s_rev_level > 0 && sb.s_inode_size != sizeof(struct ext2_inode))) {
+		fprintf(stderr, "%s: unsupported block or inode size\n", image);
+		exit(1);
+	}
+	block_shift = 10 + sb.s_log_block_size;
+	block_size = 1 << block_shift;
+	first_data_block = sb.s_first_data_block;
+	dirblock_init(block_size);
+	dir_generation_init();
+
+	if (blockdev_open(disk, image_size) < 0) {
+		perror("blockdev");
 		exit(1);
 	}
 
 	// set up pointers to file system structures
-	superblock = (struct ext2_super_block*)(fs + EXT2_BLOCK_SIZE);
-	group_desc = (struct ext2_group_desc*)(fs + 2 * EXT2_BLOCK_SIZE);
+	superblock = (struct ext2_super_block*)(fs + EXT2_SUPERBLOCK_OFFSET);
+	group_desc = (struct ext2_group_desc*)(fs + (first_data_block + 1) * EXT2_BLOCK_SIZE);
 	
 	inode_bitmap  = (uint8_t*)(fs + group_desc->bg_inode_bitmap * EXT2_BLOCK_SIZE);
 	block_bitmap  = (uint8_t*)(fs + group_desc->bg_block_bitmap * EXT2_BLOCK_SIZE);
@@ -93,15 +129,38 @@ void ext2_fsal_init(const char* image) {
 	// initialize synchronization primitives
 	locks_init(num_inodes, num_blocks);
 
-	// close file descriptor, mmap keeps the mapping
+	// summarize both bitmaps for logarithmic free-space queries;
+	// reserved inodes are never handed out
+	if (bm_tree_build(&inode_tree, inode_bitmap, num_inodes, EXT2_GOOD_OLD_FIRST_INO) < 0 ||
+	    bm_tree_build(&block_tree, block_bitmap, num_blocks - first_data_block, 0) < 0) {
+		perror("malloc failed");
+		exit(1);
+	}
+	reclaim_init();
+	qos_init();
+
+	timeline_init();
+	stats_init();
+	trace_init();
+	lockprof_init(num_inodes, num_blocks);
+	aio_engine_init();
+	discard_init(disk);
+
+	// close file descriptor; the mapping or the cache's duplicate stays
 	close(disk);
+
+	// prefault metadata and advise the data area, then record the cost
+	map_init_done(image_size);
 }
 
 /*
  * Destroys the ext2 filesystem interface and cleans up resources:
  *
+ * - Frees retired inodes and blocks; punches any queued freed blocks
+ *   and stops discard.
  * - Destroys all synchronization primitives.
- * - Unmaps the disk image from memory.
+ * - Frees the bitmap summary trees and statistics; flushes the trace.
+ * - Writes back cached blocks and unmaps or closes the disk image.
  */
 void ext2_fsal_destroy() {
 
@@ -109,9 +168,70 @@ void ext2_fsal_destroy() {
         int num_inodes = superblock->s_inodes_count;
         int num_blocks = superblock->s_blocks_count;
 
+	// free retired items, then flush pending discards, while the 
+	// bitmap locks still exist
+	reclaim_destroy();
+	discard_destroy();
+
 	// destroy synchronization primitives
 	locks_destroy(num_inodes, num_blocks);
 
-	// unmap the disk image
-    	munmap(fs, image_size);
+	bm_tree_destroy(&inode_tree);
+	bm_tree_destroy(&block_tree);
+	qos_destroy();
+	trace_destroy();
+	stats_destroy();
+	timeline_destroy();
+	lockprof_destroy();
+
+	// write back and release the disk image
+	blockdev_close();
+	aio_engine_destroy();
+}
+
+// ------------------------ PUBLIC OPERATIONS ------------------------
+
+/*
+ * Starts public operation op on path arguments a and b (b may be
+ * NULL), for each ext2_fsal_* call to wrap its do_* body in:
+ *
+ * - Times it for the operation statistics, unless OP_NO_STATS.
+ * - Traces it; only OP_REPLAY calls that are not nested in another
+ *   operation are recorded for replay (see trace.c).
+ * - Admits it through admission control (see qos.c), which only
+ *   queues bulk operations and, unless OP_NO_REJECT, may refuse them.
+ * - Once admitted, enters a reclamation section (see reclaim.c).
+ *
+ * op_end must follow, whatever this returns.
+ *
+ * Returns: 0 if the body may run, or EBUSY if it was refused.
+ */
+int32_t op_begin(struct op_call *c, int op, int flags, const char *a, const char *b) {
+	c->op = op;
+	c->flags = flags;
+	c->a = a;
+	c->b = b;
+	c->start = stats_now();
+	c->outer = trace_enter(op, a, b);
+
+	int32_t retval = qos_admit(op, !(flags & OP_NO_REJECT));
+	c->admitted = retval == 0;
+	if (c->admitted) reclaim_enter();
+	return retval;
+}
+
+/*
+ * Ends the operation op_begin started, with result retval.
+ *
+ * Returns: retval.
+ */
+int32_t op_end(struct op_call *c, int32_t retval) {
+	if (c->admitted) {
+		reclaim_exit();
+		qos_release(c->op);
+	}
+	blockdev_op_done();
+	if (!(c->flags & OP_NO_STATS)) stats_op_done(c->op, c->start);
+	trace_exit(c->outer && (c->flags & OP_REPLAY), c->op, c->a, c->b, retval);
+	return retval;
 }
@@ -36,13 +36,196 @@ extern struct ext2_inode* inode_table;
 extern int num_inodes;
 extern int num_blocks;
 
+// block size of the image, read from the superblock (see
+// EXT2_BLOCK_SIZE in e2fs.h), and the block bitmap's first block
+extern int block_size;
+extern int block_shift;
+extern int first_data_block;
+
+// in-memory summaries of the two bitmaps (see bmtree.c)
+extern struct bm_tree inode_tree;
+extern struct bm_tree block_tree;
+
 
 // ------------------ SYNCHRONIZATION PRIMITIVES --------------------
 
 extern pthread_mutex_t* inode_locks;
 extern pthread_mutex_t* block_locks;
+extern pthread_mutex_t* name_locks;
 extern pthread_mutex_t inode_bitmap_lock;
 extern pthread_mutex_t block_bitmap_lock;
+extern pthread_mutex_t rename_lock;
+
+// -------------------------- STATISTICS ----------------------------
+
+// Operations, internal phases and lock classes tracked by the
+// always-on statistics (see stats.c).
+enum ext2_fsal_op {
+	EXT2_FSAL_OP_CP,
+	EXT2_FSAL_OP_LN_HL,
+	EXT2_FSAL_OP_LN_SL,
+	EXT2_FSAL_OP_RM,
+	EXT2_FSAL_OP_MKDIR,
+	EXT2_FSAL_OP_RENAME,
+	EXT2_FSAL_OP_RM_R,
+	EXT2_FSAL_OP_MKDIR_P,
+	EXT2_FSAL_OP_CP_R,
+	EXT2_FSAL_OP_DEFRAG,
+	EXT2_FSAL_OP_CP_STREAM,
+	EXT2_FSAL_OP_WRITE,
+	EXT2_FSAL_OP_TRUNCATE,
+	EXT2_FSAL_OP_COUNT
+};
+
+enum ext2_fsal_phase {
+	EXT2_FSAL_PHASE_PATH_LOOKUP,
+	EXT2_FSAL_PHASE_ALLOC,
+	EXT2_FSAL_PHASE_DATA_COPY,
+	EXT2_FSAL_PHASE_DIRENT_INSERT,
+	EXT2_FSAL_PHASE_COUNT
+};
+
+enum ext2_fsal_lock_class {
+	EXT2_FSAL_LOCK_INODE,          // inode_locks[]
+	EXT2_FSAL_LOCK_BLOCK,          // block_locks[]
+	EXT2_FSAL_LOCK_NAME,           // name_locks[]
+	EXT2_FSAL_LOCK_INODE_BITMAP,   // inode_bitmap_lock
+	EXT2_FSAL_LOCK_BLOCK_BITMAP,   // block_bitmap_lock
+	EXT2_FSAL_LOCK_OTHER,
+	EXT2_FSAL_LOCK_COUNT
+};
+
+// Admission classes (see qos.c): bulk operations are cp, cp_r, the
+// streamed copy, rm_r and defrag; all others are metadata.
+enum ext2_fsal_qos_class {
+	EXT2_FSAL_QOS_META,
+	EXT2_FSAL_QOS_BULK,
+	EXT2_FSAL_QOS_COUNT
+};
+
+// Latency summary of one operation or phase, in nanoseconds.
+// Percentiles are accurate to within 1/16 of the value.
+struct ext2_fsal_latency {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t p50_ns;
+	uint64_t p90_ns;
+	uint64_t p99_ns;
+	uint64_t p999_ns;
+};
+
+// Acquisition and wait counters of one lock class.
+struct ext2_fsal_lock_stats {
+	uint64_t acquisitions;
+	uint64_t contended;      // acquisitions that had to wait
+	uint64_t wait_ns;        // total time spent waiting
+	uint64_t max_wait_ns;
+};
+
+// Totals of all ext2_fsal_defrag calls. An extent is a run of
+// consecutive blocks in a file's map (its data blocks in order, with
+// the indirect block after the twelfth); extents_before / files and
+// extents_after / files are the average extents per file.
+struct ext2_fsal_defrag_stats {
+	uint64_t files;          // regular files examined
+	uint64_t moved;          // files rewritten into a single run
+	uint64_t skipped;        // fragmented, but no free run was long enough
+	uint64_t blocks_moved;
+	uint64_t extents_before;
+	uint64_t extents_after;
+	uint64_t throttle_ns;    // time spent yielding to other operations
+};
+
+// How the image is mapped (EXT2FSAL_MMAP) and what mapping it cost.
+// Fault counts come from getrusage and so cover the whole process.
+struct ext2_fsal_mapping_stats {
+	char policy[16];         // plain, meta, populate, hugepage; none under pread
+	int hugepages;           // MADV_HUGEPAGE was accepted
+	uint64_t init_ns;        // wall time of ext2_fsal_init
+	uint64_t init_minor_faults;
+	uint64_t init_major_faults;
+	uint64_t minor_faults;   // since ext2_fsal_init returned
+	uint64_t major_faults;
+};
+
+// Block size, block device backend (EXT2FSAL_BACKEND) and, under pread, its
+// block cache, plus the async I/O engine that copies file data and
+// batches writeback. Metadata pages are written back separately.
+struct ext2_fsal_blockdev_stats {
+	char backend[16];        // mmap or pread
+	uint32_t block_size;     // of the image, in bytes
+	uint64_t cache_blocks;   // capacity of the cache
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t writebacks;     // cached blocks written to the image
+	uint64_t meta_writebacks;
+	char aio[16];            // I/O engine: io_uring or sync
+	uint64_t aio_requests;   // transfers run through the engine
+	uint64_t aio_enters;     // io_uring_enter calls they took
+};
+
+// Admission of one class. Only bulk operations ever queue, and only
+// with EXT2FSAL_QOS_BULK set.
+struct ext2_fsal_qos_stats {
+	uint64_t waited;         // operations that queued for a slot
+	uint64_t rejected;       // refused with EBUSY, their client's queue full
+	uint64_t depth;          // queued right now
+	uint64_t max_depth;
+	struct ext2_fsal_latency wait;     // time spent queued
+	struct ext2_fsal_latency latency;  // whole operations, queueing included
+};
+
+struct ext2_fsal_stats {
+	struct ext2_fsal_latency ops[EXT2_FSAL_OP_COUNT];
+	struct ext2_fsal_latency phases[EXT2_FSAL_PHASE_COUNT];
+	struct ext2_fsal_lock_stats locks[EXT2_FSAL_LOCK_COUNT];
+	struct ext2_fsal_defrag_stats defrag;
+	struct ext2_fsal_mapping_stats mapping;
+	struct ext2_fsal_blockdev_stats blockdev;
+	struct ext2_fsal_qos_stats qos[EXT2_FSAL_QOS_COUNT];
+};
+
+// Fills stats with totals across all threads since init. Safe to call
+// at any time; it does not stop or block running operations.
+void ext2_fsal_stats_snapshot(struct ext2_fsal_stats *stats);
+
+// Writes the same snapshot as JSON to the file descriptor fd.
+// With EXT2FSAL_STATS_PATH set, SIGUSR1 writes it to that path.
+void ext2_fsal_stats_dump(int fd);
+
+// Writes the Chrome trace timeline (see timeline.c) as JSON to fd.
+// Only collected with EXT2FSAL_TIMELINE set at init.
+void ext2_fsal_timeline_dump(int fd);
+
+// Writes the lock contention profile (per class, top locks and top
+// call sites by wait) to fd. Only collected in builds made with
+// `make LOCKPROF=1`; otherwise it says so.
+void ext2_fsal_lockprof_dump(int fd);
+
+// ---------------------------- TRACING -----------------------------
+
+// With EXT2FSAL_TRACE=path set at init, every top-level operation is
+// recorded to path (see trace.c). The file is one header followed by
+// records, each padded to 8 bytes and followed by its arguments.
+#define EXT2_FSAL_TRACE_MAGIC   0x52543245   // "E2TR"
+#define EXT2_FSAL_TRACE_VERSION 1
+
+struct ext2_fsal_trace_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t start_realtime_ns;  // wall clock when tracing started
+};
+
+struct ext2_fsal_trace_record {
+	uint64_t start_ns;      // since start of trace
+	uint64_t duration_ns;
+	uint32_t tid;           // issuing thread
+	int32_t result;         // value the operation returned
+	uint16_t op;            // enum ext2_fsal_op
+	uint16_t arg_len[2];    // bytes of each path argument (0 if absent)
+	uint16_t reserved;
+};
 
 // --------------------- FILESYSTEM OPERATIONS -----------------------
 
@@ -91,4 +274,200 @@ int32_t ext2_fsal_rm(const char *path);
 // Otherwise, an error may be returned (see handout).
 int32_t ext2_fsal_mkdir(const char *path);
 
+// src is a pointer to a zero terminated string
+// dst is a pointer to a zero terminated string
+//
+// Moves the entry at src to dst without copying any data. An existing
+// non-directory at dst is replaced atomically.
+//
+// returns 0 if the operation completed succefully. 
+// Otherwise, an error may be returned (see handout).
+int32_t ext2_fsal_rename(const char *src,
+                         const char *dst);
+
+// path is a pointer to a zero terminated string
+//
+// Removes the directory at path together with everything beneath it.
+// Non-directories are removed as by ext2_fsal_rm.
+//
+// returns 0 if the operation completed succefully. 
+// Otherwise, an error may be returned (see handout).
+int32_t ext2_fsal_rm_r(const char *path);
+
+// path is a pointer to a zero terminated string
+//
+// Creates the directory at path along with any missing parents.
+// An already existing directory is not an error.
+//
+// returns 0 if the operation completed succefully. 
+// Otherwise, an error may be returned (see handout).
+int32_t ext2_fsal_mkdir_p(const char *path);
+
+// src is a pointer to a zero terminated string
+// dst is a pointer to a zero terminated string
+//
+// Imports the host directory tree at src into dst, copying files on
+// several threads.
+//
+// returns 0 if the operation completed succefully. 
+// Otherwise, an error may be returned (see handout).
+int32_t ext2_fsal_cp_r(const char *src,
+                       const char *dst);
+
+// path is a pointer to a zero terminated string
+//
+// Defragments the regular file at path, or every regular file beneath
+// the directory at path, while other operations keep running: each
+// file whose blocks are not one contiguous run is moved into a free
+// run. Work is done in slices of EXT2FSAL_DEFRAG_BUDGET_US
+// microseconds (default 1000, 0 for no pauses), each followed by an
+// equal pause. Results are added to the defrag statistics.
+//
+// returns 0 if the operation completed succefully. 
+// Otherwise, an error may be returned (see handout).
+int32_t ext2_fsal_defrag(const char *path);
+
+// ----------------------- QUALITY OF SERVICE ------------------------
+
+// With EXT2FSAL_QOS_BULK=n set at init, at most n bulk operations
+// (see enum ext2_fsal_qos_class) run at once; metadata operations are
+// never held back. Bulk operations beyond that queue per client and
+// are let in round robin across clients. With EXT2FSAL_QOS_QUEUE=m a
+// client may have at most m queued; further bulk operations from it
+// return EBUSY at once instead of waiting.
+
+// Names the client whose requests the calling thread runs, until the
+// next call (0 by default). A server calls this before each request.
+void ext2_fsal_qos_client(uint32_t client);
+
+// returns how many more bulk operations client may queue before they
+// are refused with EBUSY, or -1 if there is no limit.
+int32_t ext2_fsal_qos_credits(uint32_t client);
+
+// ----------------------- DIRECTORY HANDLES -------------------------
+
+// A directory opened with ext2_fsal_opendir. The *_at operations
+// resolve a relative name from it instead of walking from the root;
+// an absolute name ignores it. The handle stays valid while the
+// directory exists, also across renames, and needs no closing. Once
+// the directory is removed, operations through it return ESTALE.
+struct ext2_fsal_dir {
+	uint32_t ino;
+	uint32_t generation;
+};
+
+// path is a pointer to a zero terminated string
+// dir receives the handle
+//
+// returns 0 if the operation completed succefully. 
+// Otherwise, ENOENT if path does not exist, ENOTDIR if it is not a
+// directory.
+int32_t ext2_fsal_opendir(const char *path,
+                          struct ext2_fsal_dir *dir);
+
+// As ext2_fsal_cp, with dst resolved from dir.
+int32_t ext2_fsal_cp_at(const char *src,
+                        const struct ext2_fsal_dir *dir,
+                        const char *dst);
+
+// As ext2_fsal_ln_hl, with dst resolved from dir; src is absolute.
+int32_t ext2_fsal_ln_hl_at(const char *src,
+                           const struct ext2_fsal_dir *dir,
+                           const char *dst);
+
+// As ext2_fsal_ln_sl, with dst resolved from dir.
+int32_t ext2_fsal_ln_sl_at(const char *src,
+                           const struct ext2_fsal_dir *dir,
+                           const char *dst);
+
+// As ext2_fsal_rm, with name resolved from dir.
+int32_t ext2_fsal_rm_at(const struct ext2_fsal_dir *dir,
+                        const char *name);
+
+// As ext2_fsal_mkdir, with name resolved from dir.
+int32_t ext2_fsal_mkdir_at(const struct ext2_fsal_dir *dir,
+                           const char *name);
+
+// -------------------------- STREAMED COPY --------------------------
+
+// A copy whose data the caller hands over in chunks instead of a host
+// path for the library to open, e.g. payload a server receives in
+// shared memory from a client in another mount namespace.
+//
+// ext2_fsal_cp_begin reserves the inode and all blocks for size bytes
+// up front. Each ext2_fsal_cp_write copies the next chunk straight
+// into its blocks and returns once buf may be reused, which is when a
+// server can hand the chunk's credit back to the client; chunks may
+// be of any length. Nothing appears at dst until ext2_fsal_cp_commit
+// links the file, or gives an existing regular file at dst the new
+// data in one step. ext2_fsal_cp_abort releases everything instead.
+// Commit and abort free the stream. A stream is used by one thread at
+// a time, but any number may be open at once.
+struct ext2_fsal_cp_stream;
+
+// dir is a directory handle for a relative dst, or NULL
+// dst is a pointer to a zero terminated string naming the file
+// size is the number of bytes that will be written
+// stream receives the stream
+//
+// returns 0 if the operation completed succefully. 
+// Otherwise, ENOENT if the parent does not exist, EISDIR if dst is a
+// directory, EEXIST if it is a symlink, EFBIG if size is more than an
+// inode can map, ENOSPC if the image cannot hold size bytes.
+int32_t ext2_fsal_cp_begin(const struct ext2_fsal_dir *dir,
+                           const char *dst,
+                           uint64_t size,
+                           struct ext2_fsal_cp_stream **stream);
+
+// Appends len bytes from buf to the file.
+//
+// returns 0 if the operation completed succefully. 
+// Otherwise, EINVAL if the data would run past the size given to
+// ext2_fsal_cp_begin.
+int32_t ext2_fsal_cp_write(struct ext2_fsal_cp_stream *stream,
+                           const void *buf,
+                           size_t len);
+
+// returns 0 if the operation completed succefully. 
+// Otherwise, EINVAL if fewer bytes were written than announced, or an
+// error of ext2_fsal_cp; nothing is left behind at dst.
+int32_t ext2_fsal_cp_commit(struct ext2_fsal_cp_stream *stream);
+
+void ext2_fsal_cp_abort(struct ext2_fsal_cp_stream *stream);
+
+// ---------------------------- FILE DATA ----------------------------
+
+// Changes to the contents of an existing regular file that touch only
+// the blocks in the byte range and the inode, so a log-style writer
+// pays for each record, not for the whole file as with ext2_fsal_cp.
+// Bytes between the old end of a file and a write past it, or a
+// truncate that grows it, read as zeros. These calls are not traced.
+
+// path is a pointer to a zero terminated string naming the file
+// off is the byte offset to write at
+// buf holds the len bytes to write
+//
+// returns 0 if the operation completed succefully. 
+// Otherwise, ENOENT if path does not exist, EISDIR if it is a 
+// directory, EINVAL if it is not a regular file, EFBIG if the data
+// would run past what an inode can map, ENOSPC if the image has no
+// room for the new blocks.
+int32_t ext2_fsal_write(const char *path,
+                        uint64_t off,
+                        const void *buf,
+                        size_t len);
+
+// As ext2_fsal_write, at the end of the file. The end is read under 
+// the file's lock, so concurrent appends do not overwrite each other.
+int32_t ext2_fsal_append(const char *path,
+                         const void *buf,
+                         size_t len);
+
+// Sets the size of the file at path to size bytes, freeing the blocks
+// past the new end or adding zeroed blocks up to it.
+//
+// returns 0 if the operation completed succefully. 
+// Otherwise, the errors of ext2_fsal_write.
+int32_t ext2_fsal_truncate(const char *path,
+                           uint64_t size);
 
@@ -27,11 +27,13 @@
  * Copies a file from the host filesystem to the ext2 filesystem.
  *
  * src: path to source file on host filesystem
- * dst: path to destination in ext2 filesystem
+ * dir: directory handle a relative dst starts at, or NULL
+ * dst: path to destination in ext2 filesystem; absolute unless dir 
+ *      is given
  * 
  * Returns: 0 on success, errno on error.
  */
-int32_t ext2_fsal_cp(const char *src, const char *dst) {
+int32_t copy_file(const char *src, const struct ext2_fsal_dir *dir, const char *dst) {
 	
 	if (src == NULL || dst == NULL) return ENOENT;
 
@@ -42,10 +44,10 @@ int32_t ext2_fsal_cp(const char *src, const char *dst) {
 	if (src_fd < 0) return errno;
 
 	// STEP 2: parse destination path
-	int parent_ino;
+	int parent_ino, existing;
 	char name[EXT2_NAME_LEN];
 
-	int retval = resolve_copy_destination(dst, src, &parent_ino, name);
+	int retval = resolve_copy_destination(dir, dst, src, &parent_ino, name, &existing);
 	if (retval != 0) {
 		close(src_fd);
 		return retval;
@@ -53,44 +55,39 @@ int32_t ext2_fsal_cp(const char *src, const char *dst) {
 
 	// STEP 3: handle existing target
 	int target_ino, overwrite;
-	retval = check_copy_target(src, &parent_ino, name, &target_ino, &overwrite);
+	retval = check_copy_target(src, &parent_ino, name, existing, &target_ino, &overwrite);
 	if (retval != 0) {
 		close(src_fd);
 		return retval;
 	}
 
-	// STEP 4: allocate or reuse inode
-	int use_ino;
-	if (overwrite && target_ino > 0) {
-		free_inode_blocks_locked(target_ino);
-		use_ino = target_ino;
-	}
-	else {
-		use_ino = alloc_inode();
-		if (use_ino < 0) {
-			close(src_fd);
-			return ENOSPC;
-		}
+	if (lseek(src_fd, 0, SEEK_SET) < 0) {
+		close(src_fd);
+		return EIO;
 	}
 
-	// STEP 5: initialize inode and write file data
-	struct ext2_inode new_inode;
-	init_file_inode(&new_inode);
+	// STEP 4: an existing file is rewritten in place
+	if (overwrite) {
+		retval = overwrite_file_data(src_fd, target_ino, filesize);
+		close(src_fd);
+		return retval;
+	}
 
-	if (lseek(src_fd, 0, SEEK_SET) < 0) {
+	// STEP 5: allocate inode, initialize it and write file data
+	int use_ino = alloc_inode();
+	if (use_ino < 0) {
 		close(src_fd);
-		if (!overwrite) free_inode(use_ino);
-		return EIO;
+		return ENOSPC;
 	}
 
-	int write_retval = write_data_into_inode(src_fd, &new_inode, filesize);
+	struct ext2_inode new_inode;
+	init_file_inode(&new_inode);
 
+	int write_retval = write_data_into_inode(src_fd, &new_inode, filesize);
 	if (write_retval != 0) {
 		close(src_fd);
-		if (!overwrite) {
-			free_inode_blocks_locked(use_ino);
-			free_inode(use_ino);
-		}
+		free_inode_blocks_locked(use_ino);
+		free_inode(use_ino);
 		return write_retval;
 	}
 
@@ -98,17 +95,35 @@ int32_t ext2_fsal_cp(const char *src, const char *dst) {
 	write_inode(use_ino, &new_inode);
 
 	// STEP 7: add directory entry for new file
-	if (!overwrite) {
-		int add_retval = add_dir_entry(parent_ino, name, use_ino, EXT2_FT_REG_FILE);
-		if (add_retval != 0) {
-			free_inode_blocks_locked(use_ino);
-			free_inode(use_ino);
-			close(src_fd);
-			return add_retval;
-		}
+	int add_retval = add_dir_entry(parent_ino, name, use_ino, EXT2_FT_REG_FILE);
+	if (add_retval != 0) {
+		free_inode_blocks_locked(use_ino);
+		free_inode(use_ino);
+		close(src_fd);
+		return add_retval;
 	}
 
 	close(src_fd);
 	return 0;
 
 }
+
+/*
+ * Copies host file src to dst; see copy_file.
+ */
+int32_t ext2_fsal_cp(const char *src, const char *dst) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_CP, OP_REPLAY, src, dst);
+	if (retval == 0) retval = copy_file(src, NULL, dst);
+	return op_end(&c, retval);
+}
+
+/*
+ * Like ext2_fsal_cp, with dst relative to dir.
+ */
+int32_t ext2_fsal_cp_at(const char *src, const struct ext2_fsal_dir *dir, const char *dst) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_CP, 0, src, dst);
+	if (retval == 0) retval = copy_file(src, dir, dst);
+	return op_end(&c, retval);
+}
@@ -0,0 +1,374 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+#include "ext2fsal.h"
+#include "e2fs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// upper bound on copy worker threads
+#define IMPORT_MAX_WORKERS 8
+
+/*
+ * One regular file to be copied into the image.
+ */
+struct import_job {
+	char *host_path;        // source path on the host
+	int parent_ino;         // destination directory inode
+	char name[EXT2_NAME_LEN];
+	off_t size;
+	int ino;                // pre-reserved inode
+	int first_block;        // offset of its slice in the block batch
+	int nblocks;            // length of its slice
+};
+
+/*
+ * State shared by the enumeration pass and the copy workers.
+ */
+struct import_state {
+	struct import_job *jobs;
+	int count;
+	int cap;
+
+	int *blocks;            // pre-reserved blocks, sliced per job
+	int next_job;           // claimed with an atomic fetch-add
+	int error;              // first error seen by any worker
+};
+
+/*
+ * Records a regular file to be copied later.
+ *
+ * Returns: 0 on success, ENOMEM on failure.
+ */
+static int add_job(struct import_state *st, const char *host_path, 
+		int parent_ino, const char *name, off_t size) {
+
+	if (st->count == st->cap) {
+		int cap = st->cap ? st->cap * 2 : 64;
+		struct import_job *jobs = realloc(st->jobs, sizeof(*jobs) * cap);
+		if (jobs == NULL) return ENOMEM;
+		st->jobs = jobs;
+		st->cap = cap;
+	}
+
+	struct import_job *job = &st->jobs[st->count];
+	job->host_path = strdup(host_path);
+	if (job->host_path == NULL) return ENOMEM;
+
+	job->parent_ino = parent_ino;
+	strncpy(job->name, name, EXT2_NAME_LEN);
+	job->name[EXT2_NAME_LEN - 1] = '\0';
+	job->size = size;
+	job->ino = -1;
+
+	st->count++;
+	return 0;
+}
+
+/*
+ * Returns dir_ino's child directory called name, creating it if it 
+ * does not exist yet.
+ *
+ * Returns: 0 on success, errno on error.
+ */
+static int ensure_directory(int dir_ino, const char *name, int *child_ino) {
+	struct ext2_inode *dir = get_inode(dir_ino);
+	int child = find_dir_entry(dir, name);
+
+	if (child < 0) {
+		int retval = create_directory(dir_ino, name, &child);
+		if (retval == EEXIST) child = find_dir_entry(dir, name);
+		else if (retval != 0) return retval;
+		if (child < 0) return ENOENT;
+	}
+
+	if (!S_ISDIR(get_inode(child)->i_mode)) return EEXIST;
+
+	*child_ino = child;
+	return 0;
+}
+
+/*
+ * Enumerates host directory host_dir depth first, mirroring its 
+ * directories under dir_ino immediately and queueing its regular 
+ * files for the copy phase. Other file types are skipped.
+ *
+ * Returns: 0 on success, errno on error.
+ */
+static int build_skeleton(struct import_state *st, const char *host_dir, int dir_ino) {
+	DIR *d = opendir(host_dir);
+	if (d == NULL) return ENOENT;
+
+	int retval = 0;
+	struct dirent *de;
+
+	while (retval == 0 && (de = readdir(d)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) 
+			continue;
+
+		if (strlen(de->d_name) >= EXT2_NAME_LEN) {
+			retval = ENAMETOOLONG;
+			break;
+		}
+
+		char child_path[PATH_MAX];
+		if (snprintf(child_path, PATH_MAX, "%s/%s", host_dir, de->d_name) >= PATH_MAX) {
+			retval = ENAMETOOLONG;
+			break;
+		}
+
+		struct stat sb;
+		if (lstat(child_path, &sb) < 0) continue;
+
+		if (S_ISDIR(sb.st_mode)) {
+			int child_ino;
+			retval = ensure_directory(dir_ino, de->d_name, &child_ino);
+			if (retval == 0) retval = build_skeleton(st, child_path, child_ino);
+		}
+		else if (S_ISREG(sb.st_mode)) {
+			retval = add_job(st, child_path, dir_ino, de->d_name, sb.st_size);
+		}
+	}
+
+	closedir(d);
+	return retval;
+}
+
+/*
+ * Copies one queued file using its pre-reserved inode and blocks, and
+ * links it into its directory.
+ *
+ * Returns: 0 on success, errno on error.
+ */
+static int import_one(struct import_state *st, struct import_job *job) {
+	int fd = open(job->host_path, O_RDONLY);
+	if (fd < 0) return ENOENT;
+
+	struct block_reserve res = { st->blocks + job->first_block, job->nblocks, 0 };
+	struct ext2_inode new_inode;
+	init_file_inode(&new_inode);
+
+	int retval = write_data_into_inode_reserved(fd, &new_inode, job->size, &res);
+	close(fd);
+	if (retval != 0) return retval;
+
+	write_inode(job->ino, &new_inode);
+
+	return add_dir_entry(job->parent_ino, job->name, job->ino, EXT2_FT_REG_FILE);
+}
+
+/*
+ * Copy worker: claims jobs until none are left. A job that fails 
+ * keeps its inode and blocks marked (ino stays > 0) so the caller 
+ * can release them. Workers run inside the caller's reclamation 
+ * section, which outlives them.
+ */
+static void *import_worker(void *arg) {
+	struct import_state *st = arg;
+
+	while (1) {
+		int i = __atomic_fetch_add(&st->next_job, 1, __ATOMIC_RELAXED);
+		if (i >= st->count) break;
+
+		struct import_job *job = &st->jobs[i];
+		int retval = import_one(st, job);
+
+		if (retval == 0) {
+			job->ino = -1;  // now owned by the filesystem
+		}
+		else {
+			int expected = 0;
+			__atomic_compare_exchange_n(&st->error, &expected, retval, 0, 
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Reserves inodes and blocks for every queued file in two batches and
+ * assigns each job its inode and a contiguous slice of the blocks.
+ *
+ * Returns: 0 on success, errno on error (nothing stays reserved).
+ */
+static int reserve_for_jobs(struct import_state *st) {
+	int total_blocks = 0;
+	for (int i = 0; i < st->count; i++) {
+		st->jobs[i].first_block = total_blocks;
+		st->jobs[i].nblocks = blocks_for_size(st->jobs[i].size);
+		total_blocks += st->jobs[i].nblocks;
+	}
+
+	int *inos = malloc(sizeof(int) * (st->count + 1));
+	st->blocks = malloc(sizeof(int) * (total_blocks + 1));
+	if (inos == NULL || st->blocks == NULL) {
+		free(inos);
+		return ENOMEM;
+	}
+
+	int retval = alloc_inodes_batch(st->count, inos);
+	if (retval == 0) {
+		retval = alloc_blocks_batch(total_blocks, st->blocks);
+		if (retval != 0) free_inodes_bulk(inos, st->count, 0);
+	}
+
+	if (retval == 0) {
+		for (int i = 0; i < st->count; i++) st->jobs[i].ino = inos[i];
+	}
+
+	free(inos);
+	return retval;
+}
+
+/*
+ * Returns the blocks and inodes of jobs that did not complete, plus 
+ * any reserved blocks they never consumed. Their inodes are marked 
+ * deleted, as by free_inode.
+ */
+static void release_failed_jobs(struct import_state *st) {
+	int nblocks = 0, ninos = 0;
+	int *inos = malloc(sizeof(int) * (st->count + 1));
+	if (inos == NULL) return;
+
+	for (int i = 0; i < st->count; i++) {
+		struct import_job *job = &st->jobs[i];
+		if (job->ino <= 0) continue;
+
+		// the failed job's slice is still exclusively its own
+		memmove(st->blocks + nblocks, st->blocks + job->first_block, 
+				sizeof(int) * job->nblocks);
+		nblocks += job->nblocks;
+		inos[ninos++] = job->ino;
+
+		// the inode may have been written before linking failed; it 
+		// must not look live once its bit is clear
+		struct ext2_inode *dead = get_inode(job->ino);
+		dead->i_links_count = 0;
+		dead->i_dtime = (uint32_t)time(NULL);
+	}
+
+	free_blocks_bulk(st->blocks, nblocks);
+	free_inodes_bulk(inos, ninos, 0);
+	free(inos);
+}
+
+/*
+ * Imports a host directory tree into the ext2 filesystem:
+ *
+ * - Creates the destination (and missing parents) like mkdir -p; an
+ *   existing directory receives a subdirectory named after src.
+ * - Enumerates the host tree once, creating the whole directory 
+ *   skeleton and queueing regular files.
+ * - Reserves inodes and blocks for all files in two bulk batches.
+ * - Copies file data on up to IMPORT_MAX_WORKERS threads, each file 
+ *   drawing from its own slice of the reservation.
+ *
+ * A regular file src is copied as by ext2_fsal_cp.
+ *
+ * src: path to the source directory on the host filesystem
+ * dst: absolute path of the destination in the ext2 filesystem
+ *
+ * Returns: 0 on success, errno on error (the first one seen).
+ */
+static int32_t do_cp_r(const char *src, const char *dst) {
+
+	if (src == NULL || dst == NULL) return ENOENT;
+	if (dst[0] != '/') return ENOENT;
+
+	struct stat sb;
+	if (stat(src, &sb) < 0) return ENOENT;
+	if (!S_ISDIR(sb.st_mode)) return copy_file(src, NULL, dst);
+
+	// pick the destination directory: into dst if it exists
+	char target[PATH_MAX];
+	int dst_ino = path_lookup(dst);
+	if (dst_ino >= 0) {
+		if (!S_ISDIR(get_inode(dst_ino)->i_mode)) return EEXIST;
+
+		char src_copy[PATH_MAX];
+		strncpy(src_copy, src, PATH_MAX - 1);
+		src_copy[PATH_MAX - 1] = '\0';
+		strip_trailing_slashes(src_copy);
+
+		const char *base = get_path_basename(src_copy);
+		if (strlen(base) >= EXT2_NAME_LEN) return ENAMETOOLONG;
+		if (snprintf(target, PATH_MAX, "%s/%s", dst, base) >= PATH_MAX) 
+			return ENAMETOOLONG;
+	}
+	else {
+		strncpy(target, dst, PATH_MAX - 1);
+		target[PATH_MAX - 1] = '\0';
+	}
+
+	int root_ino;
+	int retval = make_dirs(target, &root_ino);
+	if (retval != 0) return retval;
+
+	// PHASE 1: directory skeleton and file list
+	struct import_state st;
+	memset(&st, 0, sizeof(st));
+
+	retval = build_skeleton(&st, src, root_ino);
+
+	// PHASE 2: reserve and copy files in parallel
+	if (retval == 0 && st.count > 0) {
+		retval = reserve_for_jobs(&st);
+	}
+
+	if (retval == 0 && st.count > 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		int nworkers = cpus > 0 ? (int)cpus : 1;
+		if (nworkers > IMPORT_MAX_WORKERS) nworkers = IMPORT_MAX_WORKERS;
+		if (nworkers > st.count) nworkers = st.count;
+
+		pthread_t workers[IMPORT_MAX_WORKERS];
+		int started = 0;
+		for (int i = 0; i < nworkers; i++) {
+			if (pthread_create(&workers[i], NULL, import_worker, &st) != 0) break;
+			started++;
+		}
+
+		// no threads available: copy on the calling thread
+		if (started == 0) import_worker(&st);
+
+		for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+
+		retval = st.error;
+		release_failed_jobs(&st);
+	}
+
+	for (int i = 0; i < st.count; i++) free(st.jobs[i].host_path);
+	free(st.jobs);
+	free(st.blocks);
+	return retval;
+}
+
+/*
+ * Copies host tree src to dst; see do_cp_r.
+ */
+int32_t ext2_fsal_cp_r(const char *src, const char *dst) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_CP_R, OP_REPLAY, src, dst);
+	if (retval == 0) retval = do_cp_r(src, dst);
+	return op_end(&c, retval);
+}
@@ -0,0 +1,322 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+#include "ext2fsal.h"
+#include "e2fs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*
+ * A copy in progress. Its inode and blocks are reserved at begin and
+ * stay unreachable until commit, so chunks are written without locks.
+ */
+struct ext2_fsal_cp_stream {
+	struct ext2_fsal_dir parent;   // directory the file goes in
+	char name[EXT2_NAME_LEN];
+	int ino;                       // reserved inode
+	off_t size;                    // bytes announced at begin
+	off_t written;                 // bytes received so far
+	int nblocks;                   // reserved blocks, indirect included
+	int blocks[MAX_INODE_BLOCKS];  // as allocated: direct, indirect, rest
+	uint64_t busy_ns;              // time spent inside the calls
+};
+
+/*
+ * Returns: the block holding data block k (0-based) of the file s is
+ * writing, skipping the indirect block.
+ */
+static int data_block(struct ext2_fsal_cp_stream *s, int k) {
+	return k < DIRECT_POINTERS ? s->blocks[k] : s->blocks[k + 1];
+}
+
+/*
+ * Returns the reserved blocks and inode of s and frees it.
+ */
+static void release_stream(struct ext2_fsal_cp_stream *s) {
+	free_blocks_bulk(s->blocks, s->nblocks);
+	free_inode(s->ino);
+	free(s);
+}
+
+/*
+ * Starts a copy of size bytes to dst:
+ *
+ * - Resolves dst; it must name a new file or an existing regular 
+ *   file, since there is no source name to copy into a directory with.
+ * - Reserves the inode and every block (data plus indirect) in one 
+ *   batch each, so writes never allocate and commit cannot run out.
+ *
+ * Returns: 0 on success, errno on error.
+ */
+static int32_t do_cp_begin(const struct ext2_fsal_dir *dir, const char *dst, uint64_t size,
+		struct ext2_fsal_cp_stream **out) {
+
+	if (dst == NULL) return ENOENT;
+	if (out == NULL) return EINVAL;
+	if (dir == NULL && dst[0] != '/') return ENOENT;
+
+	// one inode maps its direct blocks plus one indirect block's worth
+	uint64_t max = (uint64_t)(DIRECT_POINTERS + EXT2_BLOCK_SIZE / 4) << block_shift;
+	if (size > max) return EFBIG;
+
+	struct path_res r;
+	int retval = resolve_at(dir, dst, &r);
+	if (retval != 0) return retval;
+
+	if (r.trailing_slash || r.name[0] == '\0') {
+		if (r.ino < 0 || !S_ISDIR(get_inode(r.ino)->i_mode)) return ENOENT;
+		return EISDIR;
+	}
+	if (r.ino >= 0) {
+		uint16_t mode = get_inode(r.ino)->i_mode;
+		if (S_ISDIR(mode)) return EISDIR;
+		if ((mode & 0xF000) != EXT2_S_IFREG) return EEXIST;
+	}
+
+	struct ext2_fsal_cp_stream *s = calloc(1, sizeof(*s));
+	if (s == NULL) return ENOMEM;
+
+	s->parent.ino = r.parent_ino;
+	s->parent.generation = get_inode(r.parent_ino)->i_generation;
+	strcpy(s->name, r.name);
+	s->size = (off_t)size;
+
+	s->ino = alloc_inode();
+	if (s->ino < 0) {
+		free(s);
+		return ENOSPC;
+	}
+
+	s->nblocks = blocks_for_size(s->size);
+	if (alloc_blocks_batch(s->nblocks, s->blocks) != 0) {
+		s->nblocks = 0;
+		release_stream(s);
+		return ENOSPC;
+	}
+
+	// the chunks will stream through these in order
+	if (s->nblocks > 0) map_prefetch(s->blocks[0], s->nblocks);
+
+	*out = s;
+	return 0;
+}
+
+/*
+ * Copies the next len bytes of the file from buf into the reserved 
+ * blocks. A block is zeroed behind the data when it is first 
+ * written, so the tail of the last one needs no extra pass.
+ *
+ * Returns: 0 on success, EINVAL if the data would exceed the size 
+ * given at begin.
+ */
+static int32_t do_cp_write(struct ext2_fsal_cp_stream *s, const void *buf, size_t len) {
+	if ((off_t)len > s->size - s->written) return EINVAL;
+
+	const char *src = buf;
+	while (len > 0) {
+		int k = (int)(s->written >> block_shift);
+		int off = (int)(s->written & (EXT2_BLOCK_SIZE - 1));
+		int n = EXT2_BLOCK_SIZE - off;
+		if ((size_t)n > len) n = (int)len;
+
+		int b = data_block(s, k);
+		char *blk = off == 0 ? get_block_new(b) : get_block(b);
+		memcpy(blk + off, src, n);
+		if (off == 0 && n < EXT2_BLOCK_SIZE) memset(blk + n, 0, EXT2_BLOCK_SIZE - n);
+		put_block(b, 1);
+
+		src += n;
+		len -= n;
+		s->written += n;
+	}
+
+	return 0;
+}
+
+/*
+ * Gives existing regular file ino the block map, size and block count
+ * of new_inode, then frees its old blocks.
+ *
+ * Returns: 0 on success, ENOENT if the file was removed meanwhile.
+ */
+static int replace_file_data(int ino, struct ext2_inode *new_inode) {
+	int old[MAX_INODE_BLOCKS];
+
+	mutex_lock(&inode_locks[ino - 1]);
+	struct ext2_inode *inode = get_inode(ino);
+	if (inode->i_links_count == 0 || inode->i_dtime != 0) {
+		mutex_unlock(&inode_locks[ino - 1]);
+		return ENOENT;
+	}
+
+	int n = collect_inode_blocks(inode, old);
+	memcpy(inode->i_block, new_inode->i_block, sizeof(inode->i_block));
+	inode->i_size = new_inode->i_size;
+	inode->i_blocks = new_inode->i_blocks;
+	inode->i_mtime = new_inode->i_ctime;
+	mutex_unlock(&inode_locks[ino - 1]);
+
+	free_blocks_bulk(old, n);
+	return 0;
+}
+
+/*
+ * Finishes the copy s:
+ *
+ * - Checks that the directory it goes in is still the one resolved at
+ *   begin (see check_dir_handle).
+ * - Writes the indirect block and builds the inode.
+ * - Links the reserved inode under its name, or, if a regular file 
+ *   has the name by now, swaps the new blocks into it and frees the
+ *   old ones together with the unused inode.
+ *
+ * On error everything reserved is released. s is freed either way.
+ *
+ * Returns: 0 on success, errno on error (EINVAL if fewer bytes were
+ * written than announced, ENOENT if the directory is gone).
+ */
+static int32_t do_cp_commit(struct ext2_fsal_cp_stream *s) {
+	if (s->written != s->size) {
+		release_stream(s);
+		return EINVAL;
+	}
+
+	// the directory may have been removed, and its inode reused, since
+	// begin
+	if (check_dir_handle(&s->parent) != 0) {
+		release_stream(s);
+		return ENOENT;
+	}
+
+	struct ext2_inode new_inode;
+	init_file_inode(&new_inode);
+
+	int data_blocks = s->nblocks - (s->nblocks > DIRECT_POINTERS ? 1 : 0);
+	for (int k = 0; k < data_blocks && k < DIRECT_POINTERS; k++) 
+		new_inode.i_block[k] = s->blocks[k];
+
+	if (data_blocks > DIRECT_POINTERS) {
+		uint32_t ptrs[EXT2_MAX_BLOCK_SIZE / sizeof(uint32_t)];
+		memset(ptrs, 0, sizeof(ptrs));
+		for (int k = DIRECT_POINTERS; k < data_blocks; k++) 
+			ptrs[k - DIRECT_POINTERS] = data_block(s, k);
+
+		new_inode.i_block[INDIRECT_INDEX] = s->blocks[DIRECT_POINTERS];
+		write_block(s->blocks[DIRECT_POINTERS], (char *)ptrs);
+	}
+
+	new_inode.i_size = s->size;
+	new_inode.i_blocks = s->nblocks * (EXT2_BLOCK_SIZE / 512);
+
+	// a file created at the name since begin is overwritten, as cp would
+	int retval;
+	int existing = find_dir_entry(get_inode(s->parent.ino), s->name);
+	if (existing < 0) {
+		write_inode(s->ino, &new_inode);
+		retval = add_dir_entry(s->parent.ino, s->name, s->ino, EXT2_FT_REG_FILE);
+	}
+	else if ((get_inode(existing)->i_mode & 0xF000) != EXT2_S_IFREG) {
+		retval = S_ISDIR(get_inode(existing)->i_mode) ? EISDIR : EEXIST;
+	}
+	else {
+		retval = replace_file_data(existing, &new_inode);
+		if (retval == 0) {
+			free_inode(s->ino);
+			free(s);
+			return 0;
+		}
+	}
+
+	if (retval != 0) {
+		release_stream(s);
+		return retval;
+	}
+
+	free(s);
+	return 0;
+}
+
+/*
+ * Starts a streamed copy; see ext2fsal.h. Streams are not traced: a
+ * replay would have no data to feed them. Each call is admitted as a
+ * bulk operation (see qos.c); only this first one can be refused.
+ */
+int32_t ext2_fsal_cp_begin(const struct ext2_fsal_dir *dir, const char *dst, uint64_t size,
+		struct ext2_fsal_cp_stream **stream) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_CP_STREAM, OP_NO_STATS, dst, NULL);
+	if (retval == 0) retval = do_cp_begin(dir, dst, size, stream);
+	op_end(&c, retval);
+
+	if (retval == 0 && c.start != 0) (*stream)->busy_ns = stats_now() - c.start;
+	return retval;
+}
+
+/*
+ * Runs do_cp_write once admitted, counting it as a data copy phase.
+ */
+int32_t ext2_fsal_cp_write(struct ext2_fsal_cp_stream *stream, const void *buf, size_t len) {
+	if (stream == NULL) return EINVAL;
+
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_CP_STREAM, OP_NO_REJECT | OP_NO_STATS,
+			stream->name, NULL);
+	if (retval == 0) retval = do_cp_write(stream, buf, len);
+	op_end(&c, retval);
+
+	stats_phase_done(EXT2_FSAL_PHASE_DATA_COPY, c.start);
+	if (c.start != 0) stream->busy_ns += stats_now() - c.start;
+	return retval;
+}
+
+/*
+ * Runs do_cp_commit. The stream's latency in the operation statistics
+ * is the time spent inside its calls, not the time the caller took to
+ * deliver the data.
+ */
+int32_t ext2_fsal_cp_commit(struct ext2_fsal_cp_stream *stream) {
+	if (stream == NULL) return EINVAL;
+
+	// the stream is gone once do_cp_commit returns
+	char name[EXT2_NAME_LEN];
+	strcpy(name, stream->name);
+	uint64_t busy_ns = stream->busy_ns;
+
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_CP_STREAM, OP_NO_REJECT, name, NULL);
+	if (retval == 0) retval = do_cp_commit(stream);
+
+	// count the earlier calls of the stream as part of this one
+	if (c.start != 0) c.start -= busy_ns;
+	return op_end(&c, retval);
+}
+
+/*
+ * Abandons the copy: releases what begin reserved and frees stream.
+ */
+void ext2_fsal_cp_abort(struct ext2_fsal_cp_stream *stream) {
+	if (stream == NULL) return;
+
+	char name[EXT2_NAME_LEN];
+	strcpy(name, stream->name);
+
+	trace_enter(EXT2_FSAL_OP_CP_STREAM, name, NULL);
+	release_stream(stream);
+	blockdev_op_done();
+	trace_exit(0, EXT2_FSAL_OP_CP_STREAM, name, NULL, 0);
+}
@@ -0,0 +1,317 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+#include "ext2fsal.h"
+#include "e2fs.h"
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define DEFAULT_BUDGET_US 1000
+
+/*
+ * State of one defrag call.
+ */
+struct defrag_run {
+	struct ext2_fsal_defrag_stats st;
+	uint64_t budget_ns;        // work per slice, 0 for no pauses
+	uint64_t slice_start;
+};
+
+/*
+ * Growable stack of inode numbers.
+ */
+struct ino_list {
+	int *items;
+	int count;
+	int cap;
+};
+
+/*
+ * Appends ino to list.
+ *
+ * Returns: 0 on success, ENOMEM on failure.
+ */
+static int ino_list_push(struct ino_list *list, int ino) {
+	if (list->count == list->cap) {
+		int cap = list->cap ? list->cap * 2 : 64;
+		int *items = realloc(list->items, sizeof(int) * cap);
+		if (items == NULL) return ENOMEM;
+		list->items = items;
+		list->cap = cap;
+	}
+	list->items[list->count++] = ino;
+	return 0;
+}
+
+static uint64_t mono_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Pauses for one slice once the current slice of work is used up, so
+ * that other operations get the locks and the CPU back. The pause is
+ * not a quiescent point for reclamation: the walk's queued inode
+ * numbers are only safe to use because its section keeps removed
+ * inodes from being reused.
+ */
+static void throttle(struct defrag_run *r) {
+	if (r->budget_ns == 0) return;
+
+	uint64_t now = mono_ns();
+	if (now - r->slice_start < r->budget_ns) return;
+
+	struct timespec ts = { r->budget_ns / 1000000000ULL, r->budget_ns % 1000000000ULL };
+	nanosleep(&ts, NULL);
+	r->slice_start = mono_ns();
+	r->st.throttle_ns += r->slice_start - now;
+}
+
+/*
+ * Lists the blocks of inode in layout order: the direct blocks, then
+ * the indirect block followed by the blocks it maps (the order
+ * write_data_into_inode allocates them in). out must hold
+ * MAX_INODE_BLOCKS entries. The caller must hold the inode's lock.
+ *
+ * Returns: the number of blocks, or -1 if the map has holes or uses
+ * double or triple indirect blocks (left alone).
+ */
+static int layout_blocks(struct ext2_inode *inode, int *out) {
+	int n = 0;
+	int hole = 0;
+
+	if (inode->i_block[INDIRECT_INDEX + 1] != 0 || inode->i_block[INDIRECT_INDEX + 2] != 0)
+		return -1;
+
+	for (int i = 0; i < DIRECT_POINTERS; i++) {
+		if (inode->i_block[i] == 0) hole = 1;
+		else if (hole) return -1;
+		else out[n++] = inode->i_block[i];
+	}
+
+	int indirect_blk = inode->i_block[INDIRECT_INDEX];
+	if (indirect_blk == 0) return n;
+	if (hole) return -1;
+	out[n++] = indirect_blk;
+
+	uint32_t *ptrs = (uint32_t *) get_block(indirect_blk);
+	int per_block = EXT2_BLOCK_SIZE / sizeof(uint32_t);
+	for (int i = 0; i < per_block; i++) {
+		if (ptrs[i] == 0) hole = 1;
+		else if (hole) n = -1;
+		else if (n >= 0) out[n++] = ptrs[i];
+	}
+	put_block(indirect_blk, 0);
+	return n;
+}
+
+/*
+ * Returns: the number of runs of consecutive block numbers in the n
+ * blocks of blocks.
+ */
+static int count_extents(int *blocks, int n) {
+	int extents = n > 0 ? 1 : 0;
+	for (int i = 1; i < n; i++) {
+		if (blocks[i] != blocks[i - 1] + 1) extents++;
+	}
+	return extents;
+}
+
+/*
+ * Moves regular file ino into a single run of free blocks if its
+ * blocks are fragmented. The data is copied into the new run and the
+ * block map (i_block and the indirect block) switched over while the
+ * file's inode lock is held, so no other operation sees a partial
+ * move; the old blocks are freed afterwards. A file that no longer
+ * exists by the time it is locked is skipped silently.
+ */
+static void defrag_file(struct defrag_run *r, int ino) {
+	int old[MAX_INODE_BLOCKS];
+
+	mutex_lock(&inode_locks[ino - 1]);
+	struct ext2_inode *inode = get_inode(ino);
+
+	if (!S_ISREG(inode->i_mode) || inode->i_links_count == 0 || inode->i_dtime != 0) {
+		mutex_unlock(&inode_locks[ino - 1]);
+		return;
+	}
+
+	int n = layout_blocks(inode, old);
+	if (n < 0) {
+		mutex_unlock(&inode_locks[ino - 1]);
+		return;
+	}
+
+	int extents = count_extents(old, n);
+	r->st.files++;
+	r->st.extents_before += extents;
+
+	// already contiguous, or nowhere to put it
+	int first = extents > 1 ? alloc_block_run(n) : -1;
+	if (first < 0) {
+		if (extents > 1) r->st.skipped++;
+		r->st.extents_after += extents;
+		mutex_unlock(&inode_locks[ino - 1]);
+		return;
+	}
+
+	// copy the data blocks; the indirect block is rebuilt instead
+	map_prefetch(first, n);
+	for (int k = 0; k < n; k++) {
+		if (k == DIRECT_POINTERS) continue;
+		write_block(first + k, get_block(old[k]));
+		put_block(old[k], 0);
+	}
+
+	if (n > DIRECT_POINTERS) {
+		uint32_t ptrs[EXT2_MAX_BLOCK_SIZE / sizeof(uint32_t)];
+		memset(ptrs, 0, sizeof(ptrs));
+		for (int k = DIRECT_POINTERS + 1; k < n; k++)
+			ptrs[k - DIRECT_POINTERS - 1] = first + k;
+		write_block(first + DIRECT_POINTERS, (char *)ptrs);
+		inode->i_block[INDIRECT_INDEX] = first + DIRECT_POINTERS;
+	}
+	for (int k = 0; k < n && k < DIRECT_POINTERS; k++) inode->i_block[k] = first + k;
+
+	mutex_unlock(&inode_locks[ino - 1]);
+
+	free_blocks_bulk(old, n);
+
+	r->st.moved++;
+	r->st.blocks_moved += n;
+	r->st.extents_after += 1;
+}
+
+/*
+ * Defragments every regular file beneath directory root_ino, one
+ * directory at a time: the children of a directory are recorded
+ * under its inode lock, then each file is moved with only its own
+ * inode locked.
+ *
+ * Returns: 0 on success, ENOMEM if the work lists cannot grow.
+ */
+static int defrag_tree(struct defrag_run *r, int root_ino) {
+	struct ino_list dirs = { NULL, 0, 0 };
+	struct ino_list files = { NULL, 0, 0 };
+	int retval = ino_list_push(&dirs, root_ino);
+
+	while (retval == 0 && dirs.count > 0) {
+		int dir_ino = dirs.items[--dirs.count];
+		struct ext2_inode *dir = get_inode(dir_ino);
+
+		mutex_lock(&inode_locks[dir_ino - 1]);
+
+		// removed since it was recorded
+		if (!S_ISDIR(dir->i_mode) || dir->i_dtime != 0) {
+			mutex_unlock(&inode_locks[dir_ino - 1]);
+			continue;
+		}
+
+		// record children, skipping "." and ".."
+		files.count = 0;
+		for (int i = 0; i < DIRECT_POINTERS && retval == 0; i++) {
+			int block_num = dir->i_block[i];
+			if (block_num == 0) continue;
+
+			uint8_t *blk_start = (uint8_t *)get_block(block_num);
+			uint8_t *blk_end = blk_start + EXT2_BLOCK_SIZE;
+			struct ext2_dir_entry *entry = (struct ext2_dir_entry *)blk_start;
+
+			while ((uint8_t *)entry < blk_end && entry->rec_len > 0) {
+				if (entry->inode != 0 &&
+				    !(entry->name_len == 1 && entry->name[0] == '.') &&
+				    !(entry->name_len == 2 && entry->name[0] == '.' && entry->name[1] == '.')) {
+
+					if (entry->file_type == EXT2_FT_DIR)
+						retval = ino_list_push(&dirs, entry->inode);
+					else if (entry->file_type == EXT2_FT_REG_FILE)
+						retval = ino_list_push(&files, entry->inode);
+
+					if (retval != 0) break;
+				}
+				entry = next_dir_entry(entry);
+			}
+			put_block(block_num, 0);
+		}
+
+		mutex_unlock(&inode_locks[dir_ino - 1]);
+
+		for (int i = 0; i < files.count; i++) {
+			defrag_file(r, files.items[i]);
+			throttle(r);
+		}
+	}
+
+	free(dirs.items);
+	free(files.items);
+	return retval;
+}
+
+/*
+ * Defragments the file at path, or every regular file beneath it if
+ * it is a directory.
+ *
+ * - Files are examined one at a time; a file whose blocks form more
+ *   than one extent is moved into the first free run long enough to
+ *   hold it (files for which there is none are skipped).
+ * - Only one file's inode lock (plus briefly the block bitmap lock)
+ *   is ever held, so other operations wait at most for one file move.
+ * - After each slice of EXT2FSAL_DEFRAG_BUDGET_US microseconds of
+ *   work the walk pauses for as long, bounding its share of the
+ *   server's time.
+ * - The number of files examined and moved and the extents before
+ *   and after are added to the defrag statistics.
+ *
+ * path: absolute path of a file or directory
+ *
+ * Returns: 0 on success, errno on error.
+ */
+static int32_t do_defrag(const char *path) {
+
+	// validate input path
+	if (!path) return ENOENT;
+	if (path[0] != '/') return ENOENT;
+
+	int ino = path_lookup(path);
+	if (ino < 0) return ENOENT;
+
+	struct defrag_run r;
+	memset(&r, 0, sizeof(r));
+
+	const char *budget = getenv("EXT2FSAL_DEFRAG_BUDGET_US");
+	r.budget_ns = (budget ? strtoull(budget, NULL, 10) : DEFAULT_BUDGET_US) * 1000ULL;
+	r.slice_start = mono_ns();
+
+	int retval = 0;
+	if (S_ISDIR(get_inode(ino)->i_mode)) retval = defrag_tree(&r, ino);
+	else defrag_file(&r, ino);
+
+	stats_defrag_done(&r.st);
+	return retval;
+}
+
+/*
+ * Defragments the tree at path; see do_defrag.
+ */
+int32_t ext2_fsal_defrag(const char *path) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_DEFRAG, OP_REPLAY, path, NULL);
+	if (retval == 0) retval = do_defrag(path);
+	return op_end(&c, retval);
+}
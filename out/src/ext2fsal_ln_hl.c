@@ -30,22 +30,21 @@
  * - Increments the source inode's link count
  *
  * src: absolute path to the source file
- * dst: absolute path for the new hard link
+ * dir: directory handle a relative dst starts at, or NULL
+ * dst: path for the new hard link; absolute unless dir is given
  * 
  * Returns: 0 on success, errno on error
  */
-int32_t ext2_fsal_ln_hl(const char *src, const char *dst) {
+static int32_t do_ln_hl(const char *src, const struct ext2_fsal_dir *dir, const char *dst) {
 
 	// validate input paths
 	if (!src || !dst) {
 		return ENOENT;
 	}
-	if (src[0] != '/' || dst[0] != '/') {
+	if (src[0] != '/' || (dir == NULL && dst[0] != '/')) {
 		return ENOENT;
 	}
 
-	char parent[PATH_MAX], name[EXT2_NAME_LEN];
-	
 	// lookup source file
 	int src_ino = path_lookup(src);
 	if (src_ino < 0) return ENOENT;
@@ -55,20 +54,14 @@ int32_t ext2_fsal_ln_hl(const char *src, const char *dst) {
 	// cannot create hard links for directories
 	if (S_ISDIR(src_inode->i_mode)) return EISDIR;
 
-	// parse destination path
-	if (split_parent_name(dst, parent, name) < 0) return ENOENT;
-
-	// lookup destination parent directory
-	int parent_ino = path_lookup(parent);
-	if (parent_ino < 0) return ENOENT;
-
-	struct ext2_inode *p_inode = get_inode(parent_ino);
-	if (!S_ISDIR(p_inode->i_mode)) return ENOENT;
+	// resolve destination parent directory and name
+	struct path_res d;
+	int retval = resolve_at(dir, dst, &d);
+	if (retval != 0) return retval;
 
-	// check if destination name already exists
-	int exists_ino = find_dir_entry(p_inode, name);
-	if (exists_ino >= 0) {
-		struct ext2_inode *exist_inode = get_inode(exists_ino);
+	// check if destination name already exists ("/" always does)
+	if (d.ino >= 0) {
+		struct ext2_inode *exist_inode = get_inode(d.ino);
 		// return EISDIR if target exists and is a directory
 		if (S_ISDIR(exist_inode->i_mode)) {
 			return EISDIR;
@@ -103,7 +96,7 @@ int32_t ext2_fsal_ln_hl(const char *src, const char *dst) {
 	mutex_unlock(&inode_locks[src_ino - 1]);
 
 	// add the directory entry
-	int retval = add_dir_entry(parent_ino, name, src_ino, file_type);
+	retval = add_dir_entry(d.parent_ino, d.name, src_ino, file_type);
 	if (retval != 0) {
 		// failed to add entry, decrement link count
 		mutex_lock(&inode_locks[src_ino - 1]);
@@ -114,3 +107,23 @@ int32_t ext2_fsal_ln_hl(const char *src, const char *dst) {
 
 	return 0;
 }
+
+/*
+ * Links dst to the file at src; see do_ln_hl.
+ */
+int32_t ext2_fsal_ln_hl(const char *src, const char *dst) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_LN_HL, OP_REPLAY, src, dst);
+	if (retval == 0) retval = do_ln_hl(src, NULL, dst);
+	return op_end(&c, retval);
+}
+
+/*
+ * Like ext2_fsal_ln_hl, with dst relative to dir.
+ */
+int32_t ext2_fsal_ln_hl_at(const char *src, const struct ext2_fsal_dir *dir, const char *dst) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_LN_HL, 0, src, dst);
+	if (retval == 0) retval = do_ln_hl(src, dir, dst);
+	return op_end(&c, retval);
+}
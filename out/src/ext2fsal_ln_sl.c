@@ -29,38 +29,30 @@
  * - Creates the symlink inode and directory entry.
  *
  * src: absolute target path (what the symlink points to)
- * dst: absolute path for the symlink
+ * dir: directory handle a relative dst starts at, or NULL
+ * dst: path for the symlink; absolute unless dir is given
  * 
  * Returns: 0 on success, errno on error.
  */
-int32_t ext2_fsal_ln_sl(const char *src, const char *dst) {
+static int32_t do_ln_sl(const char *src, const struct ext2_fsal_dir *dir, const char *dst) {
 
 	// validate input paths
 	if (!src || !dst) {
 		return ENOENT;
 	}
-	if (dst[0] != '/' || src[0] != '/') {
+	if ((dir == NULL && dst[0] != '/') || src[0] != '/') {
 		return ENOENT;  // paths must be absolute
 	}
 	
-	// parse destination path
-	char parent[PATH_MAX], name[EXT2_NAME_LEN];
-	int retval = split_parent_name(dst, parent, name);
+	// resolve destination parent directory and name
+	struct path_res d;
+	int retval = resolve_at(dir, dst, &d);
 	if (retval != 0) return retval;
-
-	// lookup destination parent directory
-	int parent_ino = path_lookup(parent);
-	if (parent_ino < 0) return errno;
-
-	// intermediate inodes should all be directories
-	struct ext2_inode *p_inode = get_inode(parent_ino);
-	if (!S_ISDIR(p_inode->i_mode)) return ENOENT;
+	if (d.name[0] == '\0') return ENOENT;
 	
 	// check if destination name already exists
-	int exists = find_dir_entry(p_inode, name);
-	
-	if (exists >= 0) {
-		struct ext2_inode *eino = get_inode(exists);
+	if (d.ino >= 0) {
+		struct ext2_inode *eino = get_inode(d.ino);
 		if (S_ISDIR(eino->i_mode)) return EISDIR;
 
 		// existing file (non-directory) with target name
@@ -89,16 +81,17 @@ int32_t ext2_fsal_ln_sl(const char *src, const char *dst) {
 	new_inode.i_ctime = (unsigned int)time(NULL);
 
 	// write target path to data block
-	char *blk = get_block(new_block);
+	char *blk = get_block_new(new_block);
 	memset(blk, 0, EXT2_BLOCK_SIZE);
 	memcpy(blk, src, strlen(src));
+	put_block(new_block, 1);
 	
 	// write inode to disk
 	write_inode(new_ino, &new_inode);
 	
 	// add symlink entry to parent directory
-	int add_retval = add_dir_entry(parent_ino, name, new_ino, EXT2_FT_SYMLINK);
-	if (add_retval < 0) {
+	int add_retval = add_dir_entry(d.parent_ino, d.name, new_ino, EXT2_FT_SYMLINK);
+	if (add_retval != 0) {
 		free_block(new_block);
 		free_inode(new_ino);
 		return add_retval;
@@ -106,3 +99,23 @@ int32_t ext2_fsal_ln_sl(const char *src, const char *dst) {
 	
 	return 0;
 }
+
+/*
+ * Makes dst a symbolic link to src; see do_ln_sl.
+ */
+int32_t ext2_fsal_ln_sl(const char *src, const char *dst) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_LN_SL, OP_REPLAY, src, dst);
+	if (retval == 0) retval = do_ln_sl(src, NULL, dst);
+	return op_end(&c, retval);
+}
+
+/*
+ * Like ext2_fsal_ln_sl, with dst relative to dir.
+ */
+int32_t ext2_fsal_ln_sl_at(const char *src, const struct ext2_fsal_dir *dir, const char *dst) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_LN_SL, 0, src, dst);
+	if (retval == 0) retval = do_ln_sl(src, dir, dst);
+	return op_end(&c, retval);
+}
@@ -28,36 +28,23 @@
  * - Adds an entry in the parent directory.
  * - Updates parent's link count.
  *
- * path: absolute path of the directory that is to be created.
+ * dir: directory handle a relative path starts at, or NULL
+ * path: path of the directory that is to be created; absolute unless
+ *       dir is given.
  * 
  * Returns: 0 on success, errno on error.
  */
-int32_t ext2_fsal_mkdir(const char *path) {
+static int32_t do_mkdir(const struct ext2_fsal_dir *dir, const char *path) {
 
-	// validate input path
-	if (path == NULL) return ENOENT;
-	if (path[0] != '/') {
-		return ENOENT;  // must be absolute path
-	}
-
-	// parse path into parent directory and target name
-	char parent_path[PATH_MAX];
-	char name[EXT2_NAME_LEN];
-	int retval = split_parent_name(path, parent_path, name);
+	// resolve parent directory and target name
+	struct path_res r;
+	int retval = resolve_at(dir, path, &r);
 	if (retval != 0) return retval;
-
-	// lookup parent directory inode
-	int parent_ino = path_lookup(parent_path);
-	if (parent_ino < 0) return errno;
-
-	// ensure parent is a directory - intermediate must be
-	struct ext2_inode *parent_inode = get_inode(parent_ino);
-	if (!S_ISDIR(parent_inode->i_mode)) return ENOENT;
+	if (r.name[0] == '\0') return ENOENT;
 
 	// check if target name already exists in parent
-	int existing = find_dir_entry(parent_inode, name);
-	if (existing >= 0) {
-		struct ext2_inode *exist_inode = get_inode(existing);
+	if (r.ino >= 0) {
+		struct ext2_inode *exist_inode = get_inode(r.ino);
 		
 		// if existing entry is a directory, return EEXIST
 		if (S_ISDIR(exist_inode->i_mode)) {
@@ -65,8 +52,7 @@ int32_t ext2_fsal_mkdir(const char *path) {
 		}
 		
 		// if path has trailing slash but is file
-		size_t parent_len = strlen(path);
-		if (parent_len > 1 && path[parent_len - 1] == '/') {
+		if (r.trailing_slash) {
 			return ENOENT;
 		}
 		
@@ -74,75 +60,49 @@ int32_t ext2_fsal_mkdir(const char *path) {
 		return EEXIST;
 	}
 
-	// existing == -1; not found, create directory
-
-	// allocate inode for the new directory
-	int new_ino = alloc_inode();
-	if (new_ino < 0) return ENOSPC;
-
-	// allocate data block for the directory contents
-	int new_block = alloc_block();
-	if (new_block < 0) {
-		free_inode(new_ino);
-		return ENOSPC;
-	}
-
-	// initialize new directory inode
-	struct ext2_inode new_inode;
-	memset(&new_inode, 0, sizeof(new_inode));
-
-	new_inode.i_mode = EXT2_S_IFDIR | 0755; // drwxr-xr-x
-	new_inode.i_size = EXT2_BLOCK_SIZE;
-	new_inode.i_links_count = 2;  // "." + ".."
-	new_inode.i_blocks = EXT2_BLOCK_SIZE / 512;
-	new_inode.i_ctime = (uint32_t)time(NULL);
-
-	// initialize block pointers
-	for (int i = 0; i < TOTAL_POINTERS; i++) {
-		new_inode.i_block[i] = 0;
-	}
-	new_inode.i_block[0] = new_block;
-
-	// write inode to disk
-	write_inode(new_ino, &new_inode);
-
-	// construct directory block with "." and ".." entries
-	uint8_t block_buf[EXT2_BLOCK_SIZE];
-	memset(block_buf, 0, EXT2_BLOCK_SIZE);
-
-	// create "." entry
-	struct ext2_dir_entry *dot = (struct ext2_dir_entry *) block_buf;
-	dot->inode = new_ino;
-	dot->name_len = 1;
-	dot->file_type = EXT2_FT_DIR;
-	memcpy(dot->name, ".", 1);
-	dot->rec_len = dir_entry_rec_len(1);
-
-	// create ".." entry
-	struct ext2_dir_entry *dotdot = (struct ext2_dir_entry *)((uint8_t *)dot + dot->rec_len);
-	dotdot->inode = parent_ino;
-	dotdot->name_len = 2;
-	dotdot->file_type = EXT2_FT_DIR;
-	memcpy(dotdot->name, "..", 2);
-	// the rest of the block is assigned to ".."
-	dotdot->rec_len = EXT2_BLOCK_SIZE - dot->rec_len;
+	// not found, create directory
+	return create_directory(r.parent_ino, r.name, NULL);
+}
 
-	// write directory block to disk
-	write_block(new_block, (char *)block_buf);
+/*
+ * Creates a directory and any missing intermediate directories, like
+ * "mkdir -p" (see make_dirs).
+ *
+ * path: absolute path of the directory that is to be created.
+ *
+ * Returns: 0 on success (also when the directory already exists), 
+ * errno on error.
+ */
+static int32_t do_mkdir_p(const char *path) {
+	return make_dirs(path, NULL);
+}
 
-	// add entry for new directory in parent
-	int add_retval = add_dir_entry(parent_ino, name, new_ino, EXT2_FT_DIR);
-	if (add_retval < 0) {
-		free_block(new_block);
-		free_inode(new_ino);
-		return add_retval;
-	}
+/*
+ * Creates the directory path; see do_mkdir.
+ */
+int32_t ext2_fsal_mkdir(const char *path) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_MKDIR, OP_REPLAY, path, NULL);
+	if (retval == 0) retval = do_mkdir(NULL, path);
+	return op_end(&c, retval);
+}
 
-	// increment parent's link count ( ".." links to parent)
-	mutex_lock(&inode_locks[parent_ino - 1]);
-	struct ext2_inode *p = get_inode(parent_ino);
-	p->i_links_count += 1;
-	mutex_unlock(&inode_locks[parent_ino - 1]);
+/*
+ * Creates the directory path and any missing parents; see do_mkdir_p.
+ */
+int32_t ext2_fsal_mkdir_p(const char *path) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_MKDIR_P, OP_REPLAY, path, NULL);
+	if (retval == 0) retval = do_mkdir_p(path);
+	return op_end(&c, retval);
+}
 
-	return 0;
+/*
+ * Like ext2_fsal_mkdir, with name relative to dir.
+ */
+int32_t ext2_fsal_mkdir_at(const struct ext2_fsal_dir *dir, const char *name) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_MKDIR, 0, name, NULL);
+	if (retval == 0) retval = do_mkdir(dir, name);
+	return op_end(&c, retval);
 }
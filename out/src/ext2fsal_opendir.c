@@ -0,0 +1,56 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+#include "ext2fsal.h"
+#include "e2fs.h"
+#include <sys/stat.h>
+
+#include <errno.h>
+
+/*
+ * Opens a directory handle for the relative (*_at) operations: the
+ * directory's inode number, and its generation so that the handle is
+ * recognized as stale once the inode is freed and reused.
+ *
+ * path: absolute path of the directory
+ * dir: receives the handle
+ *
+ * Returns: 0 on success, errno on error.
+ */
+static int32_t do_opendir(const char *path, struct ext2_fsal_dir *dir) {
+	if (dir == NULL) return EINVAL;
+
+	struct path_res r;
+	int retval = resolve_path(path, &r);
+	if (retval != 0) return retval;
+	if (r.ino < 0) return ENOENT;
+
+	struct ext2_inode *inode = get_inode(r.ino);
+	if (!S_ISDIR(inode->i_mode)) return ENOTDIR;
+
+	dir->ino = r.ino;
+	dir->generation = inode->i_generation;
+	return 0;
+}
+
+/*
+ * Runs do_opendir. Opening a handle only looks the path up, which the
+ * path lookup phase statistics already record; it is not traced.
+ */
+int32_t ext2_fsal_opendir(const char *path, struct ext2_fsal_dir *dir) {
+	reclaim_enter();
+	int32_t retval = do_opendir(path, dir);
+	reclaim_exit();
+	blockdev_op_done();
+	return retval;
+}
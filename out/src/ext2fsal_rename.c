@@ -0,0 +1,258 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+#include "ext2fsal.h"
+#include "e2fs.h"
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/*
+ * Returns: the directory entry file type matching inode's mode.
+ */
+static uint8_t entry_type_of(struct ext2_inode *inode) {
+	if (S_ISDIR(inode->i_mode)) return EXT2_FT_DIR;
+	if (S_ISLNK(inode->i_mode)) return EXT2_FT_SYMLINK;
+	return EXT2_FT_REG_FILE;
+}
+
+/*
+ * Returns: 1 if name is "." or "..", 0 otherwise.
+ */
+static int is_dot_name(const char *name) {
+	return strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+}
+
+/*
+ * Checks whether directory anc_ino is dir_ino itself or one of its 
+ * ancestors by following ".." entries up to the root. Must be called 
+ * with rename_lock held so the tree shape cannot change underneath.
+ *
+ * Returns: 1 if anc_ino is on the path from dir_ino to the root.
+ */
+static int is_ancestor(int anc_ino, int dir_ino) {
+	int ino = dir_ino;
+
+	while (ino != EXT2_ROOT_INO) {
+		if (ino == anc_ino) return 1;
+
+		ino = find_dir_entry(get_inode(ino), "..");
+		if (ino < 0) return 0;
+	}
+
+	return anc_ino == EXT2_ROOT_INO;
+}
+
+/*
+ * Sorts the inode numbers in inos (count <= 3) ascending and drops 
+ * duplicates and zeroes so they can be locked in a global order.
+ *
+ * Returns: the number of distinct inode numbers left in inos.
+ */
+static int order_lock_set(int *inos, int count) {
+	for (int i = 1; i < count; i++) {
+		int key = inos[i];
+		int j = i - 1;
+		while (j >= 0 && inos[j] > key) {
+			inos[j + 1] = inos[j];
+			j--;
+		}
+		inos[j + 1] = key;
+	}
+
+	int n = 0;
+	for (int i = 0; i < count; i++) {
+		if (inos[i] <= 0) continue;
+		if (n > 0 && inos[n - 1] == inos[i]) continue;
+		inos[n++] = inos[i];
+	}
+	return n;
+}
+
+/*
+ * Performs the directory updates of a rename. The caller holds the 
+ * inode locks of both parents, and of the moved directory when it 
+ * changes parent.
+ *
+ * replaced_ino: set to the inode whose entry was overwritten at dst, 
+ * or -1 if dst did not exist.
+ *
+ * Returns: 0 on success, errno on error.
+ */
+static int rename_locked(int sp_ino, const char *src_name, int src_ino,
+		int dp_ino, const char *dst_name, int *replaced_ino) {
+
+	struct ext2_inode *sp_inode = get_inode(sp_ino);
+	struct ext2_inode *dp_inode = get_inode(dp_ino);
+	struct ext2_inode *src_inode = get_inode(src_ino);
+
+	*replaced_ino = -1;
+
+	// re-verify: both parents are still directories after locking
+	if (!S_ISDIR(sp_inode->i_mode) || sp_inode->i_dtime != 0 ||
+	    !S_ISDIR(dp_inode->i_mode) || dp_inode->i_dtime != 0) {
+		return ENOENT;
+	}
+
+	// re-verify: source entry still refers to the inode we resolved
+	if (find_dir_entry(sp_inode, src_name) != src_ino) {
+		return ENOENT;
+	}
+
+	int is_dir = S_ISDIR(src_inode->i_mode);
+	uint8_t type = entry_type_of(src_inode);
+
+	int existing = find_dir_entry(dp_inode, dst_name);
+
+	// both names already refer to the same inode: nothing to do
+	if (existing == src_ino) return 0;
+
+	if (existing >= 0) {
+		struct ext2_inode *target = get_inode(existing);
+
+		// only non-directory targets can be replaced
+		if (S_ISDIR(target->i_mode)) return EISDIR;
+		if (is_dir) return ENOTDIR;
+
+		// repoint the destination entry in place so dst never 
+		// disappears, then drop the source entry
+		replace_dir_entry_locked(dp_ino, dst_name, src_ino, type);
+		*replaced_ino = existing;
+	}
+	else {
+		uint64_t start = stats_now();
+		int retval = insert_dir_entry_locked(dp_ino, dst_name, src_ino, type);
+		stats_phase_done(EXT2_FSAL_PHASE_DIRENT_INSERT, start);
+		if (retval != 0) return retval;
+	}
+
+	remove_dir_entry_locked(sp_ino, src_name);
+
+	// directory changed parent: fix ".." and parent link counts
+	if (is_dir && sp_ino != dp_ino) {
+		replace_dir_entry_locked(src_ino, "..", dp_ino, EXT2_FT_DIR);
+		sp_inode->i_links_count--;
+		dp_inode->i_links_count++;
+	}
+
+	src_inode->i_ctime = (uint32_t)time(NULL);
+	return 0;
+}
+
+/*
+ * Renames (moves) a file, link or directory within the ext2 
+ * filesystem by moving its directory entry; no data is copied:
+ *
+ * - Resolves source and destination parents and the source inode.
+ * - Locks the destination name, then both parents (and a directory 
+ *   changing parent) in ascending inode order.
+ * - Inserts or atomically replaces the destination entry, then 
+ *   removes the source entry.
+ * - For directories moved to a new parent, updates ".." and the 
+ *   link counts of both parents.
+ * - Drops a link from a replaced target, freeing it if it was the 
+ *   last one.
+ *
+ * src: absolute path of the entry to move
+ * dst: absolute path of its new name
+ *
+ * Returns: 0 on success, errno on error.
+ */
+static int32_t do_rename(const char *src, const char *dst) {
+
+	// validate input paths
+	if (!src || !dst) {
+		return ENOENT;
+	}
+	if (src[0] != '/' || dst[0] != '/') {
+		return ENOENT;  // paths must be absolute
+	}
+
+	// resolve both paths to parent and name
+	struct path_res rs, rd;
+	int retval = resolve_path(src, &rs);
+	if (retval != 0) return retval;
+
+	retval = resolve_path(dst, &rd);
+	if (retval != 0) return retval;
+
+	if (rs.name[0] == '\0' || rd.name[0] == '\0') return ENOENT;
+
+	// "." and ".." are structural and cannot be moved or replaced
+	const char *src_name = rs.name, *dst_name = rd.name;
+	if (is_dot_name(src_name) || is_dot_name(dst_name)) return EINVAL;
+
+	int sp_ino = rs.parent_ino;
+	int dp_ino = rd.parent_ino;
+
+	// lookup source entry
+	int src_ino = rs.ino;
+	if (src_ino < 0) return ENOENT;
+
+	int is_dir = S_ISDIR(get_inode(src_ino)->i_mode);
+
+	// trailing slash on a non-directory is an error
+	if (!is_dir && (rs.trailing_slash || rd.trailing_slash)) {
+		return ENOENT;
+	}
+
+	// directory moves across parents are serialized so that two 
+	// concurrent moves cannot form a cycle
+	int cross_dir_move = is_dir && sp_ino != dp_ino;
+	if (cross_dir_move) {
+		mutex_lock(&rename_lock);
+
+		// cannot move a directory into itself or a descendant
+		if (is_ancestor(src_ino, dp_ino)) {
+			mutex_unlock(&rename_lock);
+			return EINVAL;
+		}
+	}
+
+	// no entry called dst_name may be added to the destination 
+	// meanwhile (add_dir_entry checks names under the same lock)
+	pthread_mutex_t *dst_lock = name_lock(dp_ino, dst_name, strlen(dst_name));
+	mutex_lock(dst_lock);
+
+	// lock parents (and the moved directory) in ascending order
+	int lock_set[3] = { sp_ino, dp_ino, cross_dir_move ? src_ino : 0 };
+	int nlocks = order_lock_set(lock_set, 3);
+	for (int i = 0; i < nlocks; i++) mutex_lock(&inode_locks[lock_set[i] - 1]);
+
+	int replaced_ino;
+	retval = rename_locked(sp_ino, src_name, src_ino, dp_ino, dst_name, &replaced_ino);
+
+	for (int i = nlocks - 1; i >= 0; i--) mutex_unlock(&inode_locks[lock_set[i] - 1]);
+	mutex_unlock(dst_lock);
+
+	if (cross_dir_move) mutex_unlock(&rename_lock);
+
+	// the replaced target lost the link its entry held
+	if (retval == 0 && replaced_ino > 0) release_inode_link(replaced_ino);
+
+	return retval;
+}
+
+/*
+ * Moves src to dst; see do_rename.
+ */
+int32_t ext2_fsal_rename(const char *src, const char *dst) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_RENAME, OP_REPLAY, src, dst);
+	if (retval == 0) retval = do_rename(src, dst);
+	return op_end(&c, retval);
+}
@@ -0,0 +1,264 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+#include "ext2fsal.h"
+#include "e2fs.h"
+#include "probes.h"
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/*
+ * Growable array of inode or block numbers.
+ */
+struct num_list {
+	int *items;
+	int count;
+	int cap;
+};
+
+/*
+ * Makes room for at least extra more items in list.
+ *
+ * Returns: 0 on success, ENOMEM on failure.
+ */
+static int num_list_reserve(struct num_list *list, int extra) {
+	if (list->count + extra <= list->cap) return 0;
+
+	int cap = list->cap ? list->cap : 64;
+	while (cap < list->count + extra) cap *= 2;
+
+	int *items = realloc(list->items, sizeof(int) * cap);
+	if (items == NULL) return ENOMEM;
+
+	list->items = items;
+	list->cap = cap;
+	return 0;
+}
+
+/*
+ * Appends n to list.
+ *
+ * Returns: 0 on success, ENOMEM on failure.
+ */
+static int num_list_push(struct num_list *list, int n) {
+	if (num_list_reserve(list, 1) != 0) return ENOMEM;
+	list->items[list->count++] = n;
+	return 0;
+}
+
+/*
+ * Detaches the blocks of inode ino and appends them to blocks. The 
+ * caller must hold the inode's lock.
+ *
+ * Returns: 0 on success, ENOMEM on failure.
+ */
+static int collect_blocks_into(int ino, struct num_list *blocks) {
+	if (num_list_reserve(blocks, MAX_INODE_BLOCKS) != 0) return ENOMEM;
+
+	blocks->count += collect_inode_blocks(get_inode(ino), 
+			blocks->items + blocks->count);
+	return 0;
+}
+
+/*
+ * Walks the already detached subtree rooted at directory root_ino 
+ * once, depth first:
+ *
+ * - Each directory is marked deleted under its inode lock so that 
+ *   concurrent inserts into it fail, its children are recorded, and 
+ *   its blocks and inode are queued for release. The mark comes 
+ *   first and each block is read under its lock: an insert appends 
+ *   under the block lock alone (see add_dir_entry), so it either 
+ *   lands before the block is read or sees the mark.
+ * - Each non-directory child loses one link; once it has none left 
+ *   its blocks and inode are queued as well.
+ *
+ * blocks: receives the blocks of removed files, which can be freed 
+ *   at once
+ * dir_blocks/inodes: receive the directory blocks and inodes, which 
+ *   lookups may still be reading and are retired instead
+ * dirs: receives the number of directories removed
+ *
+ * Returns: 0 on success, ENOMEM if the work lists cannot grow.
+ */
+static int collect_subtree(int root_ino, struct num_list *blocks, 
+		struct num_list *dir_blocks, struct num_list *inodes, int *dirs) {
+
+	struct num_list stack = { NULL, 0, 0 };
+	struct num_list files = { NULL, 0, 0 };
+	int retval = num_list_push(&stack, root_ino);
+	uint32_t now = (uint32_t)time(NULL);
+
+	while (retval == 0 && stack.count > 0) {
+		int dir_ino = stack.items[--stack.count];
+		struct ext2_inode *dir = get_inode(dir_ino);
+
+		mutex_lock(&inode_locks[dir_ino - 1]);
+
+		// mark dead so racing inserts see a deleted directory
+		dir->i_links_count = 0;
+		dir->i_dtime = now;
+
+		// record children, skipping "." and ".."
+		for (int i = 0; i < DIRECT_POINTERS && retval == 0; i++) {
+			int block_num = dir->i_block[i];
+			if (block_num == 0) continue;
+
+			mutex_lock(&block_locks[block_num - 1]);
+			uint8_t *blk_start = (uint8_t *)get_block(block_num);
+			uint8_t *blk_end = blk_start + EXT2_BLOCK_SIZE;
+			struct ext2_dir_entry *entry = (struct ext2_dir_entry *)blk_start;
+
+			while ((uint8_t *)entry < blk_end && entry->rec_len > 0) {
+				if (entry->inode != 0 &&
+				    !(entry->name_len == 1 && entry->name[0] == '.') &&
+				    !(entry->name_len == 2 && entry->name[0] == '.' && entry->name[1] == '.')) {
+
+					if (entry->file_type == EXT2_FT_DIR) 
+						retval = num_list_push(&stack, entry->inode);
+					else 
+						retval = num_list_push(&files, entry->inode);
+
+					if (retval != 0) break;
+				}
+				entry = next_dir_entry(entry);
+			}
+			put_block(block_num, 0);
+			mutex_unlock(&block_locks[block_num - 1]);
+		}
+
+		if (retval == 0) retval = collect_blocks_into(dir_ino, dir_blocks);
+		if (retval == 0) retval = num_list_push(inodes, dir_ino);
+		(*dirs)++;
+
+		mutex_unlock(&inode_locks[dir_ino - 1]);
+	}
+
+	// drop one link per entry; hard links shared with the rest of 
+	// the tree keep the file alive
+	for (int i = 0; i < files.count && retval == 0; i++) {
+		int ino = files.items[i];
+		struct ext2_inode *inode = get_inode(ino);
+
+		mutex_lock(&inode_locks[ino - 1]);
+
+		inode->i_links_count--;
+		if (inode->i_links_count == 0) {
+			inode->i_dtime = now;
+			retval = collect_blocks_into(ino, blocks);
+			if (retval == 0) retval = num_list_push(inodes, ino);
+		}
+
+		mutex_unlock(&inode_locks[ino - 1]);
+	}
+
+	free(stack.items);
+	free(files.items);
+	return retval;
+}
+
+/*
+ * Recursively removes a directory and everything beneath it from 
+ * the ext2 filesystem. Non-directories are removed as by rm.
+ *
+ * - Unlinks the directory from its parent first, so the subtree 
+ *   becomes unreachable in one step, and fixes the parent's link 
+ *   count.
+ * - Walks the subtree once, collecting every inode and block to be 
+ *   freed.
+ * - Clears the bits of file blocks with word-wide bulk operations 
+ *   under a single hold of the block bitmap lock. Directory blocks 
+ *   and inodes are retired (reclaim.c) and cleared the same way once
+ *   no lookup can still be walking them.
+ *
+ * path: absolute path of the directory to be removed
+ *
+ * Returns: 0 on success, errno on error.
+ */
+static int32_t do_rm_r(const char *path) {
+
+	// validate input path
+	if (!path) return ENOENT;
+	if (path[0] != '/') return ENOENT;
+
+	// resolve parent directory and target name
+	struct path_res r;
+	int retval = resolve_path(path, &r);
+	if (retval != 0) return retval;
+	if (r.name[0] == '\0') return ENOENT;
+
+	// "." and ".." are not removable entries
+	const char *name = r.name;
+	if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return EINVAL;
+
+	int parent_ino = r.parent_ino;
+	struct ext2_inode *parent_inode = get_inode(parent_ino);
+
+	int target_ino = r.ino;
+	if (target_ino < 0) return ENOENT;
+
+	// plain files and links are unlinked as by rm
+	if (!S_ISDIR(get_inode(target_ino)->i_mode)) {
+		if (r.trailing_slash) return ENOENT;
+		return unlink_entry(parent_ino, name);
+	}
+
+	// detach the subtree from its parent
+	mutex_lock(&inode_locks[parent_ino - 1]);
+
+	if (!S_ISDIR(parent_inode->i_mode) || parent_inode->i_dtime != 0 ||
+	    find_dir_entry(parent_inode, name) != target_ino) {
+		mutex_unlock(&inode_locks[parent_ino - 1]);
+		return ENOENT;
+	}
+
+	remove_dir_entry_locked(parent_ino, name);
+	parent_inode->i_links_count--;  // lost the child's ".."
+
+	mutex_unlock(&inode_locks[parent_ino - 1]);
+
+	// collect everything below it in one pass
+	struct num_list blocks = { NULL, 0, 0 };
+	struct num_list dir_blocks = { NULL, 0, 0 };
+	struct num_list inodes = { NULL, 0, 0 };
+	int dirs = 0;
+
+	retval = collect_subtree(target_ino, &blocks, &dir_blocks, &inodes, &dirs);
+
+	// release whatever was collected, even on a partial walk
+	PHASE_BEGIN1(rm_free, inodes.count);
+	free_blocks_bulk(blocks.items, blocks.count);
+	reclaim_blocks(dir_blocks.items, dir_blocks.count);
+	reclaim_inodes(inodes.items, inodes.count, dirs);
+	PHASE_END0(rm_free, TL_RM_FREE);
+
+	free(blocks.items);
+	free(dir_blocks.items);
+	free(inodes.items);
+	return retval;
+}
+
+/*
+ * Removes the tree at path; see do_rm_r.
+ */
+int32_t ext2_fsal_rm_r(const char *path) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_RM_R, OP_REPLAY, path, NULL);
+	if (retval == 0) retval = do_rm_r(path);
+	return op_end(&c, retval);
+}
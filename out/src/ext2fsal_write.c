@@ -0,0 +1,243 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Writes, appends and truncates on existing regular files.
+ *
+ * Each call touches only the blocks its byte range covers and the
+ * inode: the block map is grown with map_inode_blocks or cut back
+ * with trim_inode_blocks, never rebuilt, so appending a record to a
+ * large file costs what the record costs. Files stay without holes:
+ * a write past the end, or a truncate that grows the file, maps and
+ * zeroes the blocks in between, and the bytes of the last block past
+ * the end of the file are kept zero.
+ */
+
+#include "ext2fsal.h"
+#include "e2fs.h"
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * Looks up path for a write: it must name an existing regular file.
+ *
+ * Returns: the file's inode number (1-based), or -errno.
+ */
+static int lookup_file(const char *path) {
+	if (path == NULL) return -ENOENT;
+
+	struct path_res r;
+	int retval = resolve_path(path, &r);
+	if (retval != 0) return -retval;
+	if (r.ino < 0) return -ENOENT;
+
+	struct ext2_inode *inode = get_inode(r.ino);
+	if (S_ISDIR(inode->i_mode)) return -EISDIR;
+	if (r.trailing_slash) return -ENOENT;
+	if (!S_ISREG(inode->i_mode)) return -EINVAL;
+	return r.ino;
+}
+
+/*
+ * Returns: the largest size, in bytes, a file can have.
+ */
+static off_t max_file_size(void) {
+	int per_block = EXT2_BLOCK_SIZE / sizeof(uint32_t);
+	return (off_t)(DIRECT_POINTERS + per_block) << block_shift;
+}
+
+/*
+ * Copies len bytes from buf, or zeros if buf is NULL, to offset off of
+ * inode; the blocks the range covers must be mapped. Blocks marked in
+ * fresh (indexed from data block first) were just allocated and are
+ * zeroed outside the range. The caller holds the inode's lock.
+ */
+static void fill_range(struct ext2_inode *inode, off_t off, const char *buf, size_t len,
+		int first, const char *fresh) {
+	off_t end = off + (off_t)len;
+
+	for (off_t pos = off; pos < end; ) {
+		int k = (int)(pos >> block_shift);
+		int in = (int)(pos & (EXT2_BLOCK_SIZE - 1));
+		int n = EXT2_BLOCK_SIZE - in;
+		if (n > end - pos) n = (int)(end - pos);
+
+		// a hole already reads as zeros
+		int b = inode_bmap(inode, k);
+		if (b == 0) {
+			pos += n;
+			continue;
+		}
+
+		char *blk;
+		if (fresh != NULL && k >= first && fresh[k - first]) {
+			blk = get_block_new(b);
+			memset(blk, 0, in);
+			memset(blk + in + n, 0, EXT2_BLOCK_SIZE - in - n);
+		}
+		else {
+			blk = get_block(b);
+		}
+
+		if (buf != NULL) memcpy(blk + in, buf + (pos - off), n);
+		else memset(blk + in, 0, n);
+		put_block(b, 1);
+		pos += n;
+	}
+}
+
+/*
+ * Writes len bytes from buf to the file with inode ino at offset off,
+ * or at its end if append is set. A gap between the old end of the
+ * file and off reads as zeros.
+ *
+ * Returns: 0 on success, errno on error.
+ */
+static int32_t do_write(int ino, off_t off, const void *buf, size_t len, int append) {
+	if (buf == NULL && len > 0) return EINVAL;
+	if (off < 0) return EINVAL;
+
+	mutex_lock(&inode_locks[ino - 1]);
+	struct ext2_inode *inode = get_inode(ino);
+	if (inode->i_links_count == 0 || inode->i_dtime != 0) {
+		mutex_unlock(&inode_locks[ino - 1]);
+		return ENOENT;
+	}
+
+	off_t size = inode->i_size;
+	if (append) off = size;
+	if (len > (size_t)max_file_size() || off > max_file_size() - (off_t)len) {
+		mutex_unlock(&inode_locks[ino - 1]);
+		return EFBIG;
+	}
+	if (len == 0) {
+		mutex_unlock(&inode_locks[ino - 1]);
+		return 0;
+	}
+
+	// map from the old end of the file, or from the first block
+	// written if that comes earlier
+	off_t end = off + (off_t)len;
+	int old_n = data_blocks_for_size(size);
+	int first = (int)(off >> block_shift);
+	if (first > old_n) first = old_n;
+	int n = data_blocks_for_size(end) - first;
+
+	char fresh[MAX_INODE_BLOCKS];
+	if (n > 0 && map_inode_blocks(inode, first, n, fresh) != 0) {
+		mutex_unlock(&inode_locks[ino - 1]);
+		return ENOSPC;
+	}
+
+	// the gap past the old end reads as zeros
+	if (off > size) fill_range(inode, size, NULL, off - size, first, fresh);
+	fill_range(inode, off, buf, len, first, n > 0 ? fresh : NULL);
+
+	if (end > size) inode->i_size = end;
+	inode->i_mtime = inode->i_ctime = (uint32_t)time(NULL);
+	mutex_unlock(&inode_locks[ino - 1]);
+	return 0;
+}
+
+/*
+ * Sets the size of the file with inode ino to size bytes, freeing the
+ * blocks past the new end or mapping zeroed blocks up to it.
+ *
+ * Returns: 0 on success, errno on error.
+ */
+static int32_t do_truncate(int ino, off_t size) {
+	if (size < 0) return EINVAL;
+	if (size > max_file_size()) return EFBIG;
+
+	mutex_lock(&inode_locks[ino - 1]);
+	struct ext2_inode *inode = get_inode(ino);
+	if (inode->i_links_count == 0 || inode->i_dtime != 0) {
+		mutex_unlock(&inode_locks[ino - 1]);
+		return ENOENT;
+	}
+
+	off_t old_size = inode->i_size;
+	int old_n = data_blocks_for_size(old_size);
+	int new_n = data_blocks_for_size(size);
+
+	if (size < old_size) {
+		trim_inode_blocks(inode, new_n);
+
+		// keep the rest of the new last block zero
+		off_t tail = ((off_t)new_n << block_shift) - size;
+		if (tail > 0) fill_range(inode, size, NULL, tail, 0, NULL);
+	}
+	else if (size > old_size) {
+		char fresh[MAX_INODE_BLOCKS];
+		if (new_n > old_n && map_inode_blocks(inode, old_n, new_n - old_n, fresh) != 0) {
+			mutex_unlock(&inode_locks[ino - 1]);
+			return ENOSPC;
+		}
+
+		// zero from the old end through the new last block
+		off_t span = ((off_t)new_n << block_shift) - old_size;
+		if (span > 0) fill_range(inode, old_size, NULL, span, old_n, new_n > old_n ? fresh : NULL);
+	}
+
+	inode->i_size = size;
+	inode->i_mtime = inode->i_ctime = (uint32_t)time(NULL);
+	mutex_unlock(&inode_locks[ino - 1]);
+	return 0;
+}
+
+/*
+ * Runs do_write on the file at path. Not recorded in the trace: a
+ * replay would have no data to write.
+ */
+static int32_t write_path(const char *path, off_t off, const void *buf, size_t len, int append) {
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_WRITE, 0, path, NULL);
+	if (retval == 0) {
+		int ino = lookup_file(path);
+		retval = ino < 0 ? -ino : do_write(ino, off, buf, len, append);
+	}
+	return op_end(&c, retval);
+}
+
+/*
+ * Writes to an existing file; see ext2fsal.h.
+ */
+int32_t ext2_fsal_write(const char *path, uint64_t off, const void *buf, size_t len) {
+	if (off > (uint64_t)max_file_size()) return EFBIG;
+	return write_path(path, (off_t)off, buf, len, 0);
+}
+
+/*
+ * Appends to an existing file; see ext2fsal.h.
+ */
+int32_t ext2_fsal_append(const char *path, const void *buf, size_t len) {
+	return write_path(path, 0, buf, len, 1);
+}
+
+/*
+ * Runs do_truncate on the file at path. Not recorded in the trace,
+ * like writes.
+ */
+int32_t ext2_fsal_truncate(const char *path, uint64_t size) {
+	if (size > (uint64_t)max_file_size()) return EFBIG;
+
+	struct op_call c;
+	int32_t retval = op_begin(&c, EXT2_FSAL_OP_TRUNCATE, 0, path, NULL);
+	if (retval == 0) {
+		int ino = lookup_file(path);
+		retval = ino < 0 ? -ino : do_truncate(ino, (off_t)size);
+	}
+	return op_end(&c, retval);
+}
@@ -0,0 +1,317 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Lock contention profiler.
+ *
+ * Built only with `make LOCKPROF=1` (-DEXT2FSAL_LOCKPROF); otherwise
+ * mutex_lock never calls in here and the functions below are empty.
+ *
+ * For every individual lock (each inode lock, each block lock, each
+ * name lock, the two bitmap locks, and everything else lumped 
+ * together) it counts
+ * acquisitions, contended acquisitions, total and maximum wait. Every
+ * contended acquisition is also attributed to its call site (the
+ * return address of mutex_lock), so the report shows both which locks
+ * are hot and which code waits on them.
+ *
+ * The top EXT2FSAL_LOCKPROF_TOP (default 10) locks and call sites by
+ * total wait are printed to stderr at ext2_fsal_destroy, and on
+ * demand through ext2_fsal_lockprof_dump.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ext2fsal.h"
+#include "e2fs.h"
+
+#ifdef EXT2FSAL_LOCKPROF
+
+#define SITE_SLOTS  512     // power of two
+#define DEFAULT_TOP 10
+
+struct call_site {
+	uintptr_t pc;
+	int cls;
+	uint64_t contended;
+	uint64_t wait_ns;
+	uint64_t max_wait_ns;
+};
+
+// one entry per lock: inode locks, then block locks, then name 
+// locks, then the inode bitmap, block bitmap and "other" locks
+static struct ext2_fsal_lock_stats *locks;
+static int num_locks;
+static int inode_base, block_base, name_base, singles_base;
+
+static struct call_site sites[SITE_SLOTS];
+static uint64_t sites_dropped;
+
+static void atomic_max(uint64_t *dst, uint64_t v) {
+	uint64_t cur = __atomic_load_n(dst, __ATOMIC_RELAXED);
+	while (v > cur && !__atomic_compare_exchange_n(dst, &cur, v, 1,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*
+ * Returns: monotonic time in nanoseconds.
+ */
+uint64_t lockprof_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Returns: the per-lock slot of mutex, which is of class cls.
+ */
+static int lock_index(pthread_mutex_t *mutex, int cls) {
+	switch (cls) {
+		case EXT2_FSAL_LOCK_INODE: return inode_base + (mutex - inode_locks);
+		case EXT2_FSAL_LOCK_BLOCK: return block_base + (mutex - block_locks);
+		case EXT2_FSAL_LOCK_NAME: return name_base + (mutex - name_locks);
+		case EXT2_FSAL_LOCK_INODE_BITMAP: return singles_base;
+		case EXT2_FSAL_LOCK_BLOCK_BITMAP: return singles_base + 1;
+		default: return singles_base + 2;
+	}
+}
+
+/*
+ * Returns: the call site entry for pc, claiming a free slot on first
+ * use, or NULL if the table is full.
+ */
+static struct call_site *site_for(uintptr_t pc, int cls) {
+	unsigned int h = (unsigned int)((pc >> 2) * 2654435761u) & (SITE_SLOTS - 1);
+
+	for (int probe = 0; probe < SITE_SLOTS; probe++) {
+		struct call_site *s = &sites[(h + probe) & (SITE_SLOTS - 1)];
+		uintptr_t cur = __atomic_load_n(&s->pc, __ATOMIC_ACQUIRE);
+
+		if (cur == pc) return s;
+		if (cur == 0) {
+			if (__atomic_compare_exchange_n(&s->pc, &cur, pc, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				s->cls = cls;
+				return s;
+			}
+			if (cur == pc) return s;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Records one acquisition of mutex (class cls) from call site pc;
+ * wait_ns is the time spent blocked if contended.
+ */
+void lockprof_acquired(pthread_mutex_t *mutex, int cls, uint64_t wait_ns,
+		int contended, void *pc) {
+	if (locks == NULL) return;
+
+	struct ext2_fsal_lock_stats *l = &locks[lock_index(mutex, cls)];
+	__atomic_fetch_add(&l->acquisitions, 1, __ATOMIC_RELAXED);
+	if (!contended) return;
+
+	__atomic_fetch_add(&l->contended, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&l->wait_ns, wait_ns, __ATOMIC_RELAXED);
+	atomic_max(&l->max_wait_ns, wait_ns);
+
+	struct call_site *s = site_for((uintptr_t)pc, cls);
+	if (s == NULL) {
+		__atomic_fetch_add(&sites_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	__atomic_fetch_add(&s->contended, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->wait_ns, wait_ns, __ATOMIC_RELAXED);
+	atomic_max(&s->max_wait_ns, wait_ns);
+}
+
+/*
+ * Allocates the per-lock counters. Called from ext2_fsal_init after
+ * locks_init.
+ */
+void lockprof_init(int inodes, int blocks) {
+	inode_base = 0;
+	block_base = inodes;
+	name_base = inodes + blocks;
+	singles_base = name_base + NAME_LOCKS;
+	num_locks = singles_base + 3;
+
+	memset(sites, 0, sizeof(sites));
+	sites_dropped = 0;
+	locks = calloc(num_locks, sizeof(*locks));
+	if (locks == NULL) perror("lockprof");
+}
+
+/*
+ * Prints the report to stderr and frees the counters. Called from
+ * ext2_fsal_destroy.
+ */
+void lockprof_destroy(void) {
+	if (locks == NULL) return;
+	ext2_fsal_lockprof_dump(STDERR_FILENO);
+	free(locks);
+	locks = NULL;
+}
+
+// ---------------------------- REPORT -----------------------------
+
+/*
+ * Describes lock slot i as a class name and id (inode or block
+ * number, name lock index, or -1 for the single locks).
+ */
+static const char *describe_lock(int i, int *id) {
+	if (i < block_base) {
+		*id = i - inode_base + 1;
+		return stats_lock_name(EXT2_FSAL_LOCK_INODE);
+	}
+	if (i < name_base) {
+		*id = i - block_base + 1;
+		return stats_lock_name(EXT2_FSAL_LOCK_BLOCK);
+	}
+	if (i < singles_base) {
+		*id = i - name_base;
+		return stats_lock_name(EXT2_FSAL_LOCK_NAME);
+	}
+	*id = -1;
+	return stats_lock_name(EXT2_FSAL_LOCK_INODE_BITMAP + (i - singles_base));
+}
+
+static int cmp_lock_wait(const void *a, const void *b) {
+	const struct ext2_fsal_lock_stats *x = &locks[*(const int *)a];
+	const struct ext2_fsal_lock_stats *y = &locks[*(const int *)b];
+	if (x->wait_ns != y->wait_ns) return x->wait_ns < y->wait_ns ? 1 : -1;
+	return x->contended < y->contended ? 1 : (x->contended > y->contended ? -1 : 0);
+}
+
+static int cmp_site_wait(const void *a, const void *b) {
+	const struct call_site *x = &sites[*(const int *)a];
+	const struct call_site *y = &sites[*(const int *)b];
+	return x->wait_ns < y->wait_ns ? 1 : (x->wait_ns > y->wait_ns ? -1 : 0);
+}
+
+/*
+ * Writes the top-N report to fd: totals per class, then the locks
+ * and call sites with the most total wait.
+ */
+void ext2_fsal_lockprof_dump(int fd) {
+	if (locks == NULL) return;
+
+	FILE *f = fdopen(dup(fd), "w");
+	if (f == NULL) return;
+
+	const char *top_env = getenv("EXT2FSAL_LOCKPROF_TOP");
+	int top = top_env ? atoi(top_env) : DEFAULT_TOP;
+	if (top <= 0) top = DEFAULT_TOP;
+
+	// class totals
+	struct ext2_fsal_lock_stats totals[EXT2_FSAL_LOCK_COUNT];
+	memset(totals, 0, sizeof(totals));
+	for (int i = 0; i < num_locks; i++) {
+		int cls = (i < block_base) ? EXT2_FSAL_LOCK_INODE :
+			(i < name_base) ? EXT2_FSAL_LOCK_BLOCK :
+			(i < singles_base) ? EXT2_FSAL_LOCK_NAME :
+			EXT2_FSAL_LOCK_INODE_BITMAP + (i - singles_base);
+		totals[cls].acquisitions += locks[i].acquisitions;
+		totals[cls].contended += locks[i].contended;
+		totals[cls].wait_ns += locks[i].wait_ns;
+		if (locks[i].max_wait_ns > totals[cls].max_wait_ns)
+			totals[cls].max_wait_ns = locks[i].max_wait_ns;
+	}
+
+	fprintf(f, "lock profile: classes\n");
+	fprintf(f, "  %-18s %12s %10s %12s %10s\n", "class", "acquired", "contended", "wait_ms", "max_us");
+	for (int c = 0; c < EXT2_FSAL_LOCK_COUNT; c++) {
+		fprintf(f, "  %-18s %12llu %10llu %12.3f %10.1f\n", stats_lock_name(c),
+			(unsigned long long)totals[c].acquisitions,
+			(unsigned long long)totals[c].contended,
+			totals[c].wait_ns / 1e6, totals[c].max_wait_ns / 1e3);
+	}
+
+	// hottest locks
+	int *order = malloc(num_locks * sizeof(int));
+	if (order == NULL) {
+		fclose(f);
+		return;
+	}
+	int n = 0;
+	for (int i = 0; i < num_locks; i++) {
+		if (locks[i].contended > 0) order[n++] = i;
+	}
+	qsort(order, n, sizeof(int), cmp_lock_wait);
+
+	fprintf(f, "lock profile: top %d locks by wait\n", top);
+	fprintf(f, "  %-18s %6s %12s %10s %12s %10s\n", "class", "id", "acquired", "contended", "wait_ms", "max_us");
+	for (int k = 0; k < n && k < top; k++) {
+		int id;
+		struct ext2_fsal_lock_stats *l = &locks[order[k]];
+		const char *name = describe_lock(order[k], &id);
+		fprintf(f, "  %-18s %6d %12llu %10llu %12.3f %10.1f\n", name, id,
+			(unsigned long long)l->acquisitions, (unsigned long long)l->contended,
+			l->wait_ns / 1e6, l->max_wait_ns / 1e3);
+	}
+	free(order);
+
+	// hottest call sites
+	int site_order[SITE_SLOTS];
+	n = 0;
+	for (int i = 0; i < SITE_SLOTS; i++) {
+		if (sites[i].pc != 0) site_order[n++] = i;
+	}
+	qsort(site_order, n, sizeof(int), cmp_site_wait);
+
+	fprintf(f, "lock profile: top %d call sites by wait\n", top);
+	fprintf(f, "  %-36s %-18s %10s %12s %10s\n", "site", "class", "contended", "wait_ms", "max_us");
+	for (int k = 0; k < n && k < top; k++) {
+		struct call_site *s = &sites[site_order[k]];
+		char where[64];
+		Dl_info info;
+
+		if (dladdr((void *)s->pc, &info) && info.dli_sname) {
+			snprintf(where, sizeof(where), "%s+0x%lx", info.dli_sname,
+				(unsigned long)(s->pc - (uintptr_t)info.dli_saddr));
+		} else {
+			snprintf(where, sizeof(where), "%p", (void *)s->pc);
+		}
+		fprintf(f, "  %-36s %-18s %10llu %12.3f %10.1f\n", where, stats_lock_name(s->cls),
+			(unsigned long long)s->contended, s->wait_ns / 1e6, s->max_wait_ns / 1e3);
+	}
+	if (sites_dropped > 0) {
+		fprintf(f, "  (%llu contended acquisitions from untracked sites)\n",
+			(unsigned long long)sites_dropped);
+	}
+
+	fclose(f);
+}
+
+#else
+
+void lockprof_init(int inodes, int blocks) {
+	(void)inodes;
+	(void)blocks;
+}
+
+void lockprof_destroy(void) {
+}
+
+void ext2_fsal_lockprof_dump(int fd) {
+	const char msg[] = "lock profile: not built in (rebuild with make LOCKPROF=1)\n";
+	if (write(fd, msg, sizeof(msg) - 1) < 0) { /* nothing to report to */ }
+}
+
+#endif
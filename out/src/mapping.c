@@ -0,0 +1,212 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Mapping policy of the disk image.
+ *
+ * EXT2FSAL_MMAP selects how ext2_fsal_init maps the image:
+ *
+ *   plain     one MAP_SHARED mapping and nothing else
+ *   meta      (default) plain, plus the metadata (boot block,
+ *             superblock, group descriptors, bitmaps, inode table) is
+ *             pre-faulted writable, and the data area is advised
+ *             MADV_RANDOM so faults there do not read ahead. Operations
+ *             that stream through a run of data blocks prefetch just
+ *             that run with MADV_WILLNEED (see map_prefetch)
+ *   populate  MAP_POPULATE: the whole image is faulted in at init
+ *   hugepage  meta, with the mapping aligned to 2 MiB and advised
+ *             MADV_HUGEPAGE, so the kernel can back it with
+ *             transparent huge pages where the image's file system
+ *             supports them
+ *
+ * The policy only applies to the mmap block device backend (see
+ * blockdev.c). The time ext2_fsal_init took, the page faults of the
+ * process during it and since, and whether MADV_HUGEPAGE was accepted
+ * are part of the statistics snapshot under either backend.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include "ext2fsal.h"
+#include "e2fs.h"
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23      // Linux 5.14
+#endif
+
+#define HUGE_ALIGN (2UL << 20)
+
+enum map_policy { MAP_POLICY_PLAIN, MAP_POLICY_META, MAP_POLICY_POPULATE, MAP_POLICY_HUGEPAGE };
+
+static const char *policy_names[] = { "plain", "meta", "populate", "hugepage" };
+
+static enum map_policy policy;
+static int mapped;                  // map_image mapped the image
+static size_t page_size;
+static int hugepages;               // MADV_HUGEPAGE accepted
+
+// ext2_fsal_init cost
+static uint64_t init_start_ns, init_ns;
+static long start_minflt, start_majflt;
+static long init_minflt, init_majflt;
+
+static uint64_t mono_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void faults(long *minflt, long *majflt) {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	*minflt = ru.ru_minflt;
+	*majflt = ru.ru_majflt;
+}
+
+/*
+ * Maps size bytes of fd shared at a 2 MiB aligned address.
+ *
+ * Returns: the mapping, or MAP_FAILED.
+ */
+static void *map_aligned(int fd, size_t size) {
+	size_t span = size + HUGE_ALIGN;
+	uint8_t *raw = mmap(NULL, span, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED) return MAP_FAILED;
+
+	uint8_t *aligned = (uint8_t *)(((uintptr_t)raw + HUGE_ALIGN - 1) & ~(HUGE_ALIGN - 1));
+	void *p = mmap(aligned, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+	if (p == MAP_FAILED) {
+		munmap(raw, span);
+		return MAP_FAILED;
+	}
+
+	// give back the unused ends of the reservation
+	size_t mapped = (size + page_size - 1) & ~(page_size - 1);
+	if (aligned > raw) munmap(raw, aligned - raw);
+	if (raw + span > aligned + mapped) munmap(aligned + mapped, raw + span - (aligned + mapped));
+	return p;
+}
+
+/*
+ * Starts timing ext2_fsal_init and reads EXT2FSAL_MMAP. Called first
+ * thing in ext2_fsal_init.
+ */
+void map_init_begin(void) {
+	init_start_ns = mono_ns();
+	faults(&start_minflt, &start_majflt);
+	page_size = sysconf(_SC_PAGESIZE);
+	hugepages = 0;
+	mapped = 0;
+
+	const char *env = getenv("EXT2FSAL_MMAP");
+	policy = MAP_POLICY_META;
+	if (env != NULL && *env != '\0') {
+		int found = 0;
+		for (int i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+			if (strcmp(env, policy_names[i]) == 0) {
+				policy = i;
+				found = 1;
+			}
+		}
+		if (!found) fprintf(stderr, "mmap: unknown policy %s, using meta\n", env);
+	}
+}
+
+/*
+ * Maps the image open on fd (size bytes) according to the policy.
+ * Called by the mmap block device backend; map_init_done applies the
+ * rest of the policy once the superblock and group descriptor are
+ * known.
+ *
+ * Returns: the mapping, or MAP_FAILED.
+ */
+void *map_image(int fd, size_t size) {
+	mapped = 1;
+
+	if (policy == MAP_POLICY_HUGEPAGE) {
+		void *p = map_aligned(fd, size);
+		if (p != MAP_FAILED) return p;
+		policy = MAP_POLICY_META;
+	}
+
+	int flags = MAP_SHARED | (policy == MAP_POLICY_POPULATE ? MAP_POPULATE : 0);
+	return mmap(NULL, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+}
+
+/*
+ * Applies the advice of the policy: pre-faults the metadata at the
+ * front of the image, marks the data area random access and, for
+ * hugepage, asks for transparent huge pages. Then records the time
+ * and faults ext2_fsal_init took. Called at the end of
+ * ext2_fsal_init.
+ */
+void map_init_done(size_t size) {
+	if (mapped && (policy == MAP_POLICY_META || policy == MAP_POLICY_HUGEPAGE)) {
+		// everything up to the end of the inode table
+		int itable_blocks = (num_inodes * sizeof(struct ext2_inode) + EXT2_BLOCK_SIZE - 1) / EXT2_BLOCK_SIZE;
+		int meta_end = group_desc->bg_inode_table + itable_blocks;
+		if ((int)group_desc->bg_block_bitmap >= meta_end) meta_end = group_desc->bg_block_bitmap + 1;
+		if ((int)group_desc->bg_inode_bitmap >= meta_end) meta_end = group_desc->bg_inode_bitmap + 1;
+
+		size_t meta = ((size_t)meta_end * EXT2_BLOCK_SIZE + page_size - 1) & ~(page_size - 1);
+		if (meta > size) meta = size;
+
+		if (policy == MAP_POLICY_HUGEPAGE && madvise(fs, size, MADV_HUGEPAGE) == 0) hugepages = 1;
+		if (madvise(fs, meta, MADV_POPULATE_WRITE) < 0) madvise(fs, meta, MADV_WILLNEED);
+		if (size > meta) madvise(fs + meta, size - meta, MADV_RANDOM);
+	}
+
+	init_ns = mono_ns() - init_start_ns;
+	long minflt, majflt;
+	faults(&minflt, &majflt);
+	init_minflt = minflt - start_minflt;
+	init_majflt = majflt - start_majflt;
+}
+
+/*
+ * Prefetches count blocks starting at block first before an operation
+ * streams through them, so their pages are read in one batch instead
+ * of one fault at a time. Only done under the meta and hugepage
+ * policies of the mmap backend.
+ */
+void map_prefetch(int first, int count) {
+	if (!mapped || (policy != MAP_POLICY_META && policy != MAP_POLICY_HUGEPAGE)) return;
+	if (count <= 0) return;
+
+	uintptr_t start = (uintptr_t)get_block(first) & ~(page_size - 1);
+	uintptr_t end = (uintptr_t)get_block(first + count);
+	madvise((void *)start, end - start, MADV_WILLNEED);
+}
+
+/*
+ * Fills out with the policy, the cost of ext2_fsal_init and the page
+ * faults of the process since init.
+ */
+void map_snapshot(struct ext2_fsal_mapping_stats *out) {
+	long minflt, majflt;
+	faults(&minflt, &majflt);
+
+	memset(out, 0, sizeof(*out));
+	snprintf(out->policy, sizeof(out->policy), "%s", mapped ? policy_names[policy] : "none");
+	out->hugepages = hugepages;
+	out->init_ns = init_ns;
+	out->init_minor_faults = init_minflt;
+	out->init_major_faults = init_majflt;
+	out->minor_faults = minflt - start_minflt - init_minflt;
+	out->major_faults = majflt - start_majflt - init_majflt;
+}
@@ -0,0 +1,149 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// ------------------------- USDT PROBES ----------------------------
+
+// Static tracepoints under the provider "ext2fsal". Each one compiles
+// to a single nop plus an ELF note (.note.stapsdt) naming it, so they
+// cost nothing until perf or bpftrace attaches:
+//
+//   perf probe -x libext2fsal.so sdt_ext2fsal:op__entry
+//   bpftrace -e 'usdt:./libext2fsal.so:ext2fsal:alloc_block__return
+//                { @[arg0 > 0] = count(); }'
+//
+// Probe                     arguments
+//   op__entry               op (enum ext2_fsal_op), path a, path b
+//   op__return              op, result
+//   path_lookup__entry      path
+//   path_lookup__return     inode number or -1
+//   find_dir_entry__entry   directory inode pointer, name (within a path
+//                           while resolving one, so not terminated)
+//   find_dir_entry__return  inode number or -1
+//   alloc_block__entry      -
+//   alloc_block__return     block number or -1
+//   write_data__entry       inode pointer, size
+//   write_data__return      0 or errno
+//   add_dir_entry__entry    parent inode number, name
+//   add_dir_entry__return   0 or errno
+//   rm_free__entry          inode number (or count of inodes, rm_r)
+//   rm_free__return         -
+//
+// <sys/sdt.h> is used when installed; otherwise the notes are emitted
+// directly in the same format (x86-64 and aarch64 only).
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define EXT2FSAL_HAVE_SDT_H 1
+#endif
+#endif
+
+#if defined(EXT2FSAL_HAVE_SDT_H)
+
+#include <sys/sdt.h>
+#define PROBE0(name)              DTRACE_PROBE(ext2fsal, name)
+#define PROBE1(name, a)           DTRACE_PROBE1(ext2fsal, name, a)
+#define PROBE2(name, a, b)        DTRACE_PROBE2(ext2fsal, name, a, b)
+#define PROBE3(name, a, b, c)     DTRACE_PROBE3(ext2fsal, name, a, b, c)
+
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+
+// One stapsdt v3 note: probe address, base, semaphore (none),
+// provider, name and argument spec ("-8@%rdi ..."). Arguments are
+// widened to 64 bits so every spec is "-8@<operand>".
+#define _PROBE_NOTE(name, args)                                         \
+	"990: nop\n"                                                        \
+	".pushsection .note.stapsdt,\"?\",\"note\"\n"                       \
+	".balign 4\n"                                                       \
+	".4byte 992f-991f, 994f-993f, 3\n"                                  \
+	"991: .asciz \"stapsdt\"\n"                                         \
+	"992: .balign 4\n"                                                  \
+	"993: .8byte 990b\n"                                                \
+	".8byte _.stapsdt.base\n"                                           \
+	".8byte 0\n"                                                        \
+	".asciz \"ext2fsal\"\n"                                             \
+	".asciz \"" #name "\"\n"                                            \
+	".asciz \"" args "\"\n"                                             \
+	"994: .balign 4\n"                                                  \
+	".popsection\n"                                                     \
+	".ifndef _.stapsdt.base\n"                                          \
+	".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+	".weak _.stapsdt.base\n"                                            \
+	".hidden _.stapsdt.base\n"                                          \
+	"_.stapsdt.base: .space 1\n"                                        \
+	".size _.stapsdt.base, 1\n"                                         \
+	".popsection\n"                                                     \
+	".endif\n"
+
+#define PROBE0(name) \
+	__asm__ __volatile__(_PROBE_NOTE(name, ""))
+#define PROBE1(name, a) \
+	__asm__ __volatile__(_PROBE_NOTE(name, "-8@%[a0]") \
+		:: [a0] "nor" ((int64_t)(a)))
+#define PROBE2(name, a, b) \
+	__asm__ __volatile__(_PROBE_NOTE(name, "-8@%[a0] -8@%[a1]") \
+		:: [a0] "nor" ((int64_t)(a)), [a1] "nor" ((int64_t)(b)))
+#define PROBE3(name, a, b, c) \
+	__asm__ __volatile__(_PROBE_NOTE(name, "-8@%[a0] -8@%[a1] -8@%[a2]") \
+		:: [a0] "nor" ((int64_t)(a)), [a1] "nor" ((int64_t)(b)), \
+		   [a2] "nor" ((int64_t)(c)))
+
+#else
+
+#define PROBE0(name)              do { } while (0)
+#define PROBE1(name, a)           do { (void)(a); } while (0)
+#define PROBE2(name, a, b)        do { (void)(a); (void)(b); } while (0)
+#define PROBE3(name, a, b, c)     do { (void)(a); (void)(b); (void)(c); } while (0)
+
+#endif
+
+// ------------------------ TIMELINE EVENTS -------------------------
+
+// Regions recorded by the Chrome trace collector (timeline.c). The
+// ext2_fsal_* operations use TL_OP_BASE + enum ext2_fsal_op.
+enum timeline_event {
+	TL_PATH_LOOKUP,
+	TL_FIND_DIR_ENTRY,
+	TL_ALLOC_BLOCK,
+	TL_WRITE_DATA,
+	TL_ADD_DIR_ENTRY,
+	TL_RM_FREE,
+	TL_OP_BASE
+};
+
+extern int timeline_enabled;
+void timeline_push(void);
+void timeline_pop(int event, int64_t result);
+
+// Opens a timeline region; a flag test when the collector is off.
+static inline void timeline_begin(void) {
+	if (__builtin_expect(timeline_enabled, 0)) timeline_push();
+}
+
+// Closes the innermost open region as event with result.
+static inline void timeline_end(int event, int64_t result) {
+	if (__builtin_expect(timeline_enabled, 0)) timeline_pop(event, result);
+}
+
+// Probe and timeline region around a phase: PHASE_BEGIN1(path_lookup,
+// path) fires path_lookup__entry; PHASE_END(path_lookup,
+// TL_PATH_LOOKUP, ino) fires path_lookup__return and records the
+// region.
+#define PHASE_BEGIN0(name)        do { PROBE0(name##__entry); timeline_begin(); } while (0)
+#define PHASE_BEGIN1(name, a)     do { PROBE1(name##__entry, a); timeline_begin(); } while (0)
+#define PHASE_BEGIN2(name, a, b)  do { PROBE2(name##__entry, a, b); timeline_begin(); } while (0)
+#define PHASE_END(name, event, r) do { PROBE1(name##__return, r); timeline_end(event, r); } while (0)
+#define PHASE_END0(name, event)   do { PROBE0(name##__return); timeline_end(event, 0); } while (0)
@@ -0,0 +1,297 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Admission control for bulk operations.
+ *
+ * Operations fall into two classes. Metadata operations (mkdir, ln,
+ * rm, rename, ...) are short and always run at once. Bulk operations
+ * (cp, cp_r, the streamed copy, rm_r, defrag) move many blocks; with
+ * EXT2FSAL_QOS_BULK=n set at init at most n of them run at a time,
+ * so a flood of large copies cannot take every CPU and lock away
+ * from the metadata operations behind it.
+ *
+ * Bulk operations that find no free slot wait in a queue per client.
+ * A server names the client a thread is working for with
+ * ext2_fsal_qos_client; a freed slot goes to the next client in 
+ * round-robin order that has a waiter (deficit round robin with a 
+ * quantum of one operation), so one busy client cannot starve the 
+ * others. EXT2FSAL_QOS_QUEUE=m bounds each client's queue: beyond m
+ * waiting operations a bulk operation fails with EBUSY at once, and 
+ * ext2_fsal_qos_credits tells a server how many more it may send.
+ *
+ * Without EXT2FSAL_QOS_BULK the gate is off and costs nothing.
+ * Queue depths and waits are in the qos section of the statistics.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ext2fsal.h"
+#include "e2fs.h"
+
+// one queued bulk operation, on its thread's stack
+struct qos_waiter {
+	pthread_cond_t cond;
+	int granted;
+	struct qos_waiter *next;
+};
+
+struct qos_client {
+	uint32_t id;
+	int waiting;
+	struct qos_waiter *head, *tail;
+	struct qos_client *next;       // all clients seen, in a ring
+};
+
+static int bulk_slots;             // 0: gate off
+static int queue_limit;            // waiters per client, 0: no limit
+static int bulk_running;
+static struct qos_client *clients; // ring of clients, or NULL
+static struct qos_client *rr;      // client granted last
+static pthread_mutex_t qos_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// counters for the statistics, under qos_lock
+static uint64_t waited[EXT2_FSAL_QOS_COUNT];
+static uint64_t rejected[EXT2_FSAL_QOS_COUNT];
+static uint64_t depth[EXT2_FSAL_QOS_COUNT];
+static uint64_t max_depth[EXT2_FSAL_QOS_COUNT];
+
+static __thread uint32_t my_client;
+static __thread int held;          // bulk operations admitted on this thread
+
+/*
+ * Returns: the class of operation op.
+ */
+int qos_class(int op) {
+	switch (op) {
+	case EXT2_FSAL_OP_CP:
+	case EXT2_FSAL_OP_CP_R:
+	case EXT2_FSAL_OP_CP_STREAM:
+	case EXT2_FSAL_OP_RM_R:
+	case EXT2_FSAL_OP_DEFRAG:
+		return EXT2_FSAL_QOS_BULK;
+	default:
+		return EXT2_FSAL_QOS_META;
+	}
+}
+
+/*
+ * Returns: the record of client id, added to the ring if new, or NULL
+ * if out of memory. The caller holds qos_lock.
+ */
+static struct qos_client *find_client(uint32_t id) {
+	struct qos_client *c = clients;
+	if (c != NULL) {
+		do {
+			if (c->id == id) return c;
+			c = c->next;
+		} while (c != clients);
+	}
+
+	c = calloc(1, sizeof(*c));
+	if (c == NULL) return NULL;
+	c->id = id;
+
+	if (clients == NULL) {
+		c->next = c;
+		clients = rr = c;
+	}
+	else {
+		c->next = clients->next;
+		clients->next = c;
+	}
+	return c;
+}
+
+/*
+ * Hands a free slot to the first waiter of the next client after rr 
+ * that has one. The caller holds qos_lock.
+ */
+static void grant_next(void) {
+	if (rr == NULL || bulk_running >= bulk_slots) return;
+
+	struct qos_client *c = rr->next;
+	for (;;) {
+		if (c->head != NULL) break;
+		if (c == rr) return;  // went all the way round
+		c = c->next;
+	}
+
+	struct qos_waiter *w = c->head;
+	c->head = w->next;
+	if (c->head == NULL) c->tail = NULL;
+	c->waiting--;
+	depth[EXT2_FSAL_QOS_BULK]--;
+
+	rr = c;
+	bulk_running++;
+	w->granted = 1;
+	pthread_cond_signal(&w->cond);
+}
+
+/*
+ * Admits operation op, waiting for a bulk slot if its class needs 
+ * one. Operations nested in an admitted bulk operation pass through.
+ * may_reject is 0 for calls that continue work already admitted 
+ * (the later calls of a streamed copy), which wait instead of 
+ * failing.
+ *
+ * Returns: 0 once admitted (pair with qos_release), or EBUSY if the
+ * client's queue is full.
+ */
+int qos_admit(int op, int may_reject) {
+	if (bulk_slots == 0 || qos_class(op) != EXT2_FSAL_QOS_BULK) return 0;
+	if (held++ > 0) return 0;
+
+	uint64_t start = stats_now();
+	pthread_mutex_lock(&qos_lock);
+
+	struct qos_client *c = find_client(my_client);
+
+	// a free slot is taken at once unless others are already queued
+	if (bulk_running < bulk_slots && depth[EXT2_FSAL_QOS_BULK] == 0) {
+		bulk_running++;
+		pthread_mutex_unlock(&qos_lock);
+		return 0;
+	}
+
+	if (c == NULL || (may_reject && queue_limit > 0 && c->waiting >= queue_limit)) {
+		rejected[EXT2_FSAL_QOS_BULK]++;
+		pthread_mutex_unlock(&qos_lock);
+		held--;
+		return EBUSY;
+	}
+
+	struct qos_waiter w;
+	pthread_cond_init(&w.cond, NULL);
+	w.granted = 0;
+	w.next = NULL;
+	if (c->tail) c->tail->next = &w;
+	else c->head = &w;
+	c->tail = &w;
+	c->waiting++;
+
+	waited[EXT2_FSAL_QOS_BULK]++;
+	if (++depth[EXT2_FSAL_QOS_BULK] > max_depth[EXT2_FSAL_QOS_BULK])
+		max_depth[EXT2_FSAL_QOS_BULK] = depth[EXT2_FSAL_QOS_BULK];
+
+	// a slot may have freed up while nobody was queued
+	grant_next();
+	while (!w.granted) pthread_cond_wait(&w.cond, &qos_lock);
+
+	pthread_mutex_unlock(&qos_lock);
+	pthread_cond_destroy(&w.cond);
+
+	stats_qos_wait(EXT2_FSAL_QOS_BULK, start);
+	return 0;
+}
+
+/*
+ * Releases what qos_admit(op, ...) took, passing the slot on.
+ */
+void qos_release(int op) {
+	if (bulk_slots == 0 || qos_class(op) != EXT2_FSAL_QOS_BULK) return;
+	if (--held > 0) return;
+
+	pthread_mutex_lock(&qos_lock);
+	bulk_running--;
+	grant_next();
+	pthread_mutex_unlock(&qos_lock);
+}
+
+/*
+ * Names the client whose requests the calling thread runs from now on.
+ */
+void ext2_fsal_qos_client(uint32_t client) {
+	my_client = client;
+}
+
+/*
+ * Returns: how many more bulk operations client may queue before they
+ * are refused, or -1 if there is no limit.
+ */
+int32_t ext2_fsal_qos_credits(uint32_t client) {
+	if (bulk_slots == 0 || queue_limit == 0) return -1;
+
+	pthread_mutex_lock(&qos_lock);
+	int waiting = 0;
+	struct qos_client *c = clients;
+	if (c != NULL) {
+		do {
+			if (c->id == client) waiting = c->waiting;
+			c = c->next;
+		} while (c != clients);
+	}
+	pthread_mutex_unlock(&qos_lock);
+
+	return queue_limit - waiting;
+}
+
+/*
+ * Fills in the queue counters of each class.
+ */
+void qos_snapshot(struct ext2_fsal_qos_stats *out) {
+	pthread_mutex_lock(&qos_lock);
+	for (int i = 0; i < EXT2_FSAL_QOS_COUNT; i++) {
+		out[i].waited = waited[i];
+		out[i].rejected = rejected[i];
+		out[i].depth = depth[i];
+		out[i].max_depth = max_depth[i];
+	}
+	pthread_mutex_unlock(&qos_lock);
+}
+
+/*
+ * Reads EXT2FSAL_QOS_BULK and EXT2FSAL_QOS_QUEUE. Called from 
+ * ext2_fsal_init.
+ */
+void qos_init(void) {
+	const char *slots = getenv("EXT2FSAL_QOS_BULK");
+	const char *queue = getenv("EXT2FSAL_QOS_QUEUE");
+
+	bulk_slots = slots ? atoi(slots) : 0;
+	if (bulk_slots < 0) bulk_slots = 0;
+	queue_limit = queue ? atoi(queue) : 0;
+	if (queue_limit < 0) queue_limit = 0;
+
+	bulk_running = 0;
+	memset(waited, 0, sizeof(waited));
+	memset(rejected, 0, sizeof(rejected));
+	memset(depth, 0, sizeof(depth));
+	memset(max_depth, 0, sizeof(max_depth));
+}
+
+/*
+ * Frees the client records. Called from ext2_fsal_destroy once no 
+ * operations are running.
+ */
+void qos_destroy(void) {
+	pthread_mutex_lock(&qos_lock);
+
+	// open the ring, then free it as a list
+	struct qos_client *c = NULL;
+	if (clients != NULL) {
+		c = clients->next;
+		clients->next = NULL;
+	}
+	while (c != NULL) {
+		struct qos_client *next = c->next;
+		free(c);
+		c = next;
+	}
+	clients = rr = NULL;
+	bulk_slots = 0;
+	pthread_mutex_unlock(&qos_lock);
+}
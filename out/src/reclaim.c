@@ -0,0 +1,282 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Epoch-based reclamation of inodes and directory blocks.
+ *
+ * Lookups walk directory blocks and read inodes without locks, so an
+ * inode or directory block that is unlinked must not be handed out
+ * again while a lookup that started before the unlink may still read
+ * it. Instead of going back to the bitmaps right away, such items are
+ * retired into a limbo list tagged with the global epoch, and freed
+ * two epochs later.
+ *
+ * Every public operation is one read-side section (reclaim_enter and
+ * reclaim_exit; nested operations join the outer one). A thread in a
+ * section publishes the epoch it entered in. The epoch advances only
+ * once every thread inside a section has seen the current one, so
+ * after two advances no thread can still hold a reference from before
+ * an item was retired. Threads that work on behalf of an operation
+ * (cp_r's copy workers) are covered by their caller's section.
+ *
+ * Sections leaving with items in limbo try to advance, so in a single
+ * thread everything is freed by the end of the operation that retired
+ * it. A long operation (defrag) holds reclamation back for as long
+ * as it runs, and allocation that runs out tries an advance before
+ * failing.
+ *
+ * Only what lookups read without locks is deferred: the blocks of
+ * regular files and symlinks are freed at once.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ext2fsal.h"
+#include "e2fs.h"
+
+// a thread's published state; records are recycled once their
+// thread exits, and live as long as the process (a thread's key may
+// point at one across ext2_fsal_destroy)
+struct reclaim_rec {
+	uint64_t epoch;                // epoch entered in, 0 outside a section
+	int in_use;
+	struct reclaim_rec *next;
+};
+
+// items retired during one epoch
+struct limbo {
+	int *inos, ninos, inos_cap;
+	int *blocks, nblocks, blocks_cap;
+	int dirs;                      // directories among inos
+};
+
+static uint64_t global_epoch = 1;
+static struct limbo limbo[3];      // indexed by epoch % 3
+static int pending;                // items in limbo
+static pthread_mutex_t limbo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct reclaim_rec *recs;
+static pthread_key_t rec_key;
+static pthread_once_t rec_key_once = PTHREAD_ONCE_INIT;
+static __thread struct reclaim_rec *my_rec;
+static __thread int depth;         // nesting of sections on this thread
+
+// ------------------------- THREAD RECORDS --------------------------
+
+static void rec_destructor(void *arg) {
+	struct reclaim_rec *rec = arg;
+	__atomic_store_n(&rec->epoch, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&rec->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void make_rec_key(void) {
+	pthread_key_create(&rec_key, rec_destructor);
+}
+
+/*
+ * Returns: the calling thread's record, taking over the record of an
+ * exited thread or registering a new one, or NULL if out of memory.
+ */
+static struct reclaim_rec *get_rec(void) {
+	if (my_rec != NULL) return my_rec;
+
+	pthread_once(&rec_key_once, make_rec_key);
+	pthread_mutex_lock(&limbo_lock);
+
+	struct reclaim_rec *rec;
+	for (rec = recs; rec != NULL; rec = rec->next) {
+		if (!rec->in_use) break;
+	}
+	if (rec == NULL) {
+		rec = calloc(1, sizeof(*rec));
+		if (rec == NULL) {
+			pthread_mutex_unlock(&limbo_lock);
+			return NULL;
+		}
+		rec->next = recs;
+		__atomic_store_n(&recs, rec, __ATOMIC_RELEASE);
+	}
+	rec->in_use = 1;
+
+	pthread_mutex_unlock(&limbo_lock);
+
+	pthread_setspecific(rec_key, rec);
+	my_rec = rec;
+	return rec;
+}
+
+// ---------------------------- SECTIONS -----------------------------
+
+/*
+ * Enters a read-side section; nested calls join the outermost one.
+ */
+void reclaim_enter(void) {
+	if (depth++ > 0) return;
+
+	struct reclaim_rec *rec = get_rec();
+	if (rec == NULL) return;
+
+	// published before anything is read (a full barrier on x86)
+	__atomic_store_n(&rec->epoch, __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST),
+			__ATOMIC_SEQ_CST);
+}
+
+/*
+ * Leaves a read-side section. The outermost exit tries to free what
+ * is waiting in limbo.
+ */
+void reclaim_exit(void) {
+	if (--depth > 0) return;
+
+	if (my_rec != NULL) __atomic_store_n(&my_rec->epoch, 0, __ATOMIC_SEQ_CST);
+
+	// two advances free everything retired before this section left
+	if (__atomic_load_n(&pending, __ATOMIC_RELAXED) > 0) {
+		if (reclaim_advance() >= 0) reclaim_advance();
+	}
+}
+
+// ---------------------------- RETIRING -----------------------------
+
+/*
+ * Appends count numbers from src to the array *arr (length *n, room
+ * for *cap).
+ *
+ * Returns: 0 on success, -1 if the array cannot grow.
+ */
+static int push_nums(int **arr, int *n, int *cap, const int *src, int count) {
+	if (*n + count > *cap) {
+		int new_cap = *cap ? *cap * 2 : 256;
+		while (new_cap < *n + count) new_cap *= 2;
+
+		int *grown = realloc(*arr, sizeof(int) * new_cap);
+		if (grown == NULL) return -1;
+		*arr = grown;
+		*cap = new_cap;
+	}
+	memcpy(*arr + *n, src, sizeof(int) * count);
+	*n += count;
+	return 0;
+}
+
+/*
+ * Retires count unlinked inodes (1-based), dirs of them directories:
+ * they are freed as by free_inodes_bulk once no lookup can reach them.
+ */
+void reclaim_inodes(int *inos, int count, int dirs) {
+	if (count == 0) return;
+
+	pthread_mutex_lock(&limbo_lock);
+	struct limbo *l = &limbo[global_epoch % 3];
+	int retval = push_nums(&l->inos, &l->ninos, &l->inos_cap, inos, count);
+	if (retval == 0) {
+		l->dirs += dirs;
+		__atomic_fetch_add(&pending, count, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&limbo_lock);
+
+	// no room to wait: free now, as without reclamation
+	if (retval != 0) free_inodes_bulk(inos, count, dirs);
+}
+
+/*
+ * Retires count blocks of removed directories: they are freed as by
+ * free_blocks_bulk once no lookup can reach them.
+ */
+void reclaim_blocks(int *blocks, int count) {
+	if (count == 0) return;
+
+	pthread_mutex_lock(&limbo_lock);
+	struct limbo *l = &limbo[global_epoch % 3];
+	int retval = push_nums(&l->blocks, &l->nblocks, &l->blocks_cap, blocks, count);
+	if (retval == 0) __atomic_fetch_add(&pending, count, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&limbo_lock);
+
+	if (retval != 0) free_blocks_bulk(blocks, count);
+}
+
+/*
+ * Frees everything in l and empties it. The caller owns l.
+ */
+static void free_limbo(struct limbo *l) {
+	free_blocks_bulk(l->blocks, l->nblocks);
+	free_inodes_bulk(l->inos, l->ninos, l->dirs);
+	free(l->blocks);
+	free(l->inos);
+	memset(l, 0, sizeof(*l));
+}
+
+/*
+ * Advances the global epoch if every thread inside a section has seen
+ * the current one, and frees the items retired two epochs back.
+ *
+ * Returns: the number of items freed, or -1 if the epoch could not
+ * advance.
+ */
+int reclaim_advance(void) {
+	pthread_mutex_lock(&limbo_lock);
+
+	uint64_t e = global_epoch;
+	for (struct reclaim_rec *rec = recs; rec != NULL; rec = rec->next) {
+		uint64_t seen = __atomic_load_n(&rec->epoch, __ATOMIC_SEQ_CST);
+		if (seen != 0 && seen != e) {
+			pthread_mutex_unlock(&limbo_lock);
+			return -1;
+		}
+	}
+	__atomic_store_n(&global_epoch, e + 1, __ATOMIC_SEQ_CST);
+
+	// retired at e - 1: nobody in a section can still see them
+	struct limbo done = limbo[(e + 2) % 3];
+	memset(&limbo[(e + 2) % 3], 0, sizeof(struct limbo));
+	int freed = done.ninos + done.nblocks;
+	__atomic_fetch_sub(&pending, freed, __ATOMIC_RELAXED);
+
+	pthread_mutex_unlock(&limbo_lock);
+
+	free_limbo(&done);
+	return freed;
+}
+
+// ------------------------ INIT & CLEANUP ---------------------------
+
+/*
+ * Resets the epoch and limbo. Called from ext2_fsal_init.
+ */
+void reclaim_init(void) {
+	pthread_mutex_lock(&limbo_lock);
+	global_epoch = 1;
+	pending = 0;
+	memset(limbo, 0, sizeof(limbo));
+	pthread_mutex_unlock(&limbo_lock);
+}
+
+/*
+ * Frees everything still in limbo (no operations are running). Called
+ * from ext2_fsal_destroy while the bitmaps and their locks still
+ * exist.
+ */
+void reclaim_destroy(void) {
+	pthread_mutex_lock(&limbo_lock);
+
+	struct limbo all[3];
+	memcpy(all, limbo, sizeof(all));
+	memset(limbo, 0, sizeof(limbo));
+	pending = 0;
+
+	pthread_mutex_unlock(&limbo_lock);
+
+	for (int i = 0; i < 3; i++) free_limbo(&all[i]);
+}
@@ -0,0 +1,567 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Always-on operation statistics.
+ *
+ * Every thread that runs filesystem code gets its own shard holding
+ * latency histograms for each ext2_fsal_* operation, admission class
+ * (see qos.c) and internal phase, and wait counters for each lock
+ * class. A shard only ever
+ * has one writer, so recording is a handful of plain relaxed stores
+ * with no locks or atomic read-modify-writes. Snapshots walk the
+ * shard list and sum the shards while the writers keep running.
+ *
+ * Histograms are log-linear (HDR style): values below HIST_SUB are
+ * exact, and every power of two above is split into HIST_SUB equal
+ * buckets, bounding the relative error at 1/HIST_SUB.
+ *
+ * If EXT2FSAL_STATS_PATH is set at init, sending SIGUSR1 to the
+ * server writes a JSON snapshot to that path (and, in LOCKPROF
+ * builds, the lock profile to path.locks); EXT2FSAL_STATS=0 turns
+ * recording off. The same signal also writes the timeline when
+ * EXT2FSAL_TIMELINE is set.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ext2fsal.h"
+#include "e2fs.h"
+#include "probes.h"
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40   // values are clamped below 2^40 ns (~18 min)
+#define HIST_BUCKETS  ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct stats_hist {
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t max_ns;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+struct stats_shard {
+	struct stats_hist ops[EXT2_FSAL_OP_COUNT];
+	struct stats_hist phases[EXT2_FSAL_PHASE_COUNT];
+	struct ext2_fsal_lock_stats locks[EXT2_FSAL_LOCK_COUNT];
+	struct ext2_fsal_defrag_stats defrag;
+	struct stats_hist classes[EXT2_FSAL_QOS_COUNT];   // ops by admission class
+	struct stats_hist qos_wait[EXT2_FSAL_QOS_COUNT];
+	struct stats_shard *next;
+};
+
+static const char *op_names[EXT2_FSAL_OP_COUNT] = {
+	"cp", "ln_hl", "ln_sl", "rm", "mkdir",
+	"rename", "rm_r", "mkdir_p", "cp_r", "defrag", "cp_stream",
+	"write", "truncate",
+};
+
+static const char *phase_names[EXT2_FSAL_PHASE_COUNT] = {
+	"path_lookup", "alloc", "data_copy", "dirent_insert",
+};
+
+static const char *qos_names[EXT2_FSAL_QOS_COUNT] = {
+	"meta", "bulk",
+};
+
+static const char *lock_names[EXT2_FSAL_LOCK_COUNT] = {
+	"inode_locks", "block_locks", "name_locks", "inode_bitmap_lock",
+	"block_bitmap_lock", "other",
+};
+
+static int stats_enabled = 1;
+static struct stats_shard *shards;          // all shards ever created
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static int shards_gen = 1;                  // bumped when shards are freed
+static __thread struct stats_shard *my_shard;
+static __thread int my_shard_gen;
+
+// SIGUSR1 export
+static const char *export_path;
+static int exporting;                 // export thread running
+static int export_pipe[2] = { -1, -1 };
+static pthread_t export_thread;
+
+// ------------------------- RECORDING -----------------------------
+
+/*
+ * Returns: the calling thread's shard, creating and registering it
+ * on first use (NULL if memory is exhausted).
+ */
+static struct stats_shard *get_shard(void) {
+	if (my_shard != NULL && my_shard_gen == __atomic_load_n(&shards_gen, __ATOMIC_RELAXED)) 
+		return my_shard;
+
+	struct stats_shard *shard = calloc(1, sizeof(*shard));
+	if (shard == NULL) return NULL;
+
+	pthread_mutex_lock(&shards_lock);
+	shard->next = shards;
+	__atomic_store_n(&shards, shard, __ATOMIC_RELEASE);
+	my_shard_gen = shards_gen;
+	pthread_mutex_unlock(&shards_lock);
+
+	my_shard = shard;
+	return shard;
+}
+
+/*
+ * Single-writer counter increment: readers may see a stale value
+ * but never a torn one.
+ */
+static inline void counter_add(uint64_t *c, uint64_t v) {
+	__atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+static inline void counter_max(uint64_t *c, uint64_t v) {
+	if (v > __atomic_load_n(c, __ATOMIC_RELAXED))
+		__atomic_store_n(c, v, __ATOMIC_RELAXED);
+}
+
+/*
+ * Returns: the histogram bucket for a value in nanoseconds.
+ */
+static int hist_bucket(uint64_t v) {
+	if (v < HIST_SUB) return (int)v;
+	if (v >> HIST_MAX_BITS) v = (1ULL << HIST_MAX_BITS) - 1;
+
+	int msb = 63 - __builtin_clzll(v);
+	int shift = msb - HIST_SUB_BITS;
+	return (shift + 1) * HIST_SUB + (int)((v >> shift) & (HIST_SUB - 1));
+}
+
+/*
+ * Returns: the largest value that falls in bucket idx.
+ */
+static uint64_t hist_bucket_high(int idx) {
+	if (idx < HIST_SUB) return idx;
+
+	int shift = idx / HIST_SUB - 1;
+	uint64_t sub = idx % HIST_SUB;
+	return ((HIST_SUB + sub + 1) << shift) - 1;
+}
+
+static void hist_record(struct stats_hist *h, uint64_t ns) {
+	counter_add(&h->count, 1);
+	counter_add(&h->sum_ns, ns);
+	counter_max(&h->max_ns, ns);
+	counter_add(&h->buckets[hist_bucket(ns)], 1);
+}
+
+/*
+ * Returns: monotonic time in nanoseconds, or 0 when statistics are
+ * disabled.
+ */
+uint64_t stats_now(void) {
+	if (!stats_enabled) return 0;
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Records the latency of operation op that started at start (a
+ * stats_now() value), also under its admission class.
+ */
+void stats_op_done(int op, uint64_t start) {
+	if (!stats_enabled || start == 0) return;
+
+	struct stats_shard *shard = get_shard();
+	if (shard == NULL) return;
+
+	uint64_t ns = stats_now() - start;
+	hist_record(&shard->ops[op], ns);
+	hist_record(&shard->classes[qos_class(op)], ns);
+}
+
+/*
+ * Records the time an operation of admission class cls spent queued
+ * since start.
+ */
+void stats_qos_wait(int cls, uint64_t start) {
+	if (!stats_enabled || start == 0) return;
+
+	struct stats_shard *shard = get_shard();
+	if (shard) hist_record(&shard->qos_wait[cls], stats_now() - start);
+}
+
+/*
+ * Records the latency of internal phase phase that started at start.
+ */
+void stats_phase_done(int phase, uint64_t start) {
+	if (!stats_enabled || start == 0) return;
+
+	struct stats_shard *shard = get_shard();
+	if (shard) hist_record(&shard->phases[phase], stats_now() - start);
+}
+
+/*
+ * Records one acquisition of a lock of class cls; wait_ns is the time
+ * spent blocked, or 0 if the lock was free.
+ */
+void stats_lock_acquired(int cls, uint64_t wait_ns, int contended) {
+	if (!stats_enabled) return;
+
+	struct stats_shard *shard = get_shard();
+	if (shard == NULL) return;
+
+	struct ext2_fsal_lock_stats *l = &shard->locks[cls];
+	counter_add(&l->acquisitions, 1);
+	if (contended) {
+		counter_add(&l->contended, 1);
+		counter_add(&l->wait_ns, wait_ns);
+		counter_max(&l->max_wait_ns, wait_ns);
+	}
+}
+
+/*
+ * Adds the results of one ext2_fsal_defrag call.
+ */
+void stats_defrag_done(const struct ext2_fsal_defrag_stats *d) {
+	if (!stats_enabled) return;
+
+	struct stats_shard *shard = get_shard();
+	if (shard == NULL) return;
+
+	struct ext2_fsal_defrag_stats *t = &shard->defrag;
+	counter_add(&t->files, d->files);
+	counter_add(&t->moved, d->moved);
+	counter_add(&t->skipped, d->skipped);
+	counter_add(&t->blocks_moved, d->blocks_moved);
+	counter_add(&t->extents_before, d->extents_before);
+	counter_add(&t->extents_after, d->extents_after);
+	counter_add(&t->throttle_ns, d->throttle_ns);
+}
+
+/*
+ * Returns: the report name of lock class cls.
+ */
+const char *stats_lock_name(int cls) {
+	return lock_names[cls];
+}
+
+// ------------------------- SNAPSHOTS -----------------------------
+
+/*
+ * Condenses a merged histogram into count, totals and percentiles.
+ */
+static void summarize_hist(struct stats_hist *h, struct ext2_fsal_latency *out) {
+	static const double quantiles[4] = { 0.50, 0.90, 0.99, 0.999 };
+	uint64_t *targets[4] = { &out->p50_ns, &out->p90_ns, &out->p99_ns, &out->p999_ns };
+
+	out->count = h->count;
+	out->total_ns = h->sum_ns;
+	out->max_ns = h->max_ns;
+
+	// bucket counts may run slightly ahead of count while writers
+	// are active, so rank against the bucket total
+	uint64_t total = 0;
+	for (int b = 0; b < HIST_BUCKETS; b++) total += h->buckets[b];
+
+	uint64_t seen = 0;
+	int q = 0;
+	for (int b = 0; b < HIST_BUCKETS && q < 4; b++) {
+		seen += h->buckets[b];
+		while (q < 4 && total > 0 && seen >= (uint64_t)(quantiles[q] * total + 0.5)) {
+			uint64_t v = hist_bucket_high(b);
+			*targets[q++] = v < h->max_ns ? v : h->max_ns;
+		}
+	}
+}
+
+static void merge_hist(struct stats_hist *dst, struct stats_hist *src) {
+	dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+	dst->sum_ns += __atomic_load_n(&src->sum_ns, __ATOMIC_RELAXED);
+
+	uint64_t max = __atomic_load_n(&src->max_ns, __ATOMIC_RELAXED);
+	if (max > dst->max_ns) dst->max_ns = max;
+
+	for (int b = 0; b < HIST_BUCKETS; b++)
+		dst->buckets[b] += __atomic_load_n(&src->buckets[b], __ATOMIC_RELAXED);
+}
+
+/*
+ * Fills out with the current totals of all threads. Runs
+ * concurrently with filesystem operations and never blocks them.
+ */
+void ext2_fsal_stats_snapshot(struct ext2_fsal_stats *out) {
+	memset(out, 0, sizeof(*out));
+	map_snapshot(&out->mapping);
+	blockdev_snapshot(&out->blockdev);
+	qos_snapshot(out->qos);
+
+	struct stats_hist *merged = calloc(1, sizeof(struct stats_hist));
+	if (merged == NULL) return;
+
+	struct stats_shard *head = __atomic_load_n(&shards, __ATOMIC_ACQUIRE);
+
+	for (int op = 0; op < EXT2_FSAL_OP_COUNT; op++) {
+		memset(merged, 0, sizeof(*merged));
+		for (struct stats_shard *s = head; s; s = s->next) merge_hist(merged, &s->ops[op]);
+		summarize_hist(merged, &out->ops[op]);
+	}
+
+	for (int ph = 0; ph < EXT2_FSAL_PHASE_COUNT; ph++) {
+		memset(merged, 0, sizeof(*merged));
+		for (struct stats_shard *s = head; s; s = s->next) merge_hist(merged, &s->phases[ph]);
+		summarize_hist(merged, &out->phases[ph]);
+	}
+
+	for (int c = 0; c < EXT2_FSAL_QOS_COUNT; c++) {
+		memset(merged, 0, sizeof(*merged));
+		for (struct stats_shard *s = head; s; s = s->next) merge_hist(merged, &s->classes[c]);
+		summarize_hist(merged, &out->qos[c].latency);
+
+		memset(merged, 0, sizeof(*merged));
+		for (struct stats_shard *s = head; s; s = s->next) merge_hist(merged, &s->qos_wait[c]);
+		summarize_hist(merged, &out->qos[c].wait);
+	}
+
+	for (struct stats_shard *s = head; s; s = s->next) {
+		for (int c = 0; c < EXT2_FSAL_LOCK_COUNT; c++) {
+			struct ext2_fsal_lock_stats *src = &s->locks[c];
+			struct ext2_fsal_lock_stats *dst = &out->locks[c];
+
+			dst->acquisitions += __atomic_load_n(&src->acquisitions, __ATOMIC_RELAXED);
+			dst->contended += __atomic_load_n(&src->contended, __ATOMIC_RELAXED);
+			dst->wait_ns += __atomic_load_n(&src->wait_ns, __ATOMIC_RELAXED);
+
+			uint64_t max = __atomic_load_n(&src->max_wait_ns, __ATOMIC_RELAXED);
+			if (max > dst->max_wait_ns) dst->max_wait_ns = max;
+		}
+	}
+
+	for (struct stats_shard *s = head; s; s = s->next) {
+		struct ext2_fsal_defrag_stats *src = &s->defrag;
+		struct ext2_fsal_defrag_stats *dst = &out->defrag;
+
+		dst->files += __atomic_load_n(&src->files, __ATOMIC_RELAXED);
+		dst->moved += __atomic_load_n(&src->moved, __ATOMIC_RELAXED);
+		dst->skipped += __atomic_load_n(&src->skipped, __ATOMIC_RELAXED);
+		dst->blocks_moved += __atomic_load_n(&src->blocks_moved, __ATOMIC_RELAXED);
+		dst->extents_before += __atomic_load_n(&src->extents_before, __ATOMIC_RELAXED);
+		dst->extents_after += __atomic_load_n(&src->extents_after, __ATOMIC_RELAXED);
+		dst->throttle_ns += __atomic_load_n(&src->throttle_ns, __ATOMIC_RELAXED);
+	}
+
+	free(merged);
+}
+
+static void dump_latency(FILE *f, const char *name, struct ext2_fsal_latency *l, int last) {
+	fprintf(f, "    \"%s\": {\"count\": %llu, \"total_ns\": %llu, \"max_ns\": %llu, "
+		   "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu}%s\n",
+		name, (unsigned long long)l->count, (unsigned long long)l->total_ns,
+		(unsigned long long)l->max_ns, (unsigned long long)l->p50_ns,
+		(unsigned long long)l->p90_ns, (unsigned long long)l->p99_ns,
+		(unsigned long long)l->p999_ns, last ? "" : ",");
+}
+
+/*
+ * Writes a snapshot of all statistics as JSON to fd.
+ */
+void ext2_fsal_stats_dump(int fd) {
+	struct ext2_fsal_stats st;
+	ext2_fsal_stats_snapshot(&st);
+
+	FILE *f = fdopen(dup(fd), "w");
+	if (f == NULL) return;
+
+	fprintf(f, "{\n  \"ops\": {\n");
+	for (int i = 0; i < EXT2_FSAL_OP_COUNT; i++)
+		dump_latency(f, op_names[i], &st.ops[i], i == EXT2_FSAL_OP_COUNT - 1);
+
+	fprintf(f, "  },\n  \"phases\": {\n");
+	for (int i = 0; i < EXT2_FSAL_PHASE_COUNT; i++)
+		dump_latency(f, phase_names[i], &st.phases[i], i == EXT2_FSAL_PHASE_COUNT - 1);
+
+	fprintf(f, "  },\n  \"locks\": {\n");
+	for (int i = 0; i < EXT2_FSAL_LOCK_COUNT; i++) {
+		struct ext2_fsal_lock_stats *l = &st.locks[i];
+		fprintf(f, "    \"%s\": {\"acquisitions\": %llu, \"contended\": %llu, "
+			   "\"wait_ns\": %llu, \"max_wait_ns\": %llu}%s\n",
+			lock_names[i], (unsigned long long)l->acquisitions,
+			(unsigned long long)l->contended, (unsigned long long)l->wait_ns,
+			(unsigned long long)l->max_wait_ns, i == EXT2_FSAL_LOCK_COUNT - 1 ? "" : ",");
+	}
+
+	struct ext2_fsal_defrag_stats *d = &st.defrag;
+	double files = d->files ? (double)d->files : 1.0;
+	fprintf(f, "  },\n  \"defrag\": {\"files\": %llu, \"moved\": %llu, \"skipped\": %llu, "
+		   "\"blocks_moved\": %llu, \"extents_per_file_before\": %.3f, "
+		   "\"extents_per_file_after\": %.3f, \"throttle_ns\": %llu},\n",
+		(unsigned long long)d->files, (unsigned long long)d->moved,
+		(unsigned long long)d->skipped, (unsigned long long)d->blocks_moved,
+		d->extents_before / files, d->extents_after / files,
+		(unsigned long long)d->throttle_ns);
+
+	struct ext2_fsal_mapping_stats *m = &st.mapping;
+	fprintf(f, "  \"mapping\": {\"policy\": \"%s\", \"hugepages\": %s, \"init_ns\": %llu, "
+		   "\"init_minor_faults\": %llu, \"init_major_faults\": %llu, "
+		   "\"minor_faults\": %llu, \"major_faults\": %llu},\n",
+		m->policy, m->hugepages ? "true" : "false", (unsigned long long)m->init_ns,
+		(unsigned long long)m->init_minor_faults, (unsigned long long)m->init_major_faults,
+		(unsigned long long)m->minor_faults, (unsigned long long)m->major_faults);
+
+	struct ext2_fsal_blockdev_stats *b = &st.blockdev;
+	fprintf(f, "  \"blockdev\": {\"backend\": \"%s\", \"block_size\": %u, \"cache_blocks\": %llu, "
+		   "\"hits\": %llu, \"misses\": %llu, \"writebacks\": %llu, \"meta_writebacks\": %llu, "
+		   "\"aio\": \"%s\", \"aio_requests\": %llu, \"aio_enters\": %llu},\n",
+		b->backend, b->block_size, (unsigned long long)b->cache_blocks, (unsigned long long)b->hits,
+		(unsigned long long)b->misses, (unsigned long long)b->writebacks,
+		(unsigned long long)b->meta_writebacks, b->aio,
+		(unsigned long long)b->aio_requests, (unsigned long long)b->aio_enters);
+
+	fprintf(f, "  \"qos\": {\n");
+	for (int i = 0; i < EXT2_FSAL_QOS_COUNT; i++) {
+		struct ext2_fsal_qos_stats *q = &st.qos[i];
+		fprintf(f, "    \"%s\": {\"waited\": %llu, \"rejected\": %llu, \"depth\": %llu, "
+			   "\"max_depth\": %llu,\n", qos_names[i], (unsigned long long)q->waited,
+			(unsigned long long)q->rejected, (unsigned long long)q->depth,
+			(unsigned long long)q->max_depth);
+		fprintf(f, "      \"wait\": {\"count\": %llu, \"max_ns\": %llu, \"p50_ns\": %llu, "
+			   "\"p99_ns\": %llu},\n", (unsigned long long)q->wait.count,
+			(unsigned long long)q->wait.max_ns, (unsigned long long)q->wait.p50_ns,
+			(unsigned long long)q->wait.p99_ns);
+		fprintf(f, "      \"latency\": {\"count\": %llu, \"max_ns\": %llu, \"p50_ns\": %llu, "
+			   "\"p99_ns\": %llu, \"p999_ns\": %llu}}%s\n", (unsigned long long)q->latency.count,
+			(unsigned long long)q->latency.max_ns, (unsigned long long)q->latency.p50_ns,
+			(unsigned long long)q->latency.p99_ns, (unsigned long long)q->latency.p999_ns,
+			i == EXT2_FSAL_QOS_COUNT - 1 ? "" : ",");
+	}
+	fprintf(f, "  }\n}\n");
+
+	fclose(f);
+}
+
+// ----------------------- SIGUSR1 EXPORT --------------------------
+
+/*
+ * Signal handler: only wakes the export thread (write() is
+ * async-signal-safe).
+ */
+static void on_export_signal(int sig) {
+	(void)sig;
+	int saved = errno;
+	char c = 'd';
+	if (write(export_pipe[1], &c, 1) < 0) { /* export already pending */ }
+	errno = saved;
+}
+
+/*
+ * Export thread: writes a snapshot to export_path for every wakeup,
+ * via a temporary file so readers never see a partial one. Exits on
+ * a 'q' byte.
+ */
+static void *export_main(void *arg) {
+	(void)arg;
+	char c;
+	char tmp[PATH_MAX];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", export_path ? export_path : "");
+
+	while (read(export_pipe[0], &c, 1) == 1 && c != 'q') {
+		timeline_export();
+		if (export_path == NULL) continue;
+
+		int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) continue;
+		ext2_fsal_stats_dump(fd);
+		close(fd);
+		rename(tmp, export_path);
+
+#ifdef EXT2FSAL_LOCKPROF
+		// the lock profile goes next to the statistics
+		char locks_path[PATH_MAX];
+		snprintf(locks_path, sizeof(locks_path), "%s.locks", export_path);
+		fd = open(locks_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) continue;
+		ext2_fsal_lockprof_dump(fd);
+		close(fd);
+#endif
+	}
+
+	return NULL;
+}
+
+/*
+ * Reads the statistics configuration from the environment and starts
+ * the SIGUSR1 exporter if requested. Called from ext2_fsal_init.
+ */
+void stats_init(void) {
+	const char *enabled = getenv("EXT2FSAL_STATS");
+	if (enabled && strcmp(enabled, "0") == 0) stats_enabled = 0;
+
+	export_path = getenv("EXT2FSAL_STATS_PATH");
+	if (!stats_enabled) export_path = NULL;
+
+	// the timeline collector shares the exporter
+	if (export_path == NULL && !timeline_enabled) return;
+
+	if (pipe(export_pipe) < 0) {
+		perror("pipe");
+		export_path = NULL;
+		return;
+	}
+	fcntl(export_pipe[1], F_SETFL, O_NONBLOCK);
+
+	if (pthread_create(&export_thread, NULL, export_main, NULL) != 0) {
+		close(export_pipe[0]);
+		close(export_pipe[1]);
+		export_path = NULL;
+		return;
+	}
+	exporting = 1;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_export_signal;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, NULL);
+}
+
+/*
+ * Stops the exporter and releases all shards. Called from
+ * ext2_fsal_destroy once no operations are running.
+ */
+void stats_destroy(void) {
+	if (exporting) {
+		exporting = 0;
+		signal(SIGUSR1, SIG_DFL);
+		char c = 'q';
+		if (write(export_pipe[1], &c, 1) == 1) pthread_join(export_thread, NULL);
+		close(export_pipe[0]);
+		close(export_pipe[1]);
+		export_path = NULL;
+	}
+
+	pthread_mutex_lock(&shards_lock);
+	struct stats_shard *s = shards;
+	shards = NULL;
+	__atomic_store_n(&shards_gen, shards_gen + 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&shards_lock);
+
+	while (s) {
+		struct stats_shard *next = s->next;
+		free(s);
+		s = next;
+	}
+}
@@ -0,0 +1,252 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Chrome trace (Perfetto) timeline collector.
+ *
+ * With EXT2FSAL_TIMELINE=path set at init, every ext2_fsal_* call and
+ * traced phase (see probes.h) is recorded as a complete event in a
+ * per-thread ring of EXT2FSAL_TIMELINE_EVENTS (default 65536) slots;
+ * when a ring wraps the oldest events are overwritten. The timeline is
+ * written as Chrome trace JSON to path at ext2_fsal_destroy, on
+ * SIGUSR1, or through ext2_fsal_timeline_dump, and opens directly in
+ * ui.perfetto.dev or chrome://tracing. Dumps taken while operations
+ * run are best effort: events being overwritten may be skipped.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "ext2fsal.h"
+#include "e2fs.h"
+#include "probes.h"
+
+#define DEFAULT_EVENTS 65536
+#define MAX_DEPTH      32
+
+struct tl_event {
+	uint64_t start_ns;
+	uint64_t dur_ns;
+	int64_t result;
+	int event;
+};
+
+struct tl_ring {
+	struct tl_event *events;
+	uint64_t head;                 // events ever recorded
+	uint32_t tid;
+	struct tl_ring *next;
+};
+
+int timeline_enabled;
+static const char *timeline_path;
+static size_t ring_events;
+static uint64_t epoch_ns;           // timestamps are relative to init
+
+static struct tl_ring *rings;       // all rings ever created
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static int rings_gen = 1;           // bumped when rings are freed
+
+static __thread struct tl_ring *my_ring;
+static __thread int my_ring_gen;
+static __thread uint64_t open_starts[MAX_DEPTH];
+static __thread int depth;
+
+static const char *phase_event_names[TL_OP_BASE] = {
+	"path_lookup", "find_dir_entry", "alloc_block",
+	"write_data", "add_dir_entry", "rm_free",
+};
+
+static const char *op_event_names[EXT2_FSAL_OP_COUNT] = {
+	"cp", "ln_hl", "ln_sl", "rm", "mkdir",
+	"rename", "rm_r", "mkdir_p", "cp_r", "defrag", "cp_stream",
+	"write", "truncate",
+};
+
+static uint64_t mono_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// ------------------------- RECORDING -----------------------------
+
+/*
+ * Returns: the calling thread's ring, creating it on first use (NULL
+ * if memory is exhausted).
+ */
+static struct tl_ring *get_ring(void) {
+	if (my_ring != NULL && my_ring_gen == __atomic_load_n(&rings_gen, __ATOMIC_RELAXED))
+		return my_ring;
+
+	struct tl_ring *ring = calloc(1, sizeof(*ring));
+	if (ring == NULL) return NULL;
+	ring->events = calloc(ring_events, sizeof(struct tl_event));
+	if (ring->events == NULL) {
+		free(ring);
+		return NULL;
+	}
+	ring->tid = (uint32_t)syscall(SYS_gettid);
+
+	pthread_mutex_lock(&rings_lock);
+	ring->next = rings;
+	__atomic_store_n(&rings, ring, __ATOMIC_RELEASE);
+	my_ring_gen = rings_gen;
+	pthread_mutex_unlock(&rings_lock);
+
+	my_ring = ring;
+	return ring;
+}
+
+/*
+ * Opens a region on this thread (see timeline_begin).
+ */
+void timeline_push(void) {
+	if (depth < MAX_DEPTH) open_starts[depth] = mono_ns();
+	depth++;
+}
+
+/*
+ * Closes the innermost region and records it as event (see
+ * timeline_end).
+ */
+void timeline_pop(int event, int64_t result) {
+	if (depth == 0) return;   // opened before the collector was on
+	depth--;
+	if (depth >= MAX_DEPTH) return;
+
+	struct tl_ring *ring = get_ring();
+	if (ring == NULL) return;
+
+	uint64_t start = open_starts[depth];
+	struct tl_event *e = &ring->events[ring->head % ring_events];
+	e->start_ns = start - epoch_ns;
+	e->dur_ns = mono_ns() - start;
+	e->result = result;
+	e->event = event;
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// -------------------------- EXPORT -------------------------------
+
+static const char *event_name(int event) {
+	if (event < TL_OP_BASE) return phase_event_names[event];
+	if (event - TL_OP_BASE < EXT2_FSAL_OP_COUNT) return op_event_names[event - TL_OP_BASE];
+	return "unknown";
+}
+
+/*
+ * Writes all recorded events as Chrome trace JSON to fd.
+ */
+void ext2_fsal_timeline_dump(int fd) {
+	FILE *f = fdopen(dup(fd), "w");
+	if (f == NULL) return;
+
+	int pid = getpid();
+	int first = 1;
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+	struct tl_ring *head = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+	for (struct tl_ring *r = head; r; r = r->next) {
+		uint64_t end = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		uint64_t begin = end > ring_events ? end - ring_events : 0;
+
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+			   "\"args\":{\"name\":\"fsal-%u\"}}", first ? "" : ",\n", pid, r->tid, r->tid);
+		first = 0;
+
+		for (uint64_t i = begin; i < end; i++) {
+			struct tl_event *e = &r->events[i % ring_events];
+			int op = e->event >= TL_OP_BASE;
+			fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,"
+				   "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"result\":%lld}}",
+				event_name(e->event), op ? "op" : "phase", pid, r->tid,
+				e->start_ns / 1e3, e->dur_ns / 1e3, (long long)e->result);
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+}
+
+/*
+ * Writes the timeline to EXT2FSAL_TIMELINE, via a temporary file so
+ * readers never see a partial one. Does nothing if the collector is
+ * off.
+ */
+void timeline_export(void) {
+	if (timeline_path == NULL) return;
+
+	char tmp[PATH_MAX];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", timeline_path);
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("timeline");
+		return;
+	}
+	ext2_fsal_timeline_dump(fd);
+	close(fd);
+	rename(tmp, timeline_path);
+}
+
+// ------------------------ SETUP & TEARDOWN -----------------------
+
+/*
+ * Turns the collector on if EXT2FSAL_TIMELINE is set. Called from
+ * ext2_fsal_init before stats_init, which starts the SIGUSR1 exporter.
+ */
+void timeline_init(void) {
+	timeline_path = getenv("EXT2FSAL_TIMELINE");
+	if (timeline_path == NULL || *timeline_path == '\0') {
+		timeline_path = NULL;
+		return;
+	}
+
+	const char *n = getenv("EXT2FSAL_TIMELINE_EVENTS");
+	ring_events = n ? strtoul(n, NULL, 10) : DEFAULT_EVENTS;
+	if (ring_events < 1024) ring_events = 1024;
+
+	epoch_ns = mono_ns();
+	timeline_enabled = 1;
+}
+
+/*
+ * Writes the final timeline and frees all rings. Called from
+ * ext2_fsal_destroy once no operations are running.
+ */
+void timeline_destroy(void) {
+	if (!timeline_enabled) return;
+
+	timeline_enabled = 0;
+	timeline_export();
+	timeline_path = NULL;
+
+	pthread_mutex_lock(&rings_lock);
+	struct tl_ring *r = rings;
+	rings = NULL;
+	__atomic_store_n(&rings_gen, rings_gen + 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&rings_lock);
+
+	while (r) {
+		struct tl_ring *next = r->next;
+		free(r->events);
+		free(r);
+		r = next;
+	}
+	depth = 0;
+}
@@ -0,0 +1,291 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Workload trace capture.
+ *
+ * With EXT2FSAL_TRACE set to a path at init, every top-level
+ * ext2_fsal_* call is appended to an in-memory ring as a
+ * struct ext2_fsal_trace_record followed by its path arguments. A
+ * flusher thread writes the ring to the trace file every
+ * TRACE_FLUSH_MS, or sooner once it is half full. Operations never
+ * wait for the disk: if the ring is full the record is dropped and
+ * counted. out/tools/ext2_replay re-issues a trace against an image.
+ * Calls through a directory handle (the *_at operations) are left out:
+ * their names are relative to a handle a replay would not have.
+ * Streamed copies (ext2_fsal_cp_begin and the rest) and writes to
+ * files (ext2_fsal_write, _append and _truncate) are left out too:
+ * their data never passes through a path a replay could read.
+ *
+ * EXT2FSAL_TRACE_BUF sets the ring size in bytes (default 1 MiB).
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "ext2fsal.h"
+#include "e2fs.h"
+#include "probes.h"
+
+#define TRACE_DEFAULT_BUF (1 << 20)
+#define TRACE_FLUSH_MS    100
+
+static int trace_enabled;
+static int trace_fd = -1;
+static uint64_t trace_start;      // CLOCK_MONOTONIC at init
+
+// ring of ring_size bytes; head and tail only grow, offsets wrap
+static char *ring;
+static size_t ring_size;
+static size_t head;               // next byte producers write
+static size_t tail;               // next byte the flusher writes
+static uint64_t dropped;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t flusher;
+static int stopping;
+
+// nesting depth of public operations on this thread, so that ops
+// issued by other ops (cp_r -> cp) are not replayed twice
+static __thread int op_depth;
+static __thread uint64_t op_start;
+
+/*
+ * Returns: monotonic time in nanoseconds.
+ */
+static uint64_t mono_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// ------------------------- RECORDING -----------------------------
+
+/*
+ * Copies len bytes to ring offset pos, wrapping at the end.
+ */
+static void ring_put(size_t pos, const void *src, size_t len) {
+	size_t off = pos % ring_size;
+	size_t first = ring_size - off < len ? ring_size - off : len;
+
+	memcpy(ring + off, src, first);
+	memcpy(ring, (const char *)src + first, len - first);
+}
+
+/*
+ * Appends one record and its arguments to the ring, or counts it as
+ * dropped if the ring is full.
+ */
+static void trace_append(struct ext2_fsal_trace_record *rec, const char *a, const char *b) {
+	size_t len = sizeof(*rec) + rec->arg_len[0] + rec->arg_len[1];
+	size_t padded = (len + 7) & ~(size_t)7;
+	static const char zeros[8];
+
+	mutex_lock(&ring_lock);
+
+	if (head - tail + padded > ring_size) {
+		dropped++;
+		mutex_unlock(&ring_lock);
+		return;
+	}
+
+	size_t pos = head;
+	ring_put(pos, rec, sizeof(*rec));
+	pos += sizeof(*rec);
+	ring_put(pos, a, rec->arg_len[0]);
+	pos += rec->arg_len[0];
+	ring_put(pos, b, rec->arg_len[1]);
+	pos += rec->arg_len[1];
+	ring_put(pos, zeros, padded - len);
+	head += padded;
+
+	if (head - tail > ring_size / 2) pthread_cond_signal(&ring_cond);
+	mutex_unlock(&ring_lock);
+}
+
+/*
+ * Marks the start of public operation op with path arguments a and b
+ * (b may be NULL), firing the op__entry probe.
+ *
+ * Returns: 1 if it is the outermost operation on this thread (the
+ * one trace_exit should record), 0 if nested.
+ */
+int trace_enter(int op, const char *a, const char *b) {
+	PROBE3(op__entry, op, a, b);
+	timeline_begin();
+
+	if (op_depth++ > 0) return 0;
+	if (trace_enabled) op_start = mono_ns();
+	return 1;
+}
+
+/*
+ * Marks the end of a public operation op with path arguments a and b
+ * (b may be NULL) and result retval, recording it if outer.
+ */
+void trace_exit(int outer, int op, const char *a, const char *b, int32_t retval) {
+	PROBE2(op__return, op, retval);
+	timeline_end(TL_OP_BASE + op, retval);
+
+	op_depth--;
+	if (!outer || !trace_enabled) return;
+
+	struct ext2_fsal_trace_record rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.start_ns = op_start - trace_start;
+	rec.duration_ns = mono_ns() - op_start;
+	rec.tid = (uint32_t)syscall(SYS_gettid);
+	rec.result = retval;
+	rec.op = op;
+	rec.arg_len[0] = a ? strnlen(a, PATH_MAX) : 0;
+	rec.arg_len[1] = b ? strnlen(b, PATH_MAX) : 0;
+
+	trace_append(&rec, a, b);
+}
+
+// -------------------------- FLUSHING -----------------------------
+
+/*
+ * Writes ring bytes [from, to) to the trace file.
+ */
+static void write_span(size_t from, size_t to) {
+	while (from < to) {
+		size_t off = from % ring_size;
+		size_t len = to - from;
+		if (len > ring_size - off) len = ring_size - off;
+
+		ssize_t n = write(trace_fd, ring + off, len);
+		if (n <= 0) {
+			perror("trace write");
+			return;
+		}
+		from += n;
+	}
+}
+
+/*
+ * Flusher thread: writes everything recorded so far every
+ * TRACE_FLUSH_MS (or when signalled), until stopping is set. The
+ * span being written is outside [head, tail + ring_size), so
+ * producers never overwrite it; tail only moves once it is on disk.
+ */
+static void *flusher_main(void *arg) {
+	(void)arg;
+	mutex_lock(&ring_lock);
+
+	for (;;) {
+		if (head == tail && !stopping) {
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += TRACE_FLUSH_MS * 1000000L;
+			ts.tv_sec += ts.tv_nsec / 1000000000L;
+			ts.tv_nsec %= 1000000000L;
+			pthread_cond_timedwait(&ring_cond, &ring_lock, &ts);
+		}
+
+		size_t from = tail, to = head;
+		int stop = stopping;
+		mutex_unlock(&ring_lock);
+
+		write_span(from, to);
+
+		mutex_lock(&ring_lock);
+		tail = to;
+		if (stop && head == tail) break;
+	}
+
+	mutex_unlock(&ring_lock);
+	return NULL;
+}
+
+// ------------------------ SETUP & TEARDOWN -----------------------
+
+/*
+ * Opens the trace file named by EXT2FSAL_TRACE, writes its header and
+ * starts the flusher. Tracing stays off if the variable is unset or
+ * anything fails. Called from ext2_fsal_init.
+ */
+void trace_init(void) {
+	const char *path = getenv("EXT2FSAL_TRACE");
+	if (path == NULL || *path == '\0') return;
+
+	const char *buf = getenv("EXT2FSAL_TRACE_BUF");
+	ring_size = buf ? strtoul(buf, NULL, 10) : TRACE_DEFAULT_BUF;
+	if (ring_size < 4096) ring_size = 4096;
+
+	ring = malloc(ring_size);
+	trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (ring == NULL || trace_fd < 0) {
+		perror("trace");
+		free(ring);
+		ring = NULL;
+		if (trace_fd >= 0) close(trace_fd);
+		trace_fd = -1;
+		return;
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	trace_start = mono_ns();
+
+	struct ext2_fsal_trace_header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = EXT2_FSAL_TRACE_MAGIC;
+	hdr.version = EXT2_FSAL_TRACE_VERSION;
+	hdr.start_realtime_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	if (write(trace_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) perror("trace write");
+
+	head = tail = 0;
+	dropped = 0;
+	stopping = 0;
+	if (pthread_create(&flusher, NULL, flusher_main, NULL) != 0) {
+		perror("trace");
+		close(trace_fd);
+		trace_fd = -1;
+		free(ring);
+		ring = NULL;
+		return;
+	}
+
+	trace_enabled = 1;
+}
+
+/*
+ * Flushes the remaining records, stops the flusher and closes the
+ * trace. Called from ext2_fsal_destroy once no operations are running.
+ */
+void trace_destroy(void) {
+	if (!trace_enabled) return;
+	trace_enabled = 0;
+
+	mutex_lock(&ring_lock);
+	stopping = 1;
+	pthread_cond_signal(&ring_cond);
+	mutex_unlock(&ring_lock);
+	pthread_join(flusher, NULL);
+
+	if (dropped > 0) {
+		fprintf(stderr, "trace: dropped %llu records (ring full)\n",
+			(unsigned long long)dropped);
+	}
+
+	close(trace_fd);
+	trace_fd = -1;
+	free(ring);
+	ring = NULL;
+}
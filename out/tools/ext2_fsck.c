@@ -0,0 +1,770 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Checks an ext2 image for consistency and, with -y, repairs it.
+ *
+ * Passes:
+ *   1  directory walk: breadth first from the root, directories spread
+ *      over all threads; counts the entries naming each inode and
+ *      marks which inodes are reachable
+ *   2  inode scan: the inode table in chunks over all threads; the
+ *      block map of every reachable inode is validated and its blocks
+ *      claimed in a rebuilt block bitmap, and link counts and i_blocks
+ *      are compared with what was found
+ *   3  summary: the rebuilt inode and block bitmaps, the free counts
+ *      and used directory counts of every group and the superblock
+ *      free counts are compared with the image
+ *
+ * Problems are printed to stderr (the first MAX_MESSAGES unless -v).
+ * With -y they are fixed where possible: entries naming free or
+ * invalid inodes are cleared, link counts and i_blocks set to what was
+ * found, in-use inodes no directory reaches are released, and both
+ * bitmaps and all counters are rewritten from reachability. Blocks
+ * claimed twice, bad block pointers and corrupt directory blocks are
+ * reported but left alone.
+ *
+ * The image is mmapped (read-only without -y), so a check reads it
+ * straight from the page cache and only keeps a few bytes per inode
+ * and a bit per block in memory.
+ *
+ * Exit status follows fsck(8): 0 clean, 1 problems fixed, 4 problems
+ * left, 8 usage or I/O error.
+ *
+ * usage: ./ext2_fsck [-y] [-j threads] [-v] image
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "ext2.h"
+
+#define EXIT_CLEAN      0
+#define EXIT_FIXED      1
+#define EXIT_UNFIXED    4
+#define EXIT_ERROR      8
+
+#define CHUNK_INODES    1024     // inodes per pass 2 work item
+#define MAX_MESSAGES    100      // problems printed without -v
+
+#define EXT2_SUPER_MAGIC         0xEF53
+#define EXT2_DYNAMIC_REV         1
+#define EXT2_RESIZE_INO          7
+#define EXT2_NDIR_BLOCKS         12
+#define EXT2_IND_BLOCK           12
+#define EXT2_DIND_BLOCK          13
+#define EXT2_TIND_BLOCK          14
+
+// features this checker understands; anything else is refused
+#define COMPAT_EXT_ATTR          0x0008
+#define COMPAT_RESIZE_INODE      0x0010
+#define COMPAT_DIR_INDEX         0x0020
+#define INCOMPAT_FILETYPE        0x0002
+#define RO_COMPAT_SPARSE_SUPER   0x0001
+#define RO_COMPAT_LARGE_FILE     0x0002
+#define KNOWN_COMPAT    (COMPAT_EXT_ATTR | COMPAT_RESIZE_INODE | COMPAT_DIR_INDEX)
+#define KNOWN_INCOMPAT  (INCOMPAT_FILETYPE)
+#define KNOWN_RO_COMPAT (RO_COMPAT_SPARSE_SUPER | RO_COMPAT_LARGE_FILE)
+
+struct fsck {
+	// image
+	uint8_t *base;
+	size_t size;
+	struct ext2_super_block *sb;
+	struct ext2_group_desc *gd;
+	uint32_t block_size;
+	uint32_t num_groups;
+	uint32_t num_blocks;
+	uint32_t num_inodes;
+	uint32_t first_data_block;
+	uint32_t blocks_per_group;
+	uint32_t inodes_per_group;
+	uint32_t inode_size;
+	uint32_t first_ino;
+	int filetype;                // entries carry a file type
+	int repair;
+
+	// rebuilt state, shared by all threads
+	uint8_t *block_map;          // one bit per block from first_data_block
+	uint8_t *reached;            // per inode: named by a reachable entry
+	uint8_t *dir_seen;           // per inode: directory already queued
+	uint32_t *links;             // per inode: entries naming it
+	uint32_t *parent;            // per directory: where it was found
+	uint32_t *group_dirs;        // per group: reachable directories
+
+	// pass 1 work queue
+	uint32_t *queue;
+	size_t queue_len, queue_cap;
+	size_t pending;              // queued plus being walked
+	pthread_mutex_t queue_lock;
+	pthread_cond_t queue_cond;
+
+	// pass 2 work
+	uint32_t next_chunk;
+
+	uint64_t found, fixed;
+	uint64_t messages;
+	int verbose;
+};
+
+/*
+ * Returns: monotonic time in nanoseconds.
+ */
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void die(const char *msg) {
+	fprintf(stderr, "ext2_fsck: %s\n", msg);
+	exit(EXIT_ERROR);
+}
+
+/*
+ * Records one problem, printing msg unless the message budget is
+ * spent; fixed says whether it has been repaired.
+ */
+static void problem(struct fsck *c, int fixed, const char *fmt, ...) {
+	__atomic_fetch_add(&c->found, 1, __ATOMIC_RELAXED);
+	if (fixed) __atomic_fetch_add(&c->fixed, 1, __ATOMIC_RELAXED);
+
+	uint64_t n = __atomic_fetch_add(&c->messages, 1, __ATOMIC_RELAXED);
+	if (!c->verbose && n >= MAX_MESSAGES) return;
+
+	char line[512];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "%s%s\n", line, fixed ? " (fixed)" : "");
+}
+
+// ------------------------------ IMAGE ------------------------------
+
+static uint8_t *block_ptr(struct fsck *c, uint32_t block) {
+	return c->base + (size_t)block * c->block_size;
+}
+
+static struct ext2_inode *inode_ptr(struct fsck *c, uint32_t ino) {
+	uint32_t group = (ino - 1) / c->inodes_per_group;
+	uint32_t index = (ino - 1) % c->inodes_per_group;
+	return (struct ext2_inode *)(block_ptr(c, c->gd[group].bg_inode_table) +
+		(size_t)index * c->inode_size);
+}
+
+static int valid_block(struct fsck *c, uint32_t block) {
+	return block >= c->first_data_block && block < c->num_blocks;
+}
+
+/*
+ * Returns: whether inode is allocated. Reserved inodes always are;
+ * others once linked and not yet deleted.
+ */
+static int inode_in_use(struct fsck *c, uint32_t ino, struct ext2_inode *inode) {
+	if (ino < c->first_ino) return 1;
+	return inode->i_links_count > 0 && inode->i_dtime == 0;
+}
+
+/*
+ * Returns: whether group holds a copy of the superblock and group
+ * descriptors.
+ */
+static int group_has_super(struct fsck *c, uint32_t group) {
+	if (!(c->sb->s_feature_ro_compat & RO_COMPAT_SPARSE_SUPER)) return 1;
+	if (group <= 1) return 1;
+	for (uint32_t p = 3; p <= 7; p += 2) {
+		uint32_t g = group;
+		while (g % p == 0) g /= p;
+		if (g == 1) return 1;
+	}
+	return 0;
+}
+
+static int mode_file_type(uint16_t mode) {
+	switch (mode & 0xF000) {
+		case EXT2_S_IFREG: return EXT2_FT_REG_FILE;
+		case EXT2_S_IFDIR: return EXT2_FT_DIR;
+		case EXT2_S_IFLNK: return EXT2_FT_SYMLINK;
+		default: return EXT2_FT_UNKNOWN;
+	}
+}
+
+/*
+ * Maps the image and reads its geometry, refusing anything this
+ * checker does not understand.
+ */
+static void open_image(struct fsck *c, const char *path) {
+	int fd = open(path, c->repair ? O_RDWR : O_RDONLY);
+	if (fd < 0) die("cannot open image");
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) die("cannot stat image");
+	if (st.st_size < 2048) die("image too small");
+	c->size = st.st_size;
+
+	int prot = PROT_READ | (c->repair ? PROT_WRITE : 0);
+	c->base = mmap(NULL, c->size, prot, MAP_SHARED, fd, 0);
+	if (c->base == MAP_FAILED) die("cannot map image");
+	close(fd);
+
+	c->sb = (struct ext2_super_block *)(c->base + 1024);
+	struct ext2_super_block *sb = c->sb;
+	if (sb->s_magic != EXT2_SUPER_MAGIC) die("bad superblock magic");
+	if (sb->s_log_block_size > 2) die("unsupported block size");
+	if ((sb->s_feature_compat & ~KNOWN_COMPAT) || (sb->s_feature_incompat & ~KNOWN_INCOMPAT) ||
+	    (sb->s_feature_ro_compat & ~KNOWN_RO_COMPAT))
+		die("image uses unsupported features");
+
+	c->block_size = 1024u << sb->s_log_block_size;
+	c->num_blocks = sb->s_blocks_count;
+	c->num_inodes = sb->s_inodes_count;
+	c->first_data_block = sb->s_first_data_block;
+	c->blocks_per_group = sb->s_blocks_per_group;
+	c->inodes_per_group = sb->s_inodes_per_group;
+	c->inode_size = sb->s_rev_level >= EXT2_DYNAMIC_REV ? sb->s_inode_size : 128;
+	c->first_ino = sb->s_rev_level >= EXT2_DYNAMIC_REV ? sb->s_first_ino : EXT2_GOOD_OLD_FIRST_INO;
+	c->filetype = (sb->s_feature_incompat & INCOMPAT_FILETYPE) != 0;
+
+	if (c->blocks_per_group == 0 || c->inodes_per_group == 0 || c->inode_size < 128)
+		die("bad superblock geometry");
+	if ((uint64_t)c->num_blocks * c->block_size > c->size) die("image shorter than its block count");
+
+	c->num_groups = (c->num_blocks - c->first_data_block + c->blocks_per_group - 1) / c->blocks_per_group;
+	if ((uint64_t)c->num_groups * c->inodes_per_group < c->num_inodes) die("bad superblock geometry");
+	c->gd = (struct ext2_group_desc *)block_ptr(c, c->first_data_block + 1);
+
+	uint32_t table_blocks = (c->inodes_per_group * c->inode_size + c->block_size - 1) / c->block_size;
+	for (uint32_t g = 0; g < c->num_groups; g++) {
+		if (!valid_block(c, c->gd[g].bg_block_bitmap) || !valid_block(c, c->gd[g].bg_inode_bitmap) ||
+		    !valid_block(c, c->gd[g].bg_inode_table) ||
+		    c->gd[g].bg_inode_table + table_blocks > c->num_blocks)
+			die("bad group descriptor");
+	}
+}
+
+// ------------------------------ STATE ------------------------------
+
+static void *xcalloc(size_t n, size_t size) {
+	void *p = calloc(n ? n : 1, size);
+	if (p == NULL) die("out of memory");
+	return p;
+}
+
+/*
+ * Claims block in the rebuilt bitmap.
+ *
+ * Returns: 0, or 1 if it was already claimed.
+ */
+static int claim_block(struct fsck *c, uint32_t block) {
+	uint32_t bit = block - c->first_data_block;
+	uint8_t mask = 1u << (bit % 8);
+	return (__atomic_fetch_or(&c->block_map[bit / 8], mask, __ATOMIC_RELAXED) & mask) != 0;
+}
+
+static int block_claimed(struct fsck *c, uint32_t block) {
+	uint32_t bit = block - c->first_data_block;
+	return (c->block_map[bit / 8] >> (bit % 8)) & 1;
+}
+
+/*
+ * Claims the blocks every group uses for metadata: superblock and
+ * descriptor copies (plus reserved descriptor blocks), the bitmaps and
+ * the inode table.
+ */
+static void claim_metadata(struct fsck *c) {
+	uint32_t gdt_blocks = (c->num_groups * sizeof(struct ext2_group_desc) + c->block_size - 1) / c->block_size;
+	uint32_t table_blocks = (c->inodes_per_group * c->inode_size + c->block_size - 1) / c->block_size;
+	// s_padding1 holds s_reserved_gdt_blocks in dynamic revision images
+	uint32_t reserved_gdt = (c->sb->s_feature_compat & COMPAT_RESIZE_INODE) ? c->sb->s_padding1 : 0;
+
+	for (uint32_t g = 0; g < c->num_groups; g++) {
+		uint32_t start = c->first_data_block + g * c->blocks_per_group;
+		if (group_has_super(c, g)) {
+			for (uint32_t b = 0; b < 1 + gdt_blocks + reserved_gdt; b++) {
+				if (valid_block(c, start + b)) claim_block(c, start + b);
+			}
+		}
+		claim_block(c, c->gd[g].bg_block_bitmap);
+		claim_block(c, c->gd[g].bg_inode_bitmap);
+		for (uint32_t b = 0; b < table_blocks; b++) claim_block(c, c->gd[g].bg_inode_table + b);
+	}
+}
+
+// ---------------------------- BLOCK MAPS ---------------------------
+
+typedef void (*block_fn)(struct fsck *c, uint32_t ino, uint32_t block, int data, void *arg);
+
+/*
+ * Visits the blocks under pointer block at indirection level (0 for a
+ * data block), calling fn for every valid one.
+ *
+ * Returns: the number of out-of-range pointers.
+ */
+static int walk_tree(struct fsck *c, uint32_t ino, uint32_t block, int level,
+		block_fn fn, void *arg) {
+	if (block == 0) return 0;
+	if (!valid_block(c, block)) return 1;
+
+	fn(c, ino, block, level == 0, arg);
+	if (level == 0) return 0;
+
+	int bad = 0;
+	uint32_t *ptrs = (uint32_t *)block_ptr(c, block);
+	for (uint32_t i = 0; i < c->block_size / 4; i++) {
+		bad += walk_tree(c, ino, ptrs[i], level - 1, fn, arg);
+	}
+	return bad;
+}
+
+/*
+ * Visits every block inode owns: data, indirect and extended attribute
+ * blocks. Fast symlinks own none; the resize inode only owns its
+ * doubly indirect block (the rest are reserved descriptor blocks,
+ * claimed as metadata).
+ *
+ * Returns: the number of out-of-range pointers.
+ */
+static int walk_blocks(struct fsck *c, uint32_t ino, struct ext2_inode *inode,
+		block_fn fn, void *arg) {
+	int bad = 0;
+
+	if (inode->i_file_acl != 0) {
+		if (valid_block(c, inode->i_file_acl)) fn(c, ino, inode->i_file_acl, 0, arg);
+		else bad++;
+	}
+
+	if ((inode->i_mode & 0xF000) == EXT2_S_IFLNK &&
+	    inode->i_blocks == (inode->i_file_acl ? c->block_size / 512 : 0))
+		return bad;
+
+	if (ino == EXT2_RESIZE_INO) {
+		uint32_t dind = inode->i_block[EXT2_DIND_BLOCK];
+		if (dind != 0 && !valid_block(c, dind)) return bad + 1;
+		if (dind != 0) fn(c, ino, dind, 0, arg);
+		return bad;
+	}
+
+	for (int i = 0; i < EXT2_NDIR_BLOCKS; i++) {
+		bad += walk_tree(c, ino, inode->i_block[i], 0, fn, arg);
+	}
+	bad += walk_tree(c, ino, inode->i_block[EXT2_IND_BLOCK], 1, fn, arg);
+	bad += walk_tree(c, ino, inode->i_block[EXT2_DIND_BLOCK], 2, fn, arg);
+	bad += walk_tree(c, ino, inode->i_block[EXT2_TIND_BLOCK], 3, fn, arg);
+	return bad;
+}
+
+// ------------------------- PASS 1: DIRECTORIES ---------------------
+
+static void queue_push(struct fsck *c, uint32_t ino) {
+	pthread_mutex_lock(&c->queue_lock);
+	if (c->queue_len == c->queue_cap) {
+		c->queue_cap = c->queue_cap ? c->queue_cap * 2 : 1024;
+		c->queue = realloc(c->queue, c->queue_cap * sizeof(uint32_t));
+		if (c->queue == NULL) die("out of memory");
+	}
+	c->queue[c->queue_len++] = ino;
+	c->pending++;
+	pthread_cond_signal(&c->queue_cond);
+	pthread_mutex_unlock(&c->queue_lock);
+}
+
+/*
+ * Returns: the next directory to walk, or 0 once every queued
+ * directory has been walked.
+ */
+static uint32_t queue_pop(struct fsck *c) {
+	pthread_mutex_lock(&c->queue_lock);
+	while (c->queue_len == 0 && c->pending > 0) {
+		pthread_cond_wait(&c->queue_cond, &c->queue_lock);
+	}
+	uint32_t ino = c->queue_len > 0 ? c->queue[--c->queue_len] : 0;
+	pthread_mutex_unlock(&c->queue_lock);
+	return ino;
+}
+
+static void queue_done(struct fsck *c) {
+	pthread_mutex_lock(&c->queue_lock);
+	if (--c->pending == 0) pthread_cond_broadcast(&c->queue_cond);
+	pthread_mutex_unlock(&c->queue_lock);
+}
+
+/*
+ * Checks one entry of directory dir, counting the link it makes and
+ * queueing the directory it names.
+ */
+static void check_entry(struct fsck *c, uint32_t dir, struct ext2_dir_entry *d) {
+	char name[EXT2_NAME_LEN + 1];
+	memcpy(name, d->name, d->name_len);
+	name[d->name_len] = '\0';
+
+	int dot = strcmp(name, ".") == 0;
+	int dotdot = strcmp(name, "..") == 0;
+
+	if (d->inode > c->num_inodes) {
+		problem(c, c->repair, "directory %u: entry '%s' names invalid inode %u", dir, name, d->inode);
+		if (c->repair) d->inode = 0;
+		return;
+	}
+
+	struct ext2_inode *target = inode_ptr(c, d->inode);
+	if (!inode_in_use(c, d->inode, target) || target->i_mode == 0) {
+		problem(c, c->repair, "directory %u: entry '%s' names free inode %u", dir, name, d->inode);
+		if (c->repair) d->inode = 0;
+		return;
+	}
+
+	if (dot && d->inode != dir) {
+		problem(c, c->repair, "directory %u: '.' names inode %u", dir, d->inode);
+		if (c->repair) d->inode = dir;
+	}
+	if (dotdot && d->inode != c->parent[dir - 1]) {
+		problem(c, c->repair, "directory %u: '..' names inode %u, not %u", dir, d->inode, c->parent[dir - 1]);
+		if (c->repair) d->inode = c->parent[dir - 1];
+	}
+	target = inode_ptr(c, d->inode);
+
+	int type = mode_file_type(target->i_mode);
+	if (c->filetype && d->file_type != type) {
+		problem(c, c->repair, "directory %u: entry '%s' has file type %u, inode %u is %d",
+			dir, name, d->file_type, d->inode, type);
+		if (c->repair) d->file_type = type;
+	}
+
+	__atomic_fetch_add(&c->links[d->inode - 1], 1, __ATOMIC_RELAXED);
+	if (dot || dotdot) return;
+
+	c->reached[d->inode - 1] = 1;
+	if (type != EXT2_FT_DIR) return;
+
+	uint8_t seen = 0;
+	if (!__atomic_compare_exchange_n(&c->dir_seen[d->inode - 1], &seen, 1, 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		problem(c, 0, "directory %u: entry '%s' is a second link to directory %u", dir, name, d->inode);
+		return;
+	}
+	c->parent[d->inode - 1] = dir;
+	queue_push(c, d->inode);
+}
+
+/*
+ * Checks the entries in one block of a directory; called for every
+ * data block of it.
+ */
+static void check_dir_block(struct fsck *c, uint32_t dir, uint32_t block, int data, void *arg) {
+	(void)arg;
+	if (!data) return;
+
+	uint8_t *p = block_ptr(c, block);
+	uint32_t off = 0;
+	while (off < c->block_size) {
+		struct ext2_dir_entry *d = (struct ext2_dir_entry *)(p + off);
+		uint32_t min_len = (8 + d->name_len + 3) & ~3u;
+
+		if (d->rec_len < 8 || d->rec_len % 4 != 0 || off + d->rec_len > c->block_size ||
+		    (d->inode != 0 && d->rec_len < min_len)) {
+			problem(c, 0, "directory %u: corrupt entry in block %u at offset %u", dir, block, off);
+			return;
+		}
+		if (d->inode != 0) check_entry(c, dir, d);
+		off += d->rec_len;
+	}
+}
+
+static void *walk_dirs_main(void *arg) {
+	struct fsck *c = arg;
+	uint32_t dir;
+
+	while ((dir = queue_pop(c)) != 0) {
+		struct ext2_inode *inode = inode_ptr(c, dir);
+		walk_blocks(c, dir, inode, check_dir_block, NULL);
+		queue_done(c);
+	}
+	return NULL;
+}
+
+// -------------------------- PASS 2: INODES -------------------------
+
+struct claim {
+	uint64_t blocks;
+	int dups;
+};
+
+static void claim_inode_block(struct fsck *c, uint32_t ino, uint32_t block, int data, void *arg) {
+	(void)data;
+	struct claim *cl = arg;
+
+	cl->blocks++;
+	if (claim_block(c, block)) {
+		cl->dups++;
+		problem(c, 0, "inode %u: block %u is also used elsewhere", ino, block);
+	}
+}
+
+/*
+ * Checks one inode against what pass 1 found, claiming its blocks if
+ * it is reachable.
+ */
+static void check_inode(struct fsck *c, uint32_t ino) {
+	struct ext2_inode *inode = inode_ptr(c, ino);
+	if (!inode_in_use(c, ino, inode)) return;
+
+	if (ino >= c->first_ino && !c->reached[ino - 1]) {
+		problem(c, c->repair, "inode %u: in use but in no directory", ino);
+		if (c->repair) {
+			inode->i_links_count = 0;
+			inode->i_dtime = (unsigned int)time(NULL);
+		}
+		return;
+	}
+
+	// reserved inodes other than the root only own blocks if they say so
+	if (ino < c->first_ino && ino != EXT2_ROOT_INO && inode->i_blocks == 0) return;
+
+	struct claim cl = { 0, 0 };
+	int bad = walk_blocks(c, ino, inode, claim_inode_block, &cl);
+	if (bad > 0) problem(c, 0, "inode %u: %d block pointers out of range", ino, bad);
+
+	// the resize inode's i_blocks also counts the reserved descriptor blocks
+	uint32_t sectors = cl.blocks * (c->block_size / 512);
+	if (ino != EXT2_RESIZE_INO && inode->i_blocks != sectors) {
+		problem(c, c->repair, "inode %u: i_blocks is %u, should be %u", ino, inode->i_blocks, sectors);
+		if (c->repair) inode->i_blocks = sectors;
+	}
+
+	if (ino < c->first_ino && ino != EXT2_ROOT_INO) return;
+
+	uint32_t links = c->links[ino - 1];
+	if (inode->i_links_count != links) {
+		problem(c, c->repair, "inode %u: link count is %u, should be %u", ino, inode->i_links_count, links);
+		if (c->repair) inode->i_links_count = links;
+	}
+	if ((inode->i_mode & 0xF000) == EXT2_S_IFDIR) {
+		__atomic_fetch_add(&c->group_dirs[(ino - 1) / c->inodes_per_group], 1, __ATOMIC_RELAXED);
+	}
+}
+
+static void *scan_inodes_main(void *arg) {
+	struct fsck *c = arg;
+	uint32_t chunks = (c->num_inodes + CHUNK_INODES - 1) / CHUNK_INODES;
+	uint32_t chunk;
+
+	while ((chunk = __atomic_fetch_add(&c->next_chunk, 1, __ATOMIC_RELAXED)) < chunks) {
+		uint32_t first = chunk * CHUNK_INODES + 1;
+		uint32_t last = first + CHUNK_INODES - 1;
+		if (last > c->num_inodes) last = c->num_inodes;
+		for (uint32_t ino = first; ino <= last; ino++) check_inode(c, ino);
+	}
+	return NULL;
+}
+
+// -------------------------- PASS 3: SUMMARY ------------------------
+
+/*
+ * Returns: whether ino belongs in the rebuilt inode bitmap.
+ */
+static int inode_wanted(struct fsck *c, uint32_t ino) {
+	if (ino < c->first_ino) return 1;
+	struct ext2_inode *inode = inode_ptr(c, ino);
+	return c->reached[ino - 1] && inode_in_use(c, ino, inode);
+}
+
+/*
+ * Compares count bits of an on-disk bitmap with the rebuilt state
+ * (wanted(first + i)), fixing it under -y.
+ *
+ * Returns: how many bits are clear in the rebuilt state.
+ */
+static uint32_t check_bitmap(struct fsck *c, const char *what, uint32_t group, uint8_t *bitmap,
+		uint32_t first, uint32_t count, int (*wanted)(struct fsck *, uint32_t)) {
+	uint32_t free = 0, extra = 0, missing = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		int want = wanted(c, first + i);
+		int have = (bitmap[i / 8] >> (i % 8)) & 1;
+		if (!want) free++;
+		if (want == have) continue;
+
+		if (have) extra++;
+		else missing++;
+		if (c->verbose) {
+			fprintf(stderr, "  %s %u: %s\n", what, first + i,
+				have ? "marked used, unused" : "marked free, in use");
+		}
+		if (c->repair) bitmap[i / 8] ^= 1u << (i % 8);
+	}
+
+	if (extra + missing > 0) {
+		problem(c, c->repair, "group %u: %s bitmap differs (%u marked used but unused, %u in use but marked free)",
+			group, what, extra, missing);
+	}
+	return free;
+}
+
+static int block_wanted(struct fsck *c, uint32_t block) {
+	return block_claimed(c, block);
+}
+
+static void check_count(struct fsck *c, const char *what, uint32_t *field, uint32_t want) {
+	if (*field == want) return;
+	problem(c, c->repair, "%s is %u, should be %u", what, *field, want);
+	if (c->repair) *field = want;
+}
+
+static void check_count16(struct fsck *c, const char *what, uint16_t *field, uint32_t want) {
+	if (*field == want) return;
+	problem(c, c->repair, "%s is %u, should be %u", what, *field, want);
+	if (c->repair) *field = want;
+}
+
+/*
+ * Compares both bitmaps and all counters of every group and the
+ * superblock with the rebuilt state.
+ *
+ * Returns: the number of free blocks.
+ */
+static uint32_t check_summary(struct fsck *c, uint32_t *free_inodes_out) {
+	uint32_t free_blocks = 0, free_inodes = 0;
+	char what[64];
+
+	for (uint32_t g = 0; g < c->num_groups; g++) {
+		struct ext2_group_desc *gd = &c->gd[g];
+		uint32_t first_block = c->first_data_block + g * c->blocks_per_group;
+		uint32_t nblocks = c->num_blocks - first_block;
+		if (nblocks > c->blocks_per_group) nblocks = c->blocks_per_group;
+		uint32_t first_ino = g * c->inodes_per_group + 1;
+
+		uint32_t fb = check_bitmap(c, "block", g, block_ptr(c, gd->bg_block_bitmap),
+			first_block, nblocks, block_wanted);
+		uint32_t fi = check_bitmap(c, "inode", g, block_ptr(c, gd->bg_inode_bitmap),
+			first_ino, c->inodes_per_group, inode_wanted);
+
+		snprintf(what, sizeof(what), "group %u: free blocks count", g);
+		check_count16(c, what, &gd->bg_free_blocks_count, fb);
+		snprintf(what, sizeof(what), "group %u: free inodes count", g);
+		check_count16(c, what, &gd->bg_free_inodes_count, fi);
+		snprintf(what, sizeof(what), "group %u: directories count", g);
+		check_count16(c, what, &gd->bg_used_dirs_count, c->group_dirs[g]);
+
+		free_blocks += fb;
+		free_inodes += fi;
+	}
+
+	check_count(c, "superblock: free blocks count", &c->sb->s_free_blocks_count, free_blocks);
+	check_count(c, "superblock: free inodes count", &c->sb->s_free_inodes_count, free_inodes);
+	*free_inodes_out = free_inodes;
+	return free_blocks;
+}
+
+// ------------------------------ MAIN -------------------------------
+
+static void run_threads(int threads, void *(*fn)(void *), struct fsck *c) {
+	pthread_t *t = xcalloc(threads, sizeof(pthread_t));
+	for (int i = 0; i < threads; i++) {
+		if (pthread_create(&t[i], NULL, fn, c) != 0) die("cannot create thread");
+	}
+	for (int i = 0; i < threads; i++) pthread_join(t[i], NULL);
+	free(t);
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: ext2_fsck [-y] [-j threads] [-v] image\n");
+	exit(EXIT_ERROR);
+}
+
+int main(int argc, char **argv) {
+	struct fsck c;
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+
+	memset(&c, 0, sizeof(c));
+	while ((opt = getopt(argc, argv, "yj:v")) != -1) {
+		switch (opt) {
+			case 'y': c.repair = 1; break;
+			case 'j': threads = atoi(optarg); break;
+			case 'v': c.verbose = 1; break;
+			default: usage();
+		}
+	}
+	if (argc - optind != 1) usage();
+	if (threads < 1) threads = 1;
+	const char *image = argv[optind];
+
+	uint64_t t0 = now_ns();
+	open_image(&c, image);
+
+	c.block_map = xcalloc((c.num_blocks - c.first_data_block + 7) / 8, 1);
+	c.reached = xcalloc(c.num_inodes, 1);
+	c.dir_seen = xcalloc(c.num_inodes, 1);
+	c.links = xcalloc(c.num_inodes, sizeof(uint32_t));
+	c.parent = xcalloc(c.num_inodes, sizeof(uint32_t));
+	c.group_dirs = xcalloc(c.num_groups, sizeof(uint32_t));
+	pthread_mutex_init(&c.queue_lock, NULL);
+	pthread_cond_init(&c.queue_cond, NULL);
+	claim_metadata(&c);
+
+	struct ext2_inode *root = inode_ptr(&c, EXT2_ROOT_INO);
+	if ((root->i_mode & 0xF000) != EXT2_S_IFDIR) die("root inode is not a directory");
+
+	// pass 1: the root is its own parent and is reached by definition
+	c.parent[EXT2_ROOT_INO - 1] = EXT2_ROOT_INO;
+	c.reached[EXT2_ROOT_INO - 1] = 1;
+	c.dir_seen[EXT2_ROOT_INO - 1] = 1;
+	queue_push(&c, EXT2_ROOT_INO);
+	run_threads(threads, walk_dirs_main, &c);
+	uint64_t t1 = now_ns();
+
+	// pass 2
+	run_threads(threads, scan_inodes_main, &c);
+	uint64_t t2 = now_ns();
+
+	// pass 3
+	uint32_t free_inodes;
+	uint32_t free_blocks = check_summary(&c, &free_inodes);
+	if (c.repair && msync(c.base, c.size, MS_SYNC) < 0) die("cannot write image");
+	uint64_t t3 = now_ns();
+
+	if (!c.verbose && c.messages > MAX_MESSAGES) {
+		fprintf(stderr, "... %llu more problems (use -v to list all)\n",
+			(unsigned long long)(c.messages - MAX_MESSAGES));
+	}
+	printf("%s: %u/%u inodes, %u/%u blocks, %llu problems, %llu fixed\n", image,
+		c.num_inodes - free_inodes, c.num_inodes,
+		c.num_blocks - c.first_data_block - free_blocks, c.num_blocks - c.first_data_block,
+		(unsigned long long)c.found, (unsigned long long)c.fixed);
+	if (c.verbose) {
+		printf("threads %d, directories %.3f s, inodes %.3f s, summary %.3f s, total %.3f s\n",
+			threads, (t1 - t0) / 1e9, (t2 - t1) / 1e9, (t3 - t2) / 1e9, (t3 - t0) / 1e9);
+	}
+
+	munmap(c.base, c.size);
+	free(c.block_map);
+	free(c.reached);
+	free(c.dir_seen);
+	free(c.links);
+	free(c.parent);
+	free(c.group_dirs);
+	free(c.queue);
+
+	if (c.found == 0) return EXIT_CLEAN;
+	return c.fixed == c.found ? EXIT_FIXED : EXIT_UNFIXED;
+}
@@ -0,0 +1,391 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Replays a trace recorded with EXT2FSAL_TRACE against a copy of an
+ * image, using whichever build of libext2fsal.so -l names, so two
+ * builds can be compared on the same workload.
+ *
+ * Modes:
+ *   serial  one thread, all calls in recorded start order (the only
+ *           fully deterministic mode)
+ *   fast    one thread per recorded thread, each issuing its own
+ *           calls in order as fast as possible
+ *   paced   like fast, but every call waits for its recorded start
+ *           offset
+ *
+ * Prints one JSON line with wall time, ops/sec, how many results
+ * differ from the recorded ones, and per-operation p50/p99 next to
+ * the recorded p50/p99. Host paths given to cp and cp_r must still
+ * exist on the replaying machine.
+ *
+ * usage: ./ext2_replay [-l lib] [-m serial|fast|paced] [-o out] [-v] trace image
+ */
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ext2fsal.h"
+
+enum mode { MODE_SERIAL, MODE_FAST, MODE_PACED };
+
+static const char *op_names[EXT2_FSAL_OP_COUNT] = {
+	"cp", "ln_hl", "ln_sl", "rm", "mkdir",
+	"rename", "rm_r", "mkdir_p", "cp_r", "defrag", "cp_stream",
+	"write", "truncate",
+};
+
+// number of path arguments of each operation
+static const int op_arity[EXT2_FSAL_OP_COUNT] = {
+	2, 2, 2, 1, 1, 2, 1, 1, 2, 1, 1, 1, 1,
+};
+
+struct call {
+	struct ext2_fsal_trace_record rec;
+	char *args[2];
+	int32_t result;          // result on replay
+	uint64_t latency_ns;     // latency on replay
+};
+
+struct replayer {
+	pthread_t thread;
+	struct call **calls;     // this thread's calls, in order
+	int count;
+};
+
+typedef int32_t (*op1_fn)(const char *);
+typedef int32_t (*op2_fn)(const char *, const char *);
+
+static void *ops[EXT2_FSAL_OP_COUNT];
+static enum mode mode = MODE_FAST;
+static uint64_t base_ns;          // replay time of the first call's start
+static pthread_barrier_t start_barrier;
+
+/*
+ * Returns: monotonic time in nanoseconds.
+ */
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void die(const char *msg) {
+	fprintf(stderr, "ext2_replay: %s\n", msg);
+	exit(2);
+}
+
+// ----------------------------- LOADING -----------------------------
+
+/*
+ * Reads all records of the trace at path.
+ *
+ * Returns: an array of calls; count receives its length.
+ */
+static struct call *load_trace(const char *path, int *count) {
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) die("cannot open trace");
+
+	struct ext2_fsal_trace_header hdr;
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != EXT2_FSAL_TRACE_MAGIC)
+		die("not a trace file");
+	if (hdr.version != EXT2_FSAL_TRACE_VERSION) die("unsupported trace version");
+
+	int cap = 1024, n = 0;
+	struct call *calls = malloc(cap * sizeof(struct call));
+	if (calls == NULL) die("out of memory");
+
+	struct ext2_fsal_trace_record rec;
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (rec.op >= EXT2_FSAL_OP_COUNT) die("corrupt trace record");
+		if (n == cap) {
+			cap *= 2;
+			calls = realloc(calls, cap * sizeof(struct call));
+			if (calls == NULL) die("out of memory");
+		}
+
+		struct call *c = &calls[n++];
+		memset(c, 0, sizeof(*c));
+		c->rec = rec;
+
+		size_t len = sizeof(rec);
+		for (int i = 0; i < 2; i++) {
+			c->args[i] = calloc(1, rec.arg_len[i] + 1);
+			if (c->args[i] == NULL) die("out of memory");
+			if (rec.arg_len[i] && fread(c->args[i], rec.arg_len[i], 1, f) != 1)
+				die("truncated trace");
+			len += rec.arg_len[i];
+		}
+
+		// skip padding to the next 8-byte boundary
+		size_t pad = ((len + 7) & ~(size_t)7) - len;
+		if (pad && fseek(f, pad, SEEK_CUR) != 0) die("truncated trace");
+	}
+
+	fclose(f);
+	*count = n;
+	return calls;
+}
+
+static int cmp_start(const void *a, const void *b) {
+	const struct call *x = a, *y = b;
+	if (x->rec.start_ns != y->rec.start_ns) return x->rec.start_ns < y->rec.start_ns ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Splits the calls (sorted by start) into one replayer per recorded
+ * thread, or a single replayer in serial mode.
+ *
+ * Returns: the replayers; count receives how many.
+ */
+static struct replayer *split_threads(struct call *calls, int n, int *count) {
+	uint32_t *tids = malloc((n + 1) * sizeof(uint32_t));
+	struct replayer *r = calloc(n + 1, sizeof(struct replayer));
+	if (tids == NULL || r == NULL) die("out of memory");
+
+	int nr = 0;
+	for (int i = 0; i < n; i++) {
+		int t = 0;
+		if (mode != MODE_SERIAL) {
+			while (t < nr && tids[t] != calls[i].rec.tid) t++;
+		}
+		if (t == nr) {
+			tids[nr] = calls[i].rec.tid;
+			r[nr].calls = malloc(n * sizeof(struct call *));
+			if (r[nr].calls == NULL) die("out of memory");
+			nr++;
+		}
+		r[t].calls[r[t].count++] = &calls[i];
+	}
+
+	free(tids);
+	*count = nr;
+	return r;
+}
+
+// ----------------------------- REPLAY ------------------------------
+
+static void issue(struct call *c) {
+	int op = c->rec.op;
+
+	if (mode == MODE_PACED) {
+		uint64_t due = base_ns + c->rec.start_ns;
+		struct timespec ts = { due / 1000000000ULL, due % 1000000000ULL };
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0);
+	}
+
+	uint64_t start = now_ns();
+	if (op_arity[op] == 1) c->result = ((op1_fn)ops[op])(c->args[0]);
+	else c->result = ((op2_fn)ops[op])(c->args[0], c->args[1]);
+	c->latency_ns = now_ns() - start;
+}
+
+static void *replayer_main(void *arg) {
+	struct replayer *r = arg;
+
+	pthread_barrier_wait(&start_barrier);
+	for (int i = 0; i < r->count; i++) issue(r->calls[i]);
+
+	return NULL;
+}
+
+// ----------------------------- REPORT ------------------------------
+
+static int cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Returns: the q-quantile of the n values, sorting them in place.
+ */
+static uint64_t quantile(uint64_t *v, int n, double q) {
+	qsort(v, n, sizeof(uint64_t), cmp_u64);
+	int idx = (int)(q * n + 0.999999) - 1;
+	if (idx < 0) idx = 0;
+	return v[idx];
+}
+
+static void report(const char *trace, const char *lib, struct call *calls, int n,
+		int threads, double secs, int verbose) {
+	static const char *mode_names[] = { "serial", "fast", "paced" };
+	int mismatches = 0;
+
+	for (int i = 0; i < n; i++) {
+		if (calls[i].result == calls[i].rec.result) continue;
+		mismatches++;
+		if (verbose) {
+			fprintf(stderr, "%s %s %s: recorded %d, replayed %d\n",
+				op_names[calls[i].rec.op], calls[i].args[0], calls[i].args[1],
+				calls[i].rec.result, calls[i].result);
+		}
+	}
+
+	printf("{\"trace\":\"%s\",\"lib\":\"%s\",\"mode\":\"%s\",\"calls\":%d,\"threads\":%d,"
+	       "\"secs\":%.6f,\"ops_per_sec\":%.1f,\"mismatches\":%d,\"ops\":{",
+	       trace, lib, mode_names[mode], n, threads, secs,
+	       secs > 0 ? n / secs : 0.0, mismatches);
+
+	uint64_t *replayed = malloc((n + 1) * sizeof(uint64_t));
+	uint64_t *recorded = malloc((n + 1) * sizeof(uint64_t));
+	if (replayed == NULL || recorded == NULL) die("out of memory");
+
+	int first = 1;
+	for (int op = 0; op < EXT2_FSAL_OP_COUNT; op++) {
+		int k = 0;
+		for (int i = 0; i < n; i++) {
+			if (calls[i].rec.op != op) continue;
+			replayed[k] = calls[i].latency_ns;
+			recorded[k] = calls[i].rec.duration_ns;
+			k++;
+		}
+		if (k == 0) continue;
+
+		printf("%s\"%s\":{\"count\":%d,\"p50_ns\":%llu,\"p99_ns\":%llu,"
+		       "\"recorded_p50_ns\":%llu,\"recorded_p99_ns\":%llu}",
+		       first ? "" : ",", op_names[op], k,
+		       (unsigned long long)quantile(replayed, k, 0.50),
+		       (unsigned long long)quantile(replayed, k, 0.99),
+		       (unsigned long long)quantile(recorded, k, 0.50),
+		       (unsigned long long)quantile(recorded, k, 0.99));
+		first = 0;
+	}
+	printf("}}\n");
+
+	free(replayed);
+	free(recorded);
+}
+
+/*
+ * Copies the file at src to dst.
+ */
+static void copy_file(const char *src, const char *dst) {
+	char buf[65536];
+	ssize_t n;
+
+	int in = open(src, O_RDONLY);
+	int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (in < 0 || out < 0) die("cannot copy image");
+
+	while ((n = read(in, buf, sizeof(buf))) > 0) {
+		if (write(out, buf, n) != n) die("cannot copy image");
+	}
+	close(in);
+	close(out);
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: ext2_replay [-l lib] [-m serial|fast|paced] [-o out] [-v] trace image\n");
+	exit(2);
+}
+
+int main(int argc, char **argv) {
+	const char *lib = "libext2fsal.so";
+	const char *out = NULL;
+	int verbose = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:m:o:v")) != -1) {
+		switch (opt) {
+			case 'l': lib = optarg; break;
+			case 'o': out = optarg; break;
+			case 'v': verbose = 1; break;
+			case 'm':
+				if (strcmp(optarg, "serial") == 0) mode = MODE_SERIAL;
+				else if (strcmp(optarg, "fast") == 0) mode = MODE_FAST;
+				else if (strcmp(optarg, "paced") == 0) mode = MODE_PACED;
+				else usage();
+				break;
+			default: usage();
+		}
+	}
+	if (argc - optind != 2) usage();
+	const char *trace = argv[optind];
+	const char *image = argv[optind + 1];
+
+	// the replay must not be traced into the file it reads
+	unsetenv("EXT2FSAL_TRACE");
+
+	void *h = dlopen(lib, RTLD_NOW);
+	if (h == NULL) die(dlerror());
+
+	void (*init)(const char *) = dlsym(h, "ext2_fsal_init");
+	void (*destroy)(void) = dlsym(h, "ext2_fsal_destroy");
+	if (init == NULL || destroy == NULL) die("library lacks ext2_fsal_init/destroy");
+
+	int n;
+	struct call *calls = load_trace(trace, &n);
+	qsort(calls, n, sizeof(struct call), cmp_start);
+
+	for (int i = 0; i < n; i++) {
+		int op = calls[i].rec.op;
+		if (ops[op] != NULL) continue;
+
+		char name[64];
+		snprintf(name, sizeof(name), "ext2_fsal_%s", op_names[op]);
+		ops[op] = dlsym(h, name);
+		if (ops[op] == NULL) {
+			fprintf(stderr, "ext2_replay: %s missing from %s\n", name, lib);
+			exit(2);
+		}
+	}
+
+	// replay into out, or a scratch copy that is removed afterwards
+	char scratch[64];
+	if (out == NULL) {
+		strcpy(scratch, "/tmp/ext2_replay.XXXXXX");
+		int fd = mkstemp(scratch);
+		if (fd < 0) die("cannot create scratch image");
+		close(fd);
+		out = scratch;
+	}
+	copy_file(image, out);
+
+	int threads;
+	struct replayer *r = split_threads(calls, n, &threads);
+	pthread_barrier_init(&start_barrier, NULL, threads + 1);
+
+	init(out);
+	for (int t = 0; t < threads; t++) {
+		if (pthread_create(&r[t].thread, NULL, replayer_main, &r[t]) != 0)
+			die("cannot create thread");
+	}
+
+	base_ns = now_ns();
+	uint64_t first_ns = n > 0 ? calls[0].rec.start_ns : 0;
+	base_ns -= first_ns;
+	pthread_barrier_wait(&start_barrier);
+	for (int t = 0; t < threads; t++) pthread_join(r[t].thread, NULL);
+	double secs = (now_ns() - base_ns - first_ns) / 1e9;
+	destroy();
+
+	report(trace, lib, calls, n, threads, secs, verbose);
+
+	if (out == scratch) unlink(scratch);
+	for (int t = 0; t < threads; t++) free(r[t].calls);
+	free(r);
+	for (int i = 0; i < n; i++) {
+		free(calls[i].args[0]);
+		free(calls[i].args[1]);
+	}
+	free(calls);
+	pthread_barrier_destroy(&start_barrier);
+	return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ *------------
+ * This code is provided solely for the personal and private use of
+ * students taking the CSC369H5 course at the University of Toronto.
+ * Copying for purposes other than this use is expressly prohibited.
+ * All forms of distribution of this code, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2025 MCS @ UTM
+ * -------------
+ */
+
+/*
+ * Runs a script of operations against an image in one process, using
+ * the build of libext2fsal.so -l names. Each argument after the image
+ * is one call, its words separated by spaces:
+ *
+ *   "rename /a /b"   "rm_r /d"   "mkdir_p /x/y"   "cp_r host /dst"
+ *
+ * i.e. any ext2_fsal_<op> taking one or two path arguments. Each call
+ * and its result are printed as "<call> -> <errno>", so the
+ * self-tester can check results as well as the image the calls leave.
+ * The exit status is 0 once every call has run, 2 on a usage error.
+ *
+ * usage: ./ext2_run [-l lib] image call...
+ */
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_WORDS 4
+
+typedef int32_t (*op1_fn)(const char *);
+typedef int32_t (*op2_fn)(const char *, const char *);
+
+static void die(const char *msg) {
+	fprintf(stderr, "ext2_run: %s\n", msg);
+	exit(2);
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: ext2_run [-l lib] image call...\n");
+	exit(2);
+}
+
+/*
+ * Splits call into at most MAX_WORDS space separated words, in place.
+ *
+ * Returns: the number of words.
+ */
+static int split(char *call, char **words) {
+	int n = 0;
+	char *save;
+	for (char *w = strtok_r(call, " ", &save); w != NULL && n < MAX_WORDS;
+	     w = strtok_r(NULL, " ", &save))
+		words[n++] = w;
+	return n;
+}
+
+/*
+ * Runs one call through library h.
+ *
+ * Returns: the call's result.
+ */
+static int32_t run(void *h, int n, char **words) {
+	char name[64];
+	snprintf(name, sizeof(name), "ext2_fsal_%s", words[0]);
+	void *fn = dlsym(h, name);
+	if (fn == NULL) {
+		fprintf(stderr, "ext2_run: no %s\n", name);
+		exit(2);
+	}
+
+	if (n == 2) return ((op1_fn)fn)(words[1]);
+	if (n == 3) return ((op2_fn)fn)(words[1], words[2]);
+	usage();
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	const char *lib = "libext2fsal.so";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:")) != -1) {
+		switch (opt) {
+			case 'l': lib = optarg; break;
+			default: usage();
+		}
+	}
+	if (argc - optind < 1) usage();
+	const char *image = argv[optind];
+
+	void *h = dlopen(lib, RTLD_NOW);
+	if (h == NULL) die(dlerror());
+
+	void (*init)(const char *) = dlsym(h, "ext2_fsal_init");
+	void (*destroy)(void) = dlsym(h, "ext2_fsal_destroy");
+	if (init == NULL || destroy == NULL) die("library lacks ext2_fsal_init/destroy");
+
+	init(image);
+	for (int i = optind + 1; i < argc; i++) {
+		char *call = strdup(argv[i]);
+		char *words[MAX_WORDS];
+		if (call == NULL) die("out of memory");
+
+		int n = split(call, words);
+		if (n == 0) usage();
+		printf("%s -> %d\n", argv[i], run(h, n, words));
+		free(call);
+	}
+	destroy();
+	return 0;
+}